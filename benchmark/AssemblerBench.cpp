@@ -0,0 +1,178 @@
+//Regression benchmark for the assembler on machine generated sources like the node editor's: generates a program with
+//the requested number of symbols (statics, functions with arguments and locals, labels), then times compiling it.
+//--write=[file] also saves the generated source, which compile and cRun accept like any other .bca.
+//Prints the results as JSON on stdout, progress goes to stderr.
+//usage: AssemblerBench [--symbols=N] [--warmup=N] [--reps=N] [--write=file.bca]
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../source/AssemblyCompiler.h"
+
+//Every function declares 2 arguments, LOCALS locals and a label besides its own name
+static const uint32 LOCALS = 4;
+static const uint32 SYMBOLS_PER_FUNCTION = 1 + 2 + LOCALS + 1;
+
+static uint64 NowNs()
+{
+	return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+static uint64 Median(std::vector<uint64> values)
+{
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+//Half of the symbols are statics the main code initializes, the other half belong to functions. Main calls every
+//function once and stores its result in a static, each function loads two statics, so every kind of symbol is
+//defined once and referenced several times
+static std::vector<std::string> Generate(uint32 symbols)
+{
+	uint32 functions = std::max(symbols / (2 * SYMBOLS_PER_FUNCTION), 1u);
+	uint32 used = functions * SYMBOLS_PER_FUNCTION + 1;	//+ @end
+	uint32 statics = symbols > used ? symbols - used : 1;
+
+	std::vector<std::string> lines;
+	auto line = [&lines](const std::string &text) { lines.push_back(text); };
+	auto number = [](uint32 value) { return std::to_string(value); };
+
+	line("//generated by AssemblerBench");
+	for(uint32 i = 0; i < statics; ++i)
+	{
+		line("LITERAL " + number(i));
+		line("LITERAL #static_" + number(i));
+		line("STORE");
+	}
+	for(uint32 f = 0; f < functions; ++f)
+	{
+		line("LITERAL #static_" + number(f % statics));
+		line("LOAD");
+		line("LITERAL " + number(f));
+		line("LITERAL $function_" + number(f));
+		line("CALL");
+		line("LITERAL #static_" + number((f * 7) % statics));
+		line("STORE");
+	}
+	line("LITERAL @end");
+	line("JMP");
+
+	for(uint32 f = 0; f < functions; ++f)
+	{
+		std::string id = number(f);
+		line("$function_" + id + " #a_" + id + " #b_" + id);
+		for(uint32 local = 0; local < LOCALS; ++local)
+		{
+			line("LITERAL #static_" + number((f + local) % statics));
+			line("LOAD");
+			line("LITERAL #l" + number(local) + "_" + id);
+			line("STORE_LCL");
+		}
+		line("@loop_" + id);
+		line("LITERAL #l0_" + id);
+		line("LOAD_LCL");
+		line("LITERAL #a_" + id);
+		line("LOAD_ARG");
+		line("ADD");
+		line("LITERAL #b_" + id);
+		line("LOAD_ARG");
+		line("ADD");
+		line("RETURN");
+	}
+	line("@end");
+	return lines;
+}
+
+//The compiler reports every symbol on stdout, which has to stay clean for the results
+static bool Compile(const std::vector<std::string> &lines, uint64 &ns, size_t &bytes)
+{
+	std::ostringstream discard;
+	std::streambuf* pCout = std::cout.rdbuf(discard.rdbuf());
+	uint64 start = NowNs();
+	AssemblyCompiler compiler;
+	compiler.SetSource(lines);
+	compiler.Compile();
+	ns = NowNs() - start;
+	std::cout.rdbuf(pCout);
+	if(compiler.GetState() != AssemblyCompiler::CompState::COMPILED)
+	{
+		std::cerr << "[BENCH] Generated source did not compile" << std::endl;
+		return false;
+	}
+	bytes = compiler.GetBytecode().size();
+	return true;
+}
+
+static bool ParseCount(const std::string &arg, const std::string &flag, uint32 &count)
+{
+	if(arg.compare(0, flag.size(), flag) != 0) return false;
+	count = static_cast<uint32>(std::stoul(arg.substr(flag.size())));
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	uint32 symbols = 100000;
+	uint32 warmup = 1;
+	uint32 repetitions = 5;
+	std::string writeFile;
+	static const std::string WriteFlag("--write=");
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		if(arg.compare(0, WriteFlag.size(), WriteFlag) == 0)
+		{
+			writeFile = arg.substr(WriteFlag.size());
+			continue;
+		}
+		try
+		{
+			if(ParseCount(arg, "--symbols=", symbols) || ParseCount(arg, "--warmup=", warmup) || ParseCount(arg, "--reps=", repetitions)) continue;
+		}
+		catch(const std::exception&)
+		{
+		}
+		std::cerr << "[BENCH] Invalid option: " << arg << std::endl;
+		return 1;
+	}
+	if(repetitions == 0) repetitions = 1;
+
+	std::vector<std::string> lines = Generate(symbols);
+	if(!writeFile.empty())
+	{
+		std::ofstream file(writeFile);
+		for(const std::string &text : lines) file << text << '\n';
+		if(!file.good())
+		{
+			std::cerr << "[BENCH] Could not write " << writeFile << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<uint64> compileNs;
+	size_t bytes = 0;
+	for(uint32 rep = 0; rep < warmup + repetitions; ++rep)
+	{
+		std::cerr << "[BENCH] " << symbols << " symbols, run " << rep + 1 << std::endl;
+		uint64 ns;
+		if(!Compile(lines, ns, bytes)) return 3;
+		if(rep >= warmup) compileNs.push_back(ns);
+	}
+
+	uint64 median = Median(compileNs);
+	std::cout << "{\n";
+	std::cout << "\t\"symbols\": " << symbols << ",\n";
+	std::cout << "\t\"lines\": " << lines.size() << ",\n";
+	std::cout << "\t\"bytecodeBytes\": " << bytes << ",\n";
+	std::cout << "\t\"warmup\": " << warmup << ",\n";
+	std::cout << "\t\"repetitions\": " << repetitions << ",\n";
+	std::cout << "\t\"compileNsMin\": " << *std::min_element(compileNs.begin(), compileNs.end()) << ",\n";
+	std::cout << "\t\"compileNsMedian\": " << median << ",\n";
+	std::cout << "\t\"nsPerLine\": " << static_cast<double>(median) / static_cast<double>(lines.size()) << "\n";
+	std::cout << "}" << std::endl;
+	return 0;
+}
@@ -0,0 +1,281 @@
+//Benchmark harness for the interpreter: compiles every program of the corpus once, counts the instructions it executes,
+//then times startup and execution over a number of repetitions after warming up. Program output goes to a null sink.
+//Each program is also run on the register form of its image, with its dispatches and run time reported next to the stack code's.
+//Prints the results as JSON on stdout so runs can be compared by scripts, progress goes to stderr.
+//usage: Benchmark [--warmup=N] [--reps=N] [program.bca ...]
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef PLATFORM_Win
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+	#include <sys/wait.h>
+	#include <unistd.h>
+#endif
+
+#include "../source/AssemblyCompiler.h"
+#include "../source/VirtualMachine.h"
+#include "../source/RegisterCode.h"
+
+//Run from the repository root, like the Bytecode project
+static const char* DefaultPrograms[] =
+{
+	"benchmark/programs/Fib.bca",
+	"benchmark/programs/NestedLoops.bca",
+	"benchmark/programs/DeepCalls.bca",
+	"benchmark/programs/AllocStorm.bca",
+	"benchmark/programs/PrintNull.bca",
+	"benchmark/programs/MultLoops.bca",
+};
+
+struct Result
+{
+	std::string file;
+	uint64 dispatches = 0;
+	uint64 instructions = 0;
+	std::vector<uint64> startupNs;	//Creating the VM and setting the program
+	std::vector<uint64> runNs;		//Interpret only
+	uint64 registerDispatches = 0;
+	uint64 registerBuildNs = 0;		//Converting the image to register code, once per image
+	std::vector<uint64> registerRunNs;	//InterpretRegisters on VMs sharing one image
+	uint64 peakRssKb = 0;			//Peak of a process running only this program, 0 if it couldn't be measured
+};
+
+//Makes the harness run a program once and exit, in the child process that measures its peak RSS
+static const std::string PeakRssFlag("--peak-rss=");
+
+static uint64 NowNs()
+{
+	return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+//Runs the harness with PeakRssFlag in a child process, so every program starts from the same baseline instead of the
+//peak the harness reached with the programs before it
+static uint64 MeasurePeakRssKb(const char* self, const std::string &filename)
+{
+#ifdef PLATFORM_Win
+	std::string command = std::string("\"") + self + "\" \"" + PeakRssFlag + filename + "\"";
+	STARTUPINFOA startup = {};
+	startup.cb = sizeof(startup);
+	PROCESS_INFORMATION process = {};
+	if(!CreateProcessA(nullptr, &command[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process)) return 0;
+	WaitForSingleObject(process.hProcess, INFINITE);
+	DWORD exitCode = 1;
+	PROCESS_MEMORY_COUNTERS counters;
+	bool measured = GetExitCodeProcess(process.hProcess, &exitCode) && exitCode == 0 && GetProcessMemoryInfo(process.hProcess, &counters, sizeof(counters));
+	CloseHandle(process.hThread);
+	CloseHandle(process.hProcess);
+	return measured ? static_cast<uint64>(counters.PeakWorkingSetSize / 1024) : 0;
+#else
+	std::string flag = PeakRssFlag + filename;
+	pid_t child = fork();
+	if(child < 0) return 0;
+	if(child == 0)
+	{
+		execlp(self, self, flag.c_str(), static_cast<char*>(nullptr));
+		_exit(127);
+	}
+	int status = 0;
+	rusage usage;
+	if(wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 0;
+	return static_cast<uint64>(usage.ru_maxrss);	//Kilobytes on Linux
+#endif
+}
+
+static uint64 Median(std::vector<uint64> values)
+{
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+//The compiler reports every symbol on stdout, which has to stay clean for the results
+static bool Compile(const std::string &filename, std::vector<uint8> &bytecode)
+{
+	std::ostringstream discard;
+	std::streambuf* pCout = std::cout.rdbuf(discard.rdbuf());
+	AssemblyCompiler compiler;
+	compiler.LoadSource(filename);
+	compiler.Compile();
+	std::cout.rdbuf(pCout);
+	if(compiler.GetState() != AssemblyCompiler::CompState::COMPILED)
+	{
+		std::cerr << "[BENCH] Could not compile " << filename << std::endl;
+		return false;
+	}
+	bytecode = compiler.GetBytecode();
+	return true;
+}
+
+//What the child process measured by MeasurePeakRssKb runs: one run of the stack code and one of the register code
+static bool RunOnce(const std::string &filename)
+{
+	std::vector<uint8> bytecode;
+	if(!Compile(filename, bytecode)) return false;
+	NullSink output;
+	auto image = std::make_shared<ProgramImage>();
+	if(!image->SetBytecode(bytecode.data(), bytecode.size())) return false;
+	{
+		VirtualMachine vm;
+		if(!vm.SetProgram(image)) return false;
+		vm.SetOutput(&output);
+		if(vm.Interpret() != RunStatus::FINISHED) return false;
+	}
+	VirtualMachine vm;
+	if(!vm.SetProgram(image)) return false;
+	vm.SetOutput(&output);
+	return vm.InterpretRegisters() == RunStatus::FINISHED;
+}
+
+static bool Run(const std::string &filename, uint32 warmup, uint32 repetitions, Result &result)
+{
+	std::vector<uint8> bytecode;
+	if(!Compile(filename, bytecode)) return false;
+	result.file = filename;
+	NullSink output;
+
+	{
+		VirtualMachine vm;
+		if(!vm.SetProgram(bytecode)) return false;
+		vm.SetOutput(&output);
+		DispatchCounter counter;
+		vm.Interpret(counter);
+		result.dispatches = counter.dispatches;
+		result.instructions = counter.instructions;
+	}
+
+	for(uint32 rep = 0; rep < warmup + repetitions; ++rep)
+	{
+		uint64 start = NowNs();
+		VirtualMachine* pVM = new VirtualMachine();
+		if(!pVM->SetProgram(bytecode))
+		{
+			delete pVM;
+			return false;
+		}
+		uint64 loaded = NowNs();
+		pVM->SetOutput(&output);
+		pVM->Interpret();
+		uint64 end = NowNs();
+		delete pVM;
+
+		if(rep < warmup) continue;
+		result.startupNs.push_back(loaded - start);
+		result.runNs.push_back(end - loaded);
+	}
+
+	auto image = std::make_shared<ProgramImage>();
+	if(!image->SetBytecode(bytecode.data(), bytecode.size())) return false;
+	uint64 buildStart = NowNs();
+	image->GetRegisterCode();
+	result.registerBuildNs = NowNs() - buildStart;
+	{
+		VirtualMachine vm;
+		if(!vm.SetProgram(image)) return false;
+		vm.SetOutput(&output);
+		if(vm.InterpretRegisters(&result.registerDispatches) != RunStatus::FINISHED) return false;
+	}
+	for(uint32 rep = 0; rep < warmup + repetitions; ++rep)
+	{
+		VirtualMachine vm;
+		if(!vm.SetProgram(image)) return false;
+		vm.SetOutput(&output);
+		uint64 start = NowNs();
+		vm.InterpretRegisters();
+		uint64 end = NowNs();
+		if(rep >= warmup) result.registerRunNs.push_back(end - start);
+	}
+	return true;
+}
+
+static void WriteJson(std::ostream &stream, const std::vector<Result> &results, uint32 warmup, uint32 repetitions)
+{
+	stream << "{\n";
+#ifdef VM_THREADED_DISPATCH
+	stream << "\t\"dispatch\": \"threaded\",\n";
+#else
+	stream << "\t\"dispatch\": \"switch\",\n";
+#endif
+#ifdef VM_CACHE_TOS
+	stream << "\t\"tosCache\": true,\n";
+#else
+	stream << "\t\"tosCache\": false,\n";
+#endif
+#ifdef VM_JIT
+	stream << "\t\"jit\": true,\n";
+#else
+	stream << "\t\"jit\": false,\n";
+#endif
+	stream << "\t\"warmup\": " << warmup << ",\n";
+	stream << "\t\"repetitions\": " << repetitions << ",\n";
+	stream << "\t\"benchmarks\": [";
+	for(size_t i = 0; i < results.size(); ++i)
+	{
+		const Result &result = results[i];
+		uint64 median = Median(result.runNs);
+		double seconds = static_cast<double>(median) * 1e-9;
+		stream << (i == 0 ? "\n" : ",\n") << "\t\t{\n";
+		stream << "\t\t\t\"file\": \"" << result.file << "\",\n";
+		stream << "\t\t\t\"dispatches\": " << result.dispatches << ",\n";
+		stream << "\t\t\t\"instructions\": " << result.instructions << ",\n";
+		stream << "\t\t\t\"startupNsMedian\": " << Median(result.startupNs) << ",\n";
+		stream << "\t\t\t\"runNsMin\": " << *std::min_element(result.runNs.begin(), result.runNs.end()) << ",\n";
+		stream << "\t\t\t\"runNsMedian\": " << median << ",\n";
+		stream << "\t\t\t\"instructionsPerSecond\": " << (median == 0 ? 0.0 : static_cast<double>(result.instructions) / seconds) << ",\n";
+		stream << "\t\t\t\"nsPerDispatch\": " << (result.dispatches == 0 ? 0.0 : static_cast<double>(median) / static_cast<double>(result.dispatches)) << ",\n";
+		stream << "\t\t\t\"registerDispatches\": " << result.registerDispatches << ",\n";
+		stream << "\t\t\t\"registerBuildNs\": " << result.registerBuildNs << ",\n";
+		stream << "\t\t\t\"registerRunNsMedian\": " << Median(result.registerRunNs) << ",\n";
+		stream << "\t\t\t\"peakRssKb\": " << result.peakRssKb << "\n";
+		stream << "\t\t}";
+	}
+	stream << "\n\t]\n}" << std::endl;
+}
+
+static bool ParseCount(const std::string &arg, const std::string &flag, uint32 &count)
+{
+	if(arg.compare(0, flag.size(), flag) != 0) return false;
+	count = static_cast<uint32>(std::stoul(arg.substr(flag.size())));
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	uint32 warmup = 1;
+	uint32 repetitions = 5;
+	std::vector<std::string> programs;
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg(argv[i]);
+		if(arg.compare(0, PeakRssFlag.size(), PeakRssFlag) == 0) return RunOnce(arg.substr(PeakRssFlag.size())) ? 0 : 3;
+		try
+		{
+			if(ParseCount(arg, "--warmup=", warmup) || ParseCount(arg, "--reps=", repetitions)) continue;
+		}
+		catch(const std::exception&)
+		{
+			std::cerr << "[BENCH] Invalid option: " << arg << std::endl;
+			return 1;
+		}
+		programs.push_back(arg);
+	}
+	if(repetitions == 0) repetitions = 1;
+	if(programs.empty()) programs.assign(std::begin(DefaultPrograms), std::end(DefaultPrograms));
+
+	std::vector<Result> results;
+	for(const std::string &program : programs)
+	{
+		std::cerr << "[BENCH] " << program << std::endl;
+		Result result;
+		if(!Run(program, warmup, repetitions, result)) return 3;
+		result.peakRssKb = MeasurePeakRssKb(argv[0], program);
+		results.push_back(result);
+	}
+	WriteJson(std::cout, results, warmup, repetitions);
+	return 0;
+}
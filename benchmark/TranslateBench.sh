@@ -0,0 +1,61 @@
+#!/bin/sh
+# Compares the interpreter with programs translated to C++ by the translate command.
+# Run it from the repository root after building Bytecode:
+#   benchmark/TranslateBench.sh [Bytecode binary] [programs...]
+# The binary defaults to bin/release/Bytecode, the programs to the benchmark corpus. CXX and CXXFLAGS pick the compiler
+# translated programs are built with. Times are the best of REPS runs in milliseconds, outputs are compared too.
+
+BYTECODE=${1:-bin/release/Bytecode}
+[ $# -gt 0 ] && shift
+PROGRAMS=${*:-benchmark/programs/*.bca}
+CXX=${CXX:-c++}
+CXXFLAGS=${CXXFLAGS:--std=c++14 -O2}
+REPS=${REPS:-5}
+WORK=${TMPDIR:-/tmp}/TranslateBench.$$
+RUNTIME="source/TranslatedRuntime.cpp source/HeapAllocator.cpp source/OutputSink.cpp"
+
+mkdir -p "$WORK" || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+now_ms()
+{
+	# GNU date, falls back to whole seconds elsewhere
+	date +%s%3N 2>/dev/null | grep -v N || echo $(( $(date +%s) * 1000 ))
+}
+
+# best_of command... prints the fastest of REPS runs
+best_of()
+{
+	best=
+	rep=0
+	while [ $rep -lt "$REPS" ]; do
+		start=$(now_ms)
+		"$@" > /dev/null 2>&1
+		elapsed=$(( $(now_ms) - start ))
+		if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then best=$elapsed; fi
+		rep=$((rep + 1))
+	done
+	echo "$best"
+}
+
+printf "%-16s %12s %12s %9s  %s\n" "program" "interp ms" "native ms" "speedup" "output"
+for program in $PROGRAMS; do
+	name=$(basename "$program" .bca)
+	# compile writes the executable next to its source, so work on a copy
+	cp "$program" "$WORK/$name.bca" && "$BYTECODE" compile "$WORK/$name.bca" > /dev/null 2>&1
+	if ! "$BYTECODE" translate "$WORK/$name.bce" --output="$WORK/$name.cpp" > /dev/null 2>&1 ||
+		! $CXX $CXXFLAGS -I source "$WORK/$name.cpp" $RUNTIME -o "$WORK/$name" 2> "$WORK/$name.log"; then
+		echo "$name: could not translate or build, see the translate command and $CXX output"
+		cat "$WORK/$name.log" 2>/dev/null
+		continue
+	fi
+
+	"$BYTECODE" run "$WORK/$name.bce" 2>/dev/null | sed -e '1,2d' -e '/^$/d' -e '/^=*$/d' -e '/^script execution ended!$/d' > "$WORK/$name.interp"
+	"$WORK/$name" 2>/dev/null | sed -e '/^$/d' > "$WORK/$name.native"
+	if cmp -s "$WORK/$name.interp" "$WORK/$name.native"; then same=same; else same=DIFFERS; fi
+
+	interp=$(best_of "$BYTECODE" run "$WORK/$name.bce")
+	native=$(best_of "$WORK/$name")
+	speedup=$(awk -v i="$interp" -v n="$native" 'BEGIN { if(n > 0) printf "%.1fx", i / n; else print "-" }')
+	printf "%-16s %12s %12s %9s  %s\n" "$name" "$interp" "$native" "$speedup" "$same"
+done
@@ -0,0 +1,102 @@
+//Microbenchmark for VM word access: the byte by byte Pack/Unpack the VM used before the word format was defined,
+//against the native loads and stores of WordFormat.h. Reports nanoseconds per word operation.
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include "../source/WordFormat.h"
+
+namespace Bytewise
+{
+	inline uint32 Unpack(const uint8* ram, uint32 address)
+	{
+		return static_cast<uint8>(ram[address+3]) << 24 |
+			static_cast<uint8>(ram[address+2]) << 16 |
+			static_cast<uint8>(ram[address+1]) << 8 |
+			static_cast<uint8>(ram[address+0]);
+	}
+	inline void Pack(uint8* ram, uint32 address, uint32 n)
+	{
+		ram[address+3] = (n >> 24) & 0xFF;
+		ram[address+2] = (n >> 16) & 0xFF;
+		ram[address+1] = (n >> 8) & 0xFF;
+		ram[address+0] = n & 0xFF;
+	}
+}
+
+namespace Native
+{
+	inline uint32 Unpack(const uint8* ram, uint32 address)
+	{
+		return LoadWord(ram + address);
+	}
+	inline void Pack(uint8* ram, uint32 address, uint32 n)
+	{
+		StoreWord(ram + address, n);
+	}
+}
+
+static const uint32 RAM_SIZE = 1 << 24;
+static const uint32 STACK_DEPTH = 256;
+static const uint32 ITERATIONS = 1 << 24;
+
+//Push two words, pop them into an add and push the result, like LITERAL LITERAL ADD
+template<uint32 (*UNPACK)(const uint8*, uint32), void (*PACK)(uint8*, uint32, uint32)>
+uint32 StackOps(uint8* ram, uint64 &ops)
+{
+	int32 sp = -4;
+	uint32 result = 0;
+	for(uint32 i = 0; i < ITERATIONS; ++i)
+	{
+		PACK(ram, sp += 4, i);
+		PACK(ram, sp += 4, i ^ result);
+		uint32 b = UNPACK(ram, sp); sp -= 4;
+		uint32 a = UNPACK(ram, sp); sp -= 4;
+		PACK(ram, sp += 4, a + b);
+		result += UNPACK(ram, sp); sp -= 4;
+		if(sp > static_cast<int32>(STACK_DEPTH)) sp = -4;
+	}
+	ops += static_cast<uint64>(ITERATIONS) * 6;
+	return result;
+}
+
+//Load and store at scattered aligned addresses, like STORE and LOAD on statics and heap
+template<uint32 (*UNPACK)(const uint8*, uint32), void (*PACK)(uint8*, uint32, uint32)>
+uint32 MemoryOps(uint8* ram, uint64 &ops)
+{
+	uint32 address = 0;
+	uint32 result = 0;
+	for(uint32 i = 0; i < ITERATIONS; ++i)
+	{
+		address = (address * 1664525u + 1013904223u) & (RAM_SIZE - 4) & ~3u;
+		result += UNPACK(ram, address);
+		PACK(ram, address, result);
+	}
+	ops += static_cast<uint64>(ITERATIONS) * 2;
+	return result;
+}
+
+template<uint32 (*FUNC)(uint8*, uint64&)>
+void Measure(const char* name, uint8* ram)
+{
+	uint64 warmup = 0;
+	FUNC(ram, warmup);
+	uint64 ops = 0;
+	auto start = std::chrono::steady_clock::now();
+	volatile uint32 sink = FUNC(ram, ops);
+	(void)sink;
+	auto end = std::chrono::steady_clock::now();
+	double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	std::cout << std::left << std::setw(24) << name << std::fixed << std::setprecision(3) << ns / ops << " ns/op" << std::endl;
+}
+
+int main()
+{
+	std::vector<uint8> ram(RAM_SIZE, 0);
+	Measure<StackOps<Bytewise::Unpack, Bytewise::Pack>>("stack bytewise", ram.data());
+	Measure<StackOps<Native::Unpack, Native::Pack>>("stack native", ram.data());
+	Measure<MemoryOps<Bytewise::Unpack, Bytewise::Pack>>("memory bytewise", ram.data());
+	Measure<MemoryOps<Native::Unpack, Native::Pack>>("memory native", ram.data());
+	return 0;
+}
@@ -1,3 +1,35 @@
+newoption {
+    trigger = "switch-dispatch",
+    description = "Build the interpreter with the portable switch dispatch loop instead of computed goto"
+}
+
+newoption {
+    trigger = "no-tos-cache",
+    description = "Build the interpreter without caching the top of stack in a register"
+}
+
+newoption {
+    trigger = "jit",
+    description = "Build the x86-64 baseline JIT for hot functions (Linux and macOS)"
+}
+
+newoption {
+    trigger = "debug-heap",
+    description = "Print the heap free lists after every ALLOC and FREE"
+}
+
+newoption {
+    trigger = "superinstructions",
+    value = "PROFILE",
+    description = "Regenerate source/Superinstructions.inl from an opcode sequence profile before building"
+}
+
+newoption {
+    trigger = "superinstruction-count",
+    value = "N",
+    description = "Number of superinstructions to generate from the profile (default 8)"
+}
+
 solution "Bytecode"
     configurations {
         "Release",
@@ -41,6 +73,7 @@ project "Bytecode"
 --	flags {"-pedantic"}--
 	defines { "PLATFORM_Linux", "__linux__" }
 	includedirs { "/usr/include" }
+	links { "pthread" }
 
 	buildoptions_cpp
 	{
@@ -51,11 +84,38 @@ project "Bytecode"
 
     defines { "_CONSOLE" }
 
+    if _OPTIONS["switch-dispatch"] then
+        defines { "VM_SWITCH_DISPATCH" }
+    end
+
+    if _OPTIONS["no-tos-cache"] then
+        defines { "VM_NO_TOS_CACHE" }
+    end
+
+    if _OPTIONS["jit"] then
+        defines { "VM_JIT" }
+    end
+
+    if _OPTIONS["debug-heap"] then
+        defines { "VM_DEBUG_HEAP" }
+    end
+
+    if _OPTIONS["superinstructions"] then
+        local count = _OPTIONS["superinstruction-count"] or "8"
+        local generate = " " .. count .. " source/Superinstructions.inl " .. _OPTIONS["superinstructions"]
+        configuration "Debug"
+            prebuildcommands { "bin/debug/SuperinstructionGen" .. generate }
+        configuration "Release"
+            prebuildcommands { "bin/release/SuperinstructionGen" .. generate }
+        configuration {}
+    end
+
 	flags {"ExtraWarnings", "FatalWarnings"}
 
     files {
         path.join(SOURCE_DIR, "*.cpp"),
         path.join(SOURCE_DIR, "*.h"),
+        path.join(SOURCE_DIR, "*.inl"),
     }
 
     excludes {
@@ -66,3 +126,150 @@ project "Bytecode"
     -- optional. This is purely cosmetically.
     vpaths {
     }
+
+
+-- Generates source/Superinstructions.inl from opcode sequence profiles, build it before Bytecode
+project "SuperinstructionGen"
+    kind "ConsoleApp"
+
+    configuration "Debug"
+        targetdir "../bin/debug/"
+        objdir "obj/debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+    configuration "Release"
+        targetdir "../bin/release/"
+        objdir "obj/release"
+        flags {"OptimizeSpeed", "No64BitChecks"}
+
+    configuration { "linux", "gmake"}
+        buildoptions_cpp { "-std=c++14" }
+
+    configuration {}
+
+    flags {"ExtraWarnings", "FatalWarnings"}
+
+    files {
+        path.join(PROJECT_DIR, "tools/SuperinstructionGen.cpp"),
+        path.join(SOURCE_DIR, "Opcode.cpp"),
+        path.join(SOURCE_DIR, "Opcode.h"),
+        path.join(SOURCE_DIR, "*.inl"),
+    }
+
+
+-- Compares the old byte by byte word access against WordFormat.h
+project "WordAccessBench"
+    kind "ConsoleApp"
+
+    configuration "Debug"
+        targetdir "../bin/debug/"
+        objdir "obj/debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+    configuration "Release"
+        targetdir "../bin/release/"
+        objdir "obj/release"
+        flags {"OptimizeSpeed", "No64BitChecks"}
+
+    configuration { "linux", "gmake"}
+        buildoptions_cpp { "-std=c++14" }
+
+    configuration {}
+
+    flags {"ExtraWarnings", "FatalWarnings"}
+
+    files {
+        path.join(PROJECT_DIR, "benchmark/WordAccessBench.cpp"),
+        path.join(SOURCE_DIR, "WordFormat.h"),
+        path.join(SOURCE_DIR, "AtomicTypes.h"),
+    }
+
+
+-- Times the assembler on a generated source with 100k symbols
+project "AssemblerBench"
+    kind "ConsoleApp"
+
+    configuration "Debug"
+        targetdir "../bin/debug/"
+        objdir "obj/debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+    configuration "Release"
+        targetdir "../bin/release/"
+        objdir "obj/release"
+        flags {"OptimizeSpeed", "No64BitChecks"}
+
+    configuration { "linux", "gmake"}
+        buildoptions_cpp { "-std=c++14" }
+
+    configuration {}
+
+    flags {"ExtraWarnings", "FatalWarnings"}
+
+    files {
+        path.join(PROJECT_DIR, "benchmark/AssemblerBench.cpp"),
+        path.join(SOURCE_DIR, "AssemblyCompiler.cpp"),
+        path.join(SOURCE_DIR, "AssemblyCompiler.h"),
+        path.join(SOURCE_DIR, "AssemblyLexer.cpp"),
+        path.join(SOURCE_DIR, "AssemblyLexer.h"),
+        path.join(SOURCE_DIR, "ObjectFile.cpp"),
+        path.join(SOURCE_DIR, "ObjectFile.h"),
+        path.join(SOURCE_DIR, "MappedFile.cpp"),
+        path.join(SOURCE_DIR, "MappedFile.h"),
+        path.join(SOURCE_DIR, "SymbolTable.cpp"),
+        path.join(SOURCE_DIR, "SymbolTable.h"),
+        path.join(SOURCE_DIR, "Opcode.cpp"),
+        path.join(SOURCE_DIR, "Opcode.h"),
+        path.join(SOURCE_DIR, "*.inl"),
+    }
+
+
+-- Times the interpreter on the programs in benchmark/programs, run it from the repository root
+project "Benchmark"
+    kind "ConsoleApp"
+
+    configuration "Debug"
+        targetdir "../bin/debug/"
+        objdir "obj/debug"
+        defines { "_DEBUG" }
+        flags { "Symbols" }
+    configuration "Release"
+        targetdir "../bin/release/"
+        objdir "obj/release"
+        flags {"OptimizeSpeed", "No64BitChecks"}
+
+    configuration "vs*"
+        defines { "WIN32", "PLATFORM_Win" }
+        links { "psapi" }
+    configuration { "linux", "gmake"}
+        defines { "PLATFORM_Linux", "__linux__" }
+        buildoptions_cpp { "-std=c++14" }
+        links { "pthread" }
+
+    configuration {}
+
+    -- Measure the same interpreter configuration as the Bytecode project
+    if _OPTIONS["switch-dispatch"] then
+        defines { "VM_SWITCH_DISPATCH" }
+    end
+
+    if _OPTIONS["no-tos-cache"] then
+        defines { "VM_NO_TOS_CACHE" }
+    end
+
+    if _OPTIONS["jit"] then
+        defines { "VM_JIT" }
+    end
+
+    flags {"ExtraWarnings", "FatalWarnings"}
+
+    files {
+        path.join(PROJECT_DIR, "benchmark/Benchmark.cpp"),
+        path.join(SOURCE_DIR, "*.cpp"),
+        path.join(SOURCE_DIR, "*.h"),
+        path.join(SOURCE_DIR, "*.inl"),
+    }
+
+    excludes {
+        path.join(SOURCE_DIR, "main.cpp"),
+    }
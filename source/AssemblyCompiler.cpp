@@ -9,13 +9,14 @@
 
 #include "Opcode.h"
 #include "SymbolTable.h"
+#include "WordFormat.h"
 
 //Constructor Destructor
 AssemblyCompiler::AssemblyCompiler() = default;
 
 AssemblyCompiler::~AssemblyCompiler()
 {
-    m_Lines.clear();
+    m_Source.clear();
     m_Bytecode.clear();
 
 	delete m_pSymbolTable;
@@ -26,7 +27,12 @@ AssemblyCompiler::~AssemblyCompiler()
 //Input
 void AssemblyCompiler::SetSource(std::vector<std::string> lines)
 {
-    m_Lines = lines;
+    m_Source.clear();
+    for(const auto &line : lines)
+    {
+        m_Source += line;
+        m_Source += '\n';
+    }
     m_State = CompState::SOURCE;
 }
 bool AssemblyCompiler::LoadSource(std::string filename)
@@ -35,25 +41,26 @@ bool AssemblyCompiler::LoadSource(std::string filename)
     if(!file.good())
     {
         std::cerr << "[ASM CMP] Input filestream could not be created" << std::endl;
-        m_Lines.clear();
+        m_Source.clear();
         m_State = CompState::INIT;
         return false;
     }
 
-    std::string line;
-    while (std::getline(file, line))
-    {
-        m_Lines.push_back(line);
-    }
+    //Read in one piece, the lexer splits it into lines
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    m_Source.resize(size > 0 ? static_cast<size_t>(size) : 0);
+    file.read(&m_Source[0], static_cast<std::streamsize>(m_Source.size()));
+    m_Source.resize(static_cast<size_t>(file.gcount()));
 
-    if(m_Lines.empty())
+    if(m_Source.empty())
     {
         std::cerr << "[ASM CMP] No assembly lines loaded" << std::endl;
-        m_Lines.clear();
         m_State = CompState::INIT;
         return false;
     }
-    std::cout << "[ASM CMP] Assembly file loaded!" << std::endl;
+    if(!m_Quiet) std::cout << "[ASM CMP] Assembly file loaded!" << std::endl;
     m_State = CompState::SOURCE;
     return true;
 }
@@ -83,83 +90,115 @@ bool AssemblyCompiler::Compile()
 		m_pSymbolTable = new SymbolTable(m_StackSize);
 	else
 		std::cerr << "[ASM CMP] Symbol table already created!" << std::endl;
+	m_pSymbolTable->SetListing(!m_Quiet);
 
     //Do compilation
     if(!BuildSymbolTable())return false;
     if(!CompileInstructions())return false;
-    if(!CompileHeader())return false;
+    if(m_Relocatable)
+    {
+        if(!CompileObject())return false;
+    }
+    else if(!CompileHeader())return false;
 
-    std::cout << "[ASM CMP] Compilation Complete, no errors detected!" << std::endl;
+    if(!m_Quiet) std::cout << "[ASM CMP] Compilation Complete, no errors detected!" << std::endl;
     m_State = CompState::COMPILED;
     return true;
 }
 
 bool AssemblyCompiler::BuildSymbolTable()
 {
-	for(uint32 line = 0; line < m_Lines.size(); ++line)
+    m_Lexer.Lex(m_Source, *m_pSymbolTable);
+    const std::vector<Statement> &statements = m_Lexer.GetStatements();
+
+    std::vector<SourceInstruction> parts;
+	for(uint32 index = 0; index < statements.size(); ++index)
     {
-        std::string opname;
-        std::string arguments;
-        if(!TokenizeLine(m_Lines[line], opname, arguments))continue;
+        const Statement &statement = statements[index];
+        uint32 line = statement.line;
+        const Token* tokens = m_Lexer.GetTokens(statement);
 
 		//Jump labels
-        if(opname[0] == '@')
+        if(statement.kind == StatementKind::LABEL)
         {
-            if(!m_pSymbolTable->AddLabel(opname))
+            if(!m_pSymbolTable->AddLabel(statement.name))
             {
-                std::cerr << "[ASM CMP] " << line << ": label " << opname << " already defined!" << std::endl;
+                std::cerr << "[ASM CMP] " << line << ": label " << m_Lexer.GetOpname(statement) << " already defined!" << std::endl;
                 return false;
             }
 			continue;
         }
-        if(opname[0] == '$')
+        if(statement.kind == StatementKind::FUNCTION)
         {
-            if(!m_pSymbolTable->AddFunction(opname, arguments))
+            bool added = m_pSymbolTable->AddFunction(statement.name);
+            for(uint32 i = 0; added && i < statement.tokenCount; ++i)
+                added = m_pSymbolTable->AddVariable(static_cast<uint32>(tokens[i].value), true);
+            if(!added)
             {
-                std::cerr << "[ASM CMP] " << line << ": error adding function: " << opname << std::endl;
+                std::cerr << "[ASM CMP] " << line << ": error adding function: " << m_Lexer.GetOpname(statement) << std::endl;
                 return false;
             }
 			continue;
         }
 
-        if(!IsValidOpname(opname, line))return false;
-        Opcode code = OpcodeNames[opname];
+        if(!IsValidOpname(statement))return false;
+        Opcode code = statement.code;
 
-        switch(code)
+        //A run of instructions covered by a superinstruction is replaced with the fused opcode followed by their operands
+        Opcode fused;
+        if(MatchSuperinstruction(index, parts, fused))
         {
-        case Opcode::LITERAL:
+            m_pSymbolTable->m_NumInstructions++;
+            for(auto &part : parts)
             {
-                m_pSymbolTable->m_NumInstructions += 5; 
-                if(!HasValidArgs(arguments, line, opname))return false;
-                CheckVar(arguments);
+                if(!HasIntOperand(part.code))continue;
+                m_pSymbolTable->m_NumInstructions += 4;
+                const Statement &operand = statements[part.statement];
+                if(!HasValidArgs(operand, part.code))return false;
+                CheckVar(m_Lexer.GetTokens(operand)[0]);
             }
-            break;
+            index = parts.back().last;
+            continue;
+        }
+
+        if(HasIntOperand(code))
+        {
+            m_pSymbolTable->m_NumInstructions += 5; 
+            if(!HasValidArgs(statement, code))return false;
+            CheckVar(tokens[0]);
+
+            //A literal address consumed by the next instruction is folded into its immediate form
+            Opcode immediateForm;
+            uint32 consumer;
+            if(code == Opcode::LITERAL && FindImmediateConsumer(index, immediateForm, consumer)) index = consumer;
+            continue;
+        }
 
+        switch(code)
+        {
         case Opcode::LITERAL_ARRAY:
             {
-                if(!HasValidArgs(arguments, line, opname))return false;
+                if(!HasValidArgs(statement, code))return false;
 
-                if(arguments[0] == '\"')
+                if(tokens[0].kind == TokenKind::STRING)
                 {
-                    if(arguments.size()==1)
-                    {
-                        std::cerr << "[ASM CMP] " << line << ", " << opname << ": Incorrect argument size!" << std::endl;
-                        PrintAbort(line);
-                        return false;
-                    }
-                    uint32 j = 1;
-                    while(arguments[j] != '\"')
-                    {
-                        m_pSymbolTable->m_NumInstructions+=4;
-                        ++j;
-                    }
+                    m_pSymbolTable->m_NumInstructions += 4 * tokens[0].size;
+                }
+                else if(tokens[0].kind == TokenKind::INVALID && tokens[0].size > 0)
+                {
+                    if(tokens[0].size == 1)
+                        std::cerr << "[ASM CMP] " << line << ", " << m_Lexer.GetOpname(statement) << ": Incorrect argument size!" << std::endl;
+                    else
+                        std::cerr << "[ASM CMP] " << line << ", " << m_Lexer.GetOpname(statement) << R"(: Expected ' " ' !)" << std::endl;
+                    PrintAbort(line);
+                    return false;
                 }
                 else
                 {
-                    while(!arguments.empty())
+                    for(uint32 i = 0; i < statement.tokenCount; ++i)
                     {
                         m_pSymbolTable->m_NumInstructions+=4;
-                        CheckVar(arguments);
+                        CheckVar(tokens[i]);
                     }
                 }
                 m_pSymbolTable->m_NumInstructions+=5;
@@ -180,89 +219,87 @@ bool AssemblyCompiler::BuildSymbolTable()
 
 bool AssemblyCompiler::CompileInstructions()
 {
-    for(uint32 line = 0; line < m_Lines.size(); ++line)
+    const std::vector<Statement> &statements = m_Lexer.GetStatements();
+
+    std::vector<SourceInstruction> parts;
+    for(uint32 index = 0; index < statements.size(); ++index)
     {
-        std::string opname;
-        std::string arguments;
-        if(!TokenizeLine(m_Lines[line], opname, arguments))continue;
-        if(opname[0] == '@') continue; //Skip labels
-        if(opname[0] == '$') //Write num arguments and variables for function
+        const Statement &statement = statements[index];
+        uint32 line = statement.line;
+        const Token* tokens = m_Lexer.GetTokens(statement);
+        if(statement.kind == StatementKind::LABEL) continue; //Skip labels
+        if(statement.kind == StatementKind::FUNCTION) //Write function prologue with num arguments and variables
         {
-			WriteInt(m_pSymbolTable->GetFunctionArgCount(opname));
-			WriteInt(m_pSymbolTable->GetFunctionVarCount(opname));
+            m_Bytecode.push_back(static_cast<uint8>(Opcode::FRAME));
+			WriteInt(m_pSymbolTable->GetFunctionArgCount(statement.name));
+			WriteInt(m_pSymbolTable->GetFunctionVarCount(statement.name));
 			continue;
         }
 
-        if(!IsValidOpname(opname, line))return false;
+        if(!IsValidOpname(statement))return false;
 
-        Opcode code = OpcodeNames[opname];
+        Opcode code = statement.code;
 
-        switch(code)
+        Opcode fused;
+        if(MatchSuperinstruction(index, parts, fused))
         {
-        case Opcode::LITERAL:
+            m_Bytecode.push_back(static_cast<uint8>(fused));
+            for(auto &part : parts)
             {
-                if(!HasValidArgs(arguments, line, opname))return false;
-                int32 parsed;
-                if(ParseLiteral(parsed, arguments))
+                if(!HasIntOperand(part.code))continue;
+                const Statement &operand = statements[part.statement];
+                if(!HasValidArgs(operand, part.code))return false;
+                if(!WriteLiteral(m_Lexer.GetTokens(operand)[0]))
                 {
-                    m_Bytecode.push_back(static_cast<uint8>(code));
-                    WriteInt(parsed);
-                }
-                else
-                {
-                    PrintAbort(line);
+                    PrintAbort(operand.line);
                     return false;
-                } 
+                }
             }
-            break;
+            index = parts.back().last;
+            continue;
+        }
 
+        if(HasIntOperand(code))
+        {
+            if(!HasValidArgs(statement, code))return false;
+
+            //Must make the same decision as BuildSymbolTable, or the addresses in the symbol table are off
+            uint32 consumer;
+            if(code == Opcode::LITERAL && FindImmediateConsumer(index, code, consumer)) index = consumer;
+            m_Bytecode.push_back(static_cast<uint8>(code));
+            if(!WriteLiteral(tokens[0]))
+            {
+                PrintAbort(line);
+                return false;
+            }
+            continue;
+        }
+
+        switch(code)
+        {
         case Opcode::LITERAL_ARRAY:
             {
-                if(!HasValidArgs(arguments, line, opname))return false;
+                //BuildSymbolTable already rejected missing arguments and unterminated strings
                 m_Bytecode.push_back(static_cast<uint8>(code));
 
-                std::vector<int32> arr;
-                if(arguments[0] == '\"')
+                if(tokens[0].kind == TokenKind::STRING)
                 {
-                    if(arguments.size()==1)
-                    {
-                        std::cerr << "[ASM CMP] " << line << ", " << opname << ": Incorrect argument size!" << std::endl;
-                        PrintAbort(line);
-                        return false;
-                    }
-                    uint32 j = 1;
-                    while(arguments[j] != '\"')
-                    {
-                        if(j >= arguments.size())
-                        {
-                            std::cerr << "[ASM CMP] " << line << ", " << opname << R"(: Expected ' " ' !)" << std::endl;
-                            PrintAbort(line);
-                            return false;
-                        }
-                        arr.push_back(int32(arguments[j]));
-
-                        ++j;
-                    }
+                    TextView text = m_Lexer.GetText(tokens[0]);
+                    WriteInt(static_cast<int32>(text.size));
+                    for(uint32 j = 0; j < text.size; ++j) WriteInt(int32(text.data[j]));
                 }
                 else
                 {
-                    while(!arguments.empty())
+                    WriteInt(static_cast<int32>(statement.tokenCount));
+                    for(uint32 i = 0; i < statement.tokenCount; ++i)
                     {
-                        int32 parsed;
-                        if(ParseLiteral(parsed, arguments))
-                        {
-                            WriteInt(parsed);
-                            arr.push_back(parsed);
-                        }
-                        else
+                        if(!WriteLiteral(tokens[i]))
                         {
                             PrintAbort(line);
                             return false;
-                        } 
+                        }
                     }
                 }
-                WriteInt(static_cast<int32>(arr.size()));
-                for(auto value : arr) WriteInt(value);
             }
             break;
 
@@ -277,14 +314,29 @@ bool AssemblyCompiler::CompileInstructions()
 bool AssemblyCompiler::CompileHeader()
 {
     std::vector<uint8> header;
+    WriteInt(WORD_FORMAT_VERSION, header);
+    WriteInt(GetSuperinstructionSetId(), header);
     WriteInt(m_StackSize, header);
     WriteInt(m_pSymbolTable->GetStaticVarCount(), header);
+    WriteInt(m_HeapSize, header);
 
     m_HeaderSize = header.size();
     m_Bytecode.insert(m_Bytecode.begin(), header.begin(), header.end());
     return true;
 }
 
+bool AssemblyCompiler::CompileObject()
+{
+    //Addresses in the code are already module relative, see WriteLiteral
+    m_Object.code = m_Bytecode;
+    m_Object.staticSize = m_pSymbolTable->GetStaticVarCount();
+    for(const auto &function : m_pSymbolTable->GetFunctions())
+    {
+        m_Object.exports.emplace_back(function.first, function.second - m_StackSize);
+    }
+    return true;
+}
+
 
 //Output Results
 bool AssemblyCompiler::Save(std::string filename)
@@ -295,6 +347,13 @@ bool AssemblyCompiler::Save(std::string filename)
         return false;
     }
 
+    if(m_Relocatable)
+    {
+        if(!m_Object.Save(filename))return false;
+        if(!m_Quiet) std::cout << "[ASM CMP] Object file saved!" << std::endl;
+        return true;
+    }
+
     std::ofstream output( filename, std::ios::binary );
     if(!(output.good()))
     {
@@ -302,15 +361,17 @@ bool AssemblyCompiler::Save(std::string filename)
         return false;
     }
 
-    for(uint8 i : m_Bytecode)
+    output.write(reinterpret_cast<const char*>(m_Bytecode.data()), static_cast<std::streamsize>(m_Bytecode.size()));
+    if(!(output.good()))
     {
-        output << i;
+        std::cerr << "[ASM CMP] File not saved, writing " << filename << " failed" << std::endl;
+        return false;
     }
 
-    std::cout << "[ASM CMP] Executable saved!" << std::endl;
+    if(!m_Quiet) std::cout << "[ASM CMP] Executable saved!" << std::endl;
     return true;
 }
-std::vector<uint8> AssemblyCompiler::GetBytecode()
+const std::vector<uint8>& AssemblyCompiler::GetBytecode() const
 {
     if(!(m_State == CompState::COMPILED))
     {
@@ -321,125 +382,140 @@ std::vector<uint8> AssemblyCompiler::GetBytecode()
 
 
 //Parsing helpers
-bool AssemblyCompiler::TokenizeLine(std::string line, std::string &opname, std::string &arguments)
+bool AssemblyCompiler::IsValidOpname(const Statement &statement)
 {
-    //Comment
-    if(line.size() > 1 && line[0] == '/' && line[1] == '/')
-        return false;
-    //Empty Line
-    if(line.empty())
-        return false;
-    //get op and arguments
-    std::size_t firstSpace = line.find(' ');
-    if(firstSpace!=std::string::npos)
+    if(statement.kind != StatementKind::INSTRUCTION)
     {
-        opname = line.substr(0, firstSpace);
-        if(firstSpace < line.size()-1)
-            arguments = line.substr(firstSpace+1);
+        std::cerr << "[ASM CMP] " << statement.line << ": Invalid Opcode '" << m_Lexer.GetOpname(statement) << "'!" << std::endl;
+        PrintAbort(statement.line);
+        return false;
     }
-    else opname = line;
-
     return true;
 }
-bool AssemblyCompiler::IsValidOpname(std::string opname, uint32 line)
+
+bool AssemblyCompiler::FindImmediateConsumer(uint32 statement, Opcode &immediateForm, uint32 &consumer)
 {
-    if(!(OpcodeNames.count(opname)))
-    {
-        std::cerr << "[ASM CMP] " << line << ": Invalid Opcode '" << opname << "'!" << std::endl;
-        PrintAbort(line);
-        return false;
-    }
-    return true;
+    consumer = statement + 1;
+    const std::vector<Statement> &statements = m_Lexer.GetStatements();
+    //Labels and functions are jump targets, so the instruction after them can't absorb the literal
+    if(consumer >= statements.size() || statements[consumer].kind != StatementKind::INSTRUCTION)return false;
+    return GetImmediateForm(statements[consumer].code, immediateForm);
 }
 
-void AssemblyCompiler::CheckVar(std::string &arguments)
+bool AssemblyCompiler::MatchSuperinstruction(uint32 statement, std::vector<SourceInstruction> &parts, Opcode &fused)
 {
-    //Separate first argument out
-    std::string arg;
-    std::size_t nDelim = arguments.find(' ', 1);
-    if(nDelim == std::string::npos)
+    parts.clear();
+    const std::vector<Statement> &statements = m_Lexer.GetStatements();
+    uint32 next = statement;
+    while(parts.size() < MAX_SUPERINSTRUCTION_LENGTH && next < statements.size())
     {
-        arg = arguments;
-        arguments = std::string();
+        //Labels and functions are jump targets, a superinstruction can't span them
+        if(statements[next].kind != StatementKind::INSTRUCTION)break;
+
+        SourceInstruction instruction;
+        instruction.code = statements[next].code;
+        instruction.statement = next;
+        instruction.last = next;
+        Opcode immediateForm;
+        uint32 consumer;
+        if(instruction.code == Opcode::LITERAL && FindImmediateConsumer(next, immediateForm, consumer))
+        {
+            instruction.code = immediateForm;
+            instruction.last = consumer;
+        }
+        parts.push_back(instruction);
+        next = instruction.last + 1;
     }
-    else
+
+    //Longest match first
+    Opcode sequence[MAX_SUPERINSTRUCTION_LENGTH];
+    for(uint32 length = static_cast<uint32>(parts.size()); length >= 2; --length)
     {
-        arg = arguments.substr(0, nDelim);
-        arguments = arguments.substr(nDelim+1);
+        for(uint32 i = 0; i < length; ++i) sequence[i] = parts[i].code;
+        if(FindSuperinstruction(sequence, length, fused))
+        {
+            parts.resize(length);
+            return true;
+        }
     }
+    return false;
+}
+
+void AssemblyCompiler::CheckVar(const Token &token)
+{
     //Handle found variable
-    if(arg[0]=='#')
+    if(token.kind == TokenKind::SYMBOL && m_pSymbolTable->GetName(static_cast<uint32>(token.value))[0] == '#')
     {
-		m_pSymbolTable->AddVariable(arg);
+		m_pSymbolTable->AddVariable(static_cast<uint32>(token.value));
     }
 }
 
-bool AssemblyCompiler::HasValidArgs(std::string arguments, uint32 line, std::string opname)
+bool AssemblyCompiler::HasValidArgs(const Statement &statement, Opcode code)
 {
-    if(arguments.empty())
+    if(statement.tokenCount == 0)
     {
-        std::cerr <<"[ASM CMP] " << line << ", " << opname << ": Incorrect amount of arguments!" << std::endl;
-        PrintAbort(line);
+        std::cerr <<"[ASM CMP] " << statement.line << ", " << GetOpString(code) << ": Incorrect amount of arguments!" << std::endl;
+        PrintAbort(statement.line);
         return false;
     }
     return true;
 }
-bool isNumber(const std::string& s)
-{
-    std::string::const_iterator it = s.begin();
-    while (it != s.end() && std::isdigit(*it)) ++it;
-    return !s.empty() && it == s.end();
-}
-bool AssemblyCompiler::ParseLiteral(int32 &out, std::string &arguments)
+bool AssemblyCompiler::ParseLiteral(int32 &out, const Token &token)
 {
-    if((arguments[0]=='#') || (arguments[0]=='@') || (arguments[0]=='$')) //Replace mnemonics (variables, lables, functions)
+    switch(token.kind)
     {
-        std::string arg;
-        std::size_t nDelim = arguments.find(' ', 1);
-        if(nDelim == std::string::npos)
-        {
-            arg = arguments;
-            arguments = std::string();
-        }
-        else
-        {
-            arg = arguments.substr(0, nDelim);
-            arguments = arguments.substr(nDelim+1);
-        }
-		if(m_pSymbolTable->HasSymbol(arg)) 
+    case TokenKind::SYMBOL: //Replace mnemonics (variables, lables, functions)
+		if(m_pSymbolTable->HasSymbol(static_cast<uint32>(token.value))) 
 		{
-			out = static_cast<int32>(m_pSymbolTable->GetValue(arg));
+			out = static_cast<int32>(m_pSymbolTable->GetValue(static_cast<uint32>(token.value)));
 			return true;
 		}
-        std::cerr << "[ASM CMP] Couldn't find symbol: " << arg << std::endl;
+        std::cerr << "[ASM CMP] Couldn't find symbol: " << m_pSymbolTable->GetName(static_cast<uint32>(token.value)) << std::endl;
+        return false;
+    case TokenKind::CHARACTER:
+    case TokenKind::NUMBER:
+        out = token.value;
+        return true;
+    default:
+        return false;
     }
-    else if(arguments[0]=='\'') //char
+}
+bool AssemblyCompiler::WriteLiteral(const Token &token)
+{
+    uint32 offset = static_cast<uint32>(m_Bytecode.size());
+    uint32 name = static_cast<uint32>(token.value);
+    bool isSymbol = token.kind == TokenKind::SYMBOL;
+    if(m_Relocatable && isSymbol && !m_pSymbolTable->HasSymbol(name) && m_pSymbolTable->GetName(name)[0] == '$')
     {
-        out = int32(arguments[1]);
-        std::size_t nDelim = arguments.find('\'', 1);
-        if(nDelim == std::string::npos)
-        {
-            arguments = std::string();
-        }
-        else arguments = arguments.substr(nDelim+1);
+        //Function of another module, the Linker writes its address
+        auto imported = m_Imports.emplace(name, static_cast<uint32>(m_Object.imports.size()));
+        if(imported.second) m_Object.imports.push_back(m_pSymbolTable->GetName(name));
+        m_Object.relocations.push_back(Relocation{offset, RelocationKind::IMPORT});
+        WriteInt(static_cast<int32>(imported.first->second));
         return true;
     }
-    else if(isNumber(arguments)) //int
+
+    int32 parsed;
+    if(!ParseLiteral(parsed, token))return false;
+    if(m_Relocatable && isSymbol)
     {
-        std::size_t nDelim = arguments.find(' ', 1);
-        if(nDelim == std::string::npos)
-        {
-            out = stoi(arguments);
-            arguments = std::string();
-        }
-        else
+        switch(m_pSymbolTable->GetType(name))
         {
-            out = stoi(arguments.substr(0, nDelim));
-            arguments = arguments.substr(nDelim+1);
+        case SymbolType::FUNCTION:
+        case SymbolType::LABEL:
+            parsed -= static_cast<int32>(m_StackSize);
+            m_Object.relocations.push_back(Relocation{offset, RelocationKind::CODE});
+            break;
+        case SymbolType::STATIC:
+            parsed -= static_cast<int32>(m_pSymbolTable->GetStaticBase());
+            m_Object.relocations.push_back(Relocation{offset, RelocationKind::STATIC});
+            break;
+        default:
+            break;  //Frame offsets don't move
         }
-        return true;
     }
-    return false;
+    WriteInt(parsed);
+    return true;
 }
 void AssemblyCompiler::WriteInt(int32 value)
 {
@@ -447,22 +523,14 @@ void AssemblyCompiler::WriteInt(int32 value)
 }
 void AssemblyCompiler::WriteInt(int32 value, std::vector<uint8> &target)
 {
-#ifdef WORD_BIG_ENDIAN
-   target.push_back(value & 0xFF);
-   target.push_back((value >> 8) & 0xFF);
-   target.push_back((value >> 16) & 0xFF);
-   target.push_back((value >> 24) & 0xFF);
-#elif
-   target.push_back((value >> 24) & 0xFF);
-   target.push_back((value >> 16) & 0xFF);
-   target.push_back((value >> 8) & 0xFF);
-   target.push_back(value & 0xFF);
-#endif
+    uint8 word[sizeof(uint32)];
+    StoreWord(word, static_cast<uint32>(value));
+    target.insert(target.end(), word, word + sizeof(uint32));
 }
 
 void AssemblyCompiler::PrintAbort(uint32 line)
 {
-    std::cerr << m_Lines[line] << std::endl;
+    std::cerr << m_Lexer.GetLine(line) << std::endl;
     std::cerr << "[ASM CMP]" <<  std::endl;
     std::cerr << "[ASM CMP] Aborting compilation!" <<  std::endl;
     m_State = CompState::FAILED;
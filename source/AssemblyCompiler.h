@@ -1,12 +1,19 @@
 #pragma once
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "AtomicTypes.h"
+#include "AssemblyLexer.h"
+#include "ObjectFile.h"
+
+//Bump ASSEMBLER_VERSION whenever the same source assembles to different bytecode, the bytecode cache keys on it
+static const uint32 ASSEMBLER_VERSION = 1;
 
 //Forward declaration
 class SymbolTable;
+enum class Opcode : uint8;
 
 class AssemblyCompiler
 {
@@ -19,31 +26,58 @@ public:
         FAILED
     };
 
+    //Memory layout written to executables, the Linker uses the same
+    static const uint32 DEFAULT_STACK_SIZE = 1048576;
+    static const uint32 DEFAULT_HEAP_SIZE = 67108864;
+
 public:
     AssemblyCompiler();
     ~AssemblyCompiler();
 
     void SetSource(std::vector<std::string> lines);
     bool LoadSource(std::string filename);
+    const std::string& GetSource() const {return m_Source;}
 
     bool Compile();
 
     CompState GetState(){return m_State;}
     bool Save(std::string filename);
-    std::vector<uint8> GetBytecode();
+    const std::vector<uint8>& GetBytecode() const;
+    const SymbolTable* GetSymbolTable() const {return m_pSymbolTable;}
+
+    //Maximum heap size written to the executable header
+    void SetHeapSize(uint32 heapSize){m_HeapSize = heapSize;}
+    //Compile to an ObjectFile for the Linker instead of an executable, Save then writes the object.
+    //Functions the source calls without defining them become imports
+    void SetRelocatable(bool relocatable){m_Relocatable = relocatable;}
+    const ObjectFile& GetObject() const {return m_Object;}
+    //No progress messages or symbol listing on stdout, errors are still reported
+    void SetQuiet(bool quiet){m_Quiet = quiet;}
 
 private:
     bool BuildSymbolTable();
     bool CompileInstructions();
     bool CompileHeader();
+    bool CompileObject();
+
+    bool IsValidOpname(const Statement &statement);
+    bool FindImmediateConsumer(uint32 statement, Opcode &immediateForm, uint32 &consumer);
 
-    bool TokenizeLine(std::string line, std::string &opname, std::string &arguments);
-    bool IsValidOpname(std::string opname, uint32 line);
+    //One instruction as it will be emitted, after folding literals into immediate forms
+    struct SourceInstruction
+    {
+        Opcode code;
+        uint32 statement = 0;
+        uint32 last = 0;    //Statement of the instruction a literal was folded into
+    };
+    bool MatchSuperinstruction(uint32 statement, std::vector<SourceInstruction> &parts, Opcode &fused);
 
-    void CheckVar(std::string &arguments);
+    void CheckVar(const Token &token);
 
-    bool HasValidArgs(std::string arguments, uint32 line, std::string opname);
-    bool ParseLiteral(int32 &out, std::string &arguments);
+    bool HasValidArgs(const Statement &statement, Opcode code);
+    bool ParseLiteral(int32 &out, const Token &token);
+    //Parses and writes an operand, recording a relocation if it is an address
+    bool WriteLiteral(const Token &token);
     void WriteInt(int32 value);
     void WriteInt(int32 value, std::vector<uint8> &target);
 
@@ -52,11 +86,18 @@ private:
 private:
     CompState m_State = CompState::INIT;
 
-    std::vector<std::string> m_Lines;
+    std::string m_Source;   //Whole source, the token stream points into it
+    AssemblyLexer m_Lexer;
     std::vector<uint8> m_Bytecode;
 
 	SymbolTable* m_pSymbolTable = nullptr;
 
     uint32 m_HeaderSize = 0;
-    uint32 m_StackSize = 1048576;
+    uint32 m_StackSize = DEFAULT_STACK_SIZE;
+    uint32 m_HeapSize = DEFAULT_HEAP_SIZE;
+
+    bool m_Relocatable = false;
+    bool m_Quiet = false;
+    ObjectFile m_Object;
+    std::unordered_map<uint32, uint32> m_Imports;   //Index in m_Object.imports per interned name
 };
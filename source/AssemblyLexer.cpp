@@ -0,0 +1,193 @@
+#include "AssemblyLexer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "Opcode.h"
+#include "SymbolTable.h"
+
+void AssemblyLexer::Lex(const std::string &source, SymbolTable &symbols)
+{
+	m_pSource = &source;
+	m_Statements.clear();
+	m_Tokens.clear();
+	//Nearly every line is a statement with at most one operand
+	size_t lines = static_cast<size_t>(std::count(source.begin(), source.end(), '\n')) + 1;
+	m_Statements.reserve(lines);
+	m_Tokens.reserve(lines);
+
+	//Lines split like std::getline, a final line break doesn't start another line
+	const char* text = source.data();
+	const char* end = text + source.size();
+	uint32 line = 0;
+	for(const char* begin = text; begin < end; ++line)
+	{
+		const char* lineEnd = static_cast<const char*>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+		if(!lineEnd) lineEnd = end;
+		LexLine(begin, lineEnd, line, symbols);
+		begin = lineEnd + 1;
+	}
+}
+
+TextView AssemblyLexer::GetLine(uint32 line) const
+{
+	TextView text;
+	if(!m_pSource) return text;
+	const char* begin = m_pSource->data();
+	const char* end = begin + m_pSource->size();
+	for(; line > 0 && begin < end; --line)
+	{
+		begin = std::find(begin, end, '\n');
+		if(begin < end) ++begin;
+	}
+	text.data = begin;
+	text.size = static_cast<uint32>(std::find(begin, end, '\n') - begin);
+	return text;
+}
+
+TextView AssemblyLexer::GetText(const Token &token) const
+{
+	TextView text;
+	if(token.kind != TokenKind::STRING || !m_pSource) return text;
+	text.data = m_pSource->data() + token.value;
+	text.size = token.size;
+	return text;
+}
+
+TextView AssemblyLexer::GetOpname(const Statement &statement) const
+{
+	TextView text = GetLine(statement.line);
+	text.size = static_cast<uint32>(std::find(text.data, text.data + text.size, ' ') - text.data);
+	return text;
+}
+
+void AssemblyLexer::LexLine(const char* begin, const char* end, uint32 line, SymbolTable &symbols)
+{
+	//Empty lines and comments
+	if(begin == end || (end - begin > 1 && begin[0] == '/' && begin[1] == '/')) return;
+
+	const char* space = std::find(begin, end, ' ');
+	const char* arguments = space == end ? end : space + 1;
+
+	Statement statement;
+	statement.code = Opcode::INVALID;
+	statement.line = line;
+	statement.name = 0;
+	statement.firstToken = static_cast<uint32>(m_Tokens.size());
+	uint32 length = static_cast<uint32>(space - begin);
+
+	if(*begin == '@')
+	{
+		statement.kind = StatementKind::LABEL;
+		statement.name = symbols.Intern(begin, length);
+	}
+	else if(*begin == '$')
+	{
+		statement.kind = StatementKind::FUNCTION;
+		statement.name = symbols.Intern(begin, length);
+		LexNames(arguments, end, symbols);
+	}
+	else
+	{
+		m_Opname.assign(begin, space);
+		auto found = OpcodeNames.find(m_Opname);
+		if(found == OpcodeNames.end())
+		{
+			statement.kind = StatementKind::INVALID;
+		}
+		else
+		{
+			statement.kind = StatementKind::INSTRUCTION;
+			statement.code = found->second;
+			LexArguments(arguments, end, symbols);
+		}
+	}
+	statement.tokenCount = static_cast<uint32>(m_Tokens.size()) - statement.firstToken;
+	m_Statements.push_back(statement);
+}
+
+void AssemblyLexer::LexArguments(const char* begin, const char* end, SymbolTable &symbols)
+{
+	for(const char* p = begin; p < end;)
+	{
+		if(*p == ' ')
+		{
+			++p;
+			continue;
+		}
+
+		Token token;
+		token.kind = TokenKind::INVALID;
+		token.value = 0;
+		token.size = 0;
+		if(*p == '\'')
+		{
+			//The character itself may be a space or a quote
+			token.kind = TokenKind::CHARACTER;
+			if(p + 1 < end) token.value = int32(p[1]);
+			const char* close = std::find(std::min(p + 2, end), end, '\'');
+			p = close == end ? end : close + 1;
+		}
+		else if(*p == '\"')
+		{
+			const char* close = std::find(p + 1, end, '\"');
+			if(close != end)
+			{
+				token.kind = TokenKind::STRING;
+				token.value = static_cast<int32>(p + 1 - m_pSource->data());
+				token.size = static_cast<uint32>(close - (p + 1));
+			}
+			else
+			{
+				token.size = static_cast<uint32>(end - p);
+			}
+			p = close == end ? end : close + 1;
+		}
+		else
+		{
+			const char* wordEnd = std::find(p, end, ' ');
+			if(*p == '#' || *p == '@' || *p == '$')
+			{
+				token.kind = TokenKind::SYMBOL;
+				token.value = static_cast<int32>(symbols.Intern(p, static_cast<uint32>(wordEnd - p)));
+			}
+			else
+			{
+				uint64 value = 0;
+				const char* digit = p;
+				for(; digit < wordEnd && *digit >= '0' && *digit <= '9'; ++digit)
+				{
+					value = value * 10 + static_cast<uint64>(*digit - '0');
+					if(value > static_cast<uint64>(std::numeric_limits<int32>::max())) break;
+				}
+				if(digit == wordEnd)
+				{
+					token.kind = TokenKind::NUMBER;
+					token.value = static_cast<int32>(value);
+				}
+			}
+			p = wordEnd;
+		}
+		m_Tokens.push_back(token);
+	}
+}
+
+void AssemblyLexer::LexNames(const char* begin, const char* end, SymbolTable &symbols)
+{
+	for(const char* p = begin; p < end;)
+	{
+		if(*p == ' ')
+		{
+			++p;
+			continue;
+		}
+		const char* wordEnd = std::find(p, end, ' ');
+		Token token;
+		token.kind = TokenKind::SYMBOL;
+		token.value = static_cast<int32>(symbols.Intern(p, static_cast<uint32>(wordEnd - p)));
+		token.size = 0;
+		m_Tokens.push_back(token);
+		p = wordEnd;
+	}
+}
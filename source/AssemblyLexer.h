@@ -0,0 +1,83 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+
+//Forward declaration
+class SymbolTable;
+enum class Opcode : uint8;
+
+//Characters of the source a token was read from, the source outlives the token stream
+struct TextView
+{
+	const char* data = nullptr;
+	uint32 size = 0;
+};
+inline std::ostream& operator<<(std::ostream &stream, const TextView &text)
+{
+	return stream.write(text.data, static_cast<std::streamsize>(text.size));
+}
+
+enum class TokenKind : uint8
+{
+	NUMBER,		//Decimal literal
+	CHARACTER,	//'c'
+	SYMBOL,		//#variable, @label or $function, value is the interned name
+	STRING,		//"text" of a LITERAL_ARRAY, value and size locate the characters between the quotes in the source
+	INVALID		//Anything else, also unterminated strings and numbers that don't fit an int32
+};
+
+//Tokens only keep what the compiler passes need, their text can be looked up in the source with GetText
+struct Token
+{
+	TokenKind kind;
+	int32 value;
+	uint32 size;	//Characters of a STRING, or of an unterminated one including its quote for INVALID
+};
+
+enum class StatementKind : uint8
+{
+	INSTRUCTION,
+	LABEL,
+	FUNCTION,	//Tokens are the argument names
+	INVALID		//Unknown opname
+};
+
+//A line that is neither empty nor a comment
+struct Statement
+{
+	StatementKind kind;
+	Opcode code;
+	uint32 line;		//Index of the source line, for error messages
+	uint32 name;		//Interned name of a label or function
+	uint32 firstToken;
+	uint32 tokenCount;
+};
+
+//Reads assembly source once into statements and one array of argument tokens for both compiler passes.
+//Tokens point into the source instead of copying it, symbols are interned in the symbol table as they are read
+class AssemblyLexer
+{
+public:
+	void Lex(const std::string &source, SymbolTable &symbols);
+
+	const std::vector<Statement>& GetStatements() const { return m_Statements; }
+	const Token* GetTokens(const Statement &statement) const { return m_Tokens.data() + statement.firstToken; }
+	//Text of a source line without its line break, and the opname or label a statement starts with. Only needed for
+	//error messages, so lines are found by scanning the source instead of keeping an index of them
+	TextView GetLine(uint32 line) const;
+	TextView GetOpname(const Statement &statement) const;
+	TextView GetText(const Token &token) const;
+
+private:
+	void LexLine(const char* begin, const char* end, uint32 line, SymbolTable &symbols);
+	void LexArguments(const char* begin, const char* end, SymbolTable &symbols);
+	void LexNames(const char* begin, const char* end, SymbolTable &symbols);
+
+	const std::string* m_pSource = nullptr;
+	std::vector<Statement> m_Statements;
+	std::vector<Token> m_Tokens;
+	std::string m_Opname;	//Reused for opcode lookups
+};
@@ -1,9 +1,11 @@
 #pragma once
 
-#ifndef WORD_LITTLE_ENDIAN
-    #define WORD_LITTLE_ENDIAN
+#include <cstdint>
+
+//Byte order of the machine the VM runs on, see WordFormat.h for the byte order of VM words
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    #define HOST_BIG_ENDIAN
 #endif
-#define WORD_BIG_ENDIAN false
 
 typedef std::int8_t		int8;
 typedef std::int16_t	int16;
@@ -13,4 +15,4 @@ typedef std::int64_t	int64;
 typedef std::uint8_t	uint8;
 typedef std::uint16_t	uint16;
 typedef std::uint32_t	uint32;
-typedef std::uint64_t	uint64;
\ No newline at end of file
+typedef std::uint64_t	uint64;
@@ -0,0 +1,205 @@
+#include "BytecodeCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+
+#ifdef PLATFORM_Win
+	#include <windows.h>
+	#include <direct.h>
+	#include <process.h>
+	#include <sys/utime.h>
+#else
+	#include <dirent.h>
+	#include <unistd.h>
+	#include <utime.h>
+#endif
+
+#include "AssemblyCompiler.h"
+#include "Opcode.h"
+#include "WordFormat.h"
+
+static const std::string EntryExtension(".bce");
+
+//Nanoseconds where the platform records them, entries used within the same second still age in order
+static uint64 GetModificationTime(const struct stat &info)
+{
+#ifdef PLATFORM_Linux
+	return static_cast<uint64>(info.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64>(info.st_mtim.tv_nsec);
+#else
+	return static_cast<uint64>(info.st_mtime) * 1000000000ull;
+#endif
+}
+
+BytecodeCache::BytecodeCache(const std::string &directory, uint64 sizeCap)
+	: m_Directory(directory)
+	, m_SizeCap(sizeCap)
+{
+}
+
+std::string BytecodeCache::GetDefaultDirectory()
+{
+	const char* directory = std::getenv("BVM_CACHE_DIR");
+	if(directory) return directory;
+#ifdef PLATFORM_Win
+	const char* base = std::getenv("LOCALAPPDATA");
+	return base ? std::string(base) + "\\BytecodeVM" : std::string();
+#else
+	const char* base = std::getenv("XDG_CACHE_HOME");
+	if(base && *base) return std::string(base) + "/BytecodeVM";
+	base = std::getenv("HOME");
+	return base ? std::string(base) + "/.cache/BytecodeVM" : std::string();
+#endif
+}
+
+std::string BytecodeCache::GetEntry(const std::string &source, uint32 heapSize) const
+{
+	//64 bit FNV-1a over the source and everything else that changes the executable
+	uint64 hash = 14695981039346656037ull;
+	auto add = [&hash](const uint8* data, size_t size)
+	{
+		for(size_t i = 0; i < size; ++i) hash = (hash ^ data[i]) * 1099511628211ull;
+	};
+	add(reinterpret_cast<const uint8*>(source.data()), source.size());
+	const uint32 settings[] = 
+	{
+		ASSEMBLER_VERSION,
+		WORD_FORMAT_VERSION,
+		GetSuperinstructionSetId(),
+		AssemblyCompiler::DEFAULT_STACK_SIZE,
+		heapSize != 0 ? heapSize : AssemblyCompiler::DEFAULT_HEAP_SIZE
+	};
+	for(uint32 setting : settings)
+	{
+		uint8 word[sizeof(uint32)];
+		StoreWord(word, setting);
+		add(word, sizeof(uint32));
+	}
+
+	//The source size in the name rules out collisions between sources of different lengths
+	std::ostringstream entry;
+	entry << m_Directory << '/' << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << '-' << source.size() << EntryExtension;
+	return entry.str();
+}
+
+bool BytecodeCache::Find(const std::string &entry) const
+{
+	struct stat info;
+	if(!IsEnabled() || stat(entry.c_str(), &info) != 0) return false;
+	//Recency is the modification time, refreshed on every hit
+#ifdef PLATFORM_Win
+	_utime(entry.c_str(), nullptr);
+#else
+	utime(entry.c_str(), nullptr);
+#endif
+	return true;
+}
+
+bool BytecodeCache::Store(const std::string &entry, const std::vector<uint8> &bytecode) const
+{
+	if(!IsEnabled() || !MakeDirectory()) return false;
+
+#ifdef PLATFORM_Win
+	std::string temporary = entry + ".tmp" + std::to_string(_getpid());
+#else
+	std::string temporary = entry + ".tmp" + std::to_string(getpid());
+#endif
+	{
+		std::ofstream file(temporary, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(bytecode.data()), static_cast<std::streamsize>(bytecode.size()));
+		if(!file.good())
+		{
+			file.close();
+			std::remove(temporary.c_str());
+			std::cerr << "[CACHE] Could not write " << temporary << std::endl;
+			return false;
+		}
+	}
+	//Fails on Windows if another process stored the same entry first, which holds the same bytecode
+	if(std::rename(temporary.c_str(), entry.c_str()) != 0) std::remove(temporary.c_str());
+
+	Evict();
+	return true;
+}
+
+bool BytecodeCache::MakeDirectory() const
+{
+	//Creates every missing parent, mkdir fails harmlessly for the ones that exist
+	for(size_t end = m_Directory.find_first_of("/\\", 1); ; end = m_Directory.find_first_of("/\\", end + 1))
+	{
+		std::string path = m_Directory.substr(0, end);
+#ifdef PLATFORM_Win
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+		if(end == std::string::npos) break;
+	}
+	struct stat info;
+	if(stat(m_Directory.c_str(), &info) != 0 || !(info.st_mode & S_IFDIR))
+	{
+		std::cerr << "[CACHE] Could not create " << m_Directory << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void BytecodeCache::Evict() const
+{
+	std::vector<std::string> names;
+#ifdef PLATFORM_Win
+	WIN32_FIND_DATAA found;
+	HANDLE hFind = FindFirstFileA((m_Directory + "\\*" + EntryExtension).c_str(), &found);
+	if(hFind == INVALID_HANDLE_VALUE) return;
+	do
+	{
+		names.push_back(found.cFileName);
+	} while(FindNextFileA(hFind, &found));
+	FindClose(hFind);
+#else
+	DIR* pDir = opendir(m_Directory.c_str());
+	if(pDir == nullptr) return;
+	while(dirent* pEntry = readdir(pDir))
+	{
+		names.push_back(pEntry->d_name);
+	}
+	closedir(pDir);
+#endif
+
+	struct Entry
+	{
+		std::string path;
+		uint64 size;
+		uint64 used;
+	};
+	std::vector<Entry> entries;
+	uint64 total = 0;
+	for(const auto &name : names)
+	{
+		//Temporary files of stores in progress end differently
+		if(name.size() <= EntryExtension.size() || name.compare(name.size() - EntryExtension.size(), EntryExtension.size(), EntryExtension) != 0) continue;
+		Entry entry;
+		entry.path = m_Directory + '/' + name;
+		struct stat info;
+		if(stat(entry.path.c_str(), &info) != 0) continue;
+		entry.size = static_cast<uint64>(info.st_size);
+		entry.used = GetModificationTime(info);
+		total += entry.size;
+		entries.push_back(entry);
+	}
+	if(total <= m_SizeCap) return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+	for(const auto &entry : entries)
+	{
+		if(total <= m_SizeCap) break;
+		//Another process may have evicted it already
+		std::remove(entry.path.c_str());
+		total -= entry.size;
+	}
+}
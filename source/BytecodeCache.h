@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+
+//On disk cache of the executables cRun assembles. Entries are content addressed: an entry's name is a hash of the
+//source, the assembler version and the settings written to the header, so an entry never goes stale, it only stops
+//being used. Entries are plain .bce files the VM loads directly. Finding an entry refreshes its modification time and
+//storing one removes the least recently used entries until the cache fits its size cap.
+//Processes can share a directory: entries are written to a temporary file and renamed into place
+class BytecodeCache
+{
+public:
+	static const uint64 DEFAULT_SIZE_CAP = 64ull * 1024 * 1024;
+
+	//An empty directory disables the cache
+	BytecodeCache(const std::string &directory, uint64 sizeCap = DEFAULT_SIZE_CAP);
+	//BVM_CACHE_DIR if it is set, else a BytecodeVM directory in the user's cache directory
+	static std::string GetDefaultDirectory();
+
+	bool IsEnabled() const { return !m_Directory.empty(); }
+	//File of the entry for a source assembled with a heap size, 0 for the assembler's default
+	std::string GetEntry(const std::string &source, uint32 heapSize) const;
+	//Whether the entry exists, marks it as recently used
+	bool Find(const std::string &entry) const;
+	bool Store(const std::string &entry, const std::vector<uint8> &bytecode) const;
+
+private:
+	bool MakeDirectory() const;
+	//Removes the least recently used entries while the cache is larger than the cap
+	void Evict() const;
+
+	std::string m_Directory;
+	uint64 m_SizeCap;
+};
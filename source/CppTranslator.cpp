@@ -0,0 +1,461 @@
+#include "CppTranslator.h"
+
+#include <iostream>
+
+#include "WordFormat.h"
+
+bool CppTranslator::Translate(const ProgramImage &image, const std::string &name, std::ostream &output)
+{
+	if(!image.IsLoaded())
+	{
+		std::cerr << "[VM] Program image is not loaded" << std::endl;
+		return false;
+	}
+	m_pImage = &image;
+	m_HaltIndex = image.GetInstructionCount() - 1;
+	m_Labels.clear();
+	m_Dispatch.clear();
+	m_Body.str(std::string());
+	m_Stack.clear();
+	m_Temporaries = 0;
+	m_Registers.clear();
+	m_UsesDispatch = false;
+	m_UsesCallSwitch = false;
+	image.FindBlockEntries(m_Labels, m_Dispatch);
+
+	//A block per label, each in its own scope so gotos never jump over the temporaries of another block
+	m_Indent = 2;
+	for(uint32 index = 1; index < m_HaltIndex; index += m_pImage->GetInstructionLength(index))
+	{
+		bool label = m_Labels.count(index) != 0 || m_Dispatch.count(index) != 0;
+		if(index != 1 && label)
+		{
+			Flush();
+			m_Body << "\t}\n";
+		}
+		if(label) m_Body << "L" << GetAddress(index) << ":\n";
+		if(index == 1 || label) m_Body << "\t{\n";
+		TranslateInstruction(index);
+	}
+	if(m_HaltIndex > 1)
+	{
+		//Falling off the end of the code segment ends the program
+		m_Stack.clear();
+		Line() << "return runtime.Finish();\n";
+		m_Body << "\t}\n";
+	}
+	else m_Body << "\treturn runtime.Finish();\n";
+
+	m_Indent = 1;
+	if(m_UsesCallSwitch)
+	{
+		m_Body << "call:\n";
+		Line() << "switch(callee)\n";
+		Line() << "{\n";
+		for(uint32 index = 1; index < m_HaltIndex; index += m_pImage->GetInstructionLength(index))
+		{
+			if(image.GetInstruction(index).operation != Opcode::FRAME) continue;
+			Line() << "case " << GetAddress(index) << ":\n";
+			m_Indent = 2;
+			TranslateCall(index, Register("callReturn"));
+			m_Indent = 1;
+		}
+		Line() << "default:\n";
+		Line() << "\treturn runtime.Fail(\"Call target is not a function\", static_cast<uint32>(callee));\n";
+		Line() << "}\n";
+	}
+	if(m_UsesDispatch)
+	{
+		uint32 codeEnd = image.GetStackSize() + image.GetCodeSize();
+		m_Body << "dispatch:\n";
+		Line() << "switch(" << Register("target") << ")\n";
+		Line() << "{\n";
+		for(uint32 index : m_Dispatch)
+		{
+			if(index == 0 || index >= m_HaltIndex) continue;
+			Line() << "case " << GetAddress(index) << ": goto L" << GetAddress(index) << ";\n";
+		}
+		Line() << "default:\n";
+		Line() << "\tif(target == " << codeEnd << " || target >= " << image.GetStaticBase() << ") return runtime.Finish();\n";
+		Line() << "\treturn runtime.Fail(\"Jump to an address that was not translated\", target);\n";
+		Line() << "}\n";
+	}
+
+	output << "//Translated from " << name << " by the Bytecode translate command. Build it with source/ on the include path\n";
+	output << "//and link source/TranslatedRuntime.cpp, source/HeapAllocator.cpp and source/OutputSink.cpp\n";
+	output << "#include \"TranslatedRuntime.h\"\n\n";
+	output << "static const uint32 HEAP_BASE = " << image.GetHeapBase() << ";\n";
+	output << "static const uint32 HEAP_SIZE = " << image.GetHeapSize() << ";\n\n";
+	output << "static int Run(TranslatedRuntime &runtime)\n";
+	output << "{\n";
+	if(m_Registers.count("ram")) output << "\tuint8* const ram = runtime.GetRAM();\n";
+	if(m_Registers.count("sp")) output << "\tint32 sp = -4;\n";
+	const char* const registers[] = { "lcl", "arg", "rtn", "self", "callee" };
+	for(const char* reg : registers)
+	{
+		if(m_Registers.count(reg)) output << "\tint32 " << reg << " = 0;\n";
+	}
+	if(m_Registers.count("callReturn")) output << "\tuint32 callReturn = 0;\n";
+	if(m_Registers.count("target")) output << "\tuint32 target = 0;\n";
+	output << m_Body.str();
+	output << "}\n\n";
+	output << "int main()\n";
+	output << "{\n";
+	output << "\tTranslatedRuntime runtime;\n";
+	output << "\tif(!runtime.Init(HEAP_BASE, HEAP_SIZE)) return 1;\n";
+	output << "\treturn Run(runtime);\n";
+	output << "}\n";
+	return static_cast<bool>(output);
+}
+
+bool CppTranslator::IsInstruction(uint32 address) const
+{
+	return address - m_pImage->GetStackSize() < m_pImage->GetCodeSize() && m_pImage->Resolve(address) != 0;
+}
+
+void CppTranslator::TranslateInstruction(uint32 index)
+{
+	for(uint32 part = 0; part < m_pImage->GetInstructionLength(index); ++part)
+	{
+		TranslatePart(m_pImage->GetPart(index, part), m_pImage->GetInstruction(index + part), index);
+	}
+}
+
+void CppTranslator::TranslatePart(Opcode code, const ProgramImage::Instruction &instruction, uint32 index)
+{
+	int32 immediate = instruction.immediate;
+	uint32 address = instruction.address;
+	switch(code)
+	{
+	case Opcode::LITERAL:
+		PushConstant(immediate);
+		break;
+	case Opcode::LITERAL_ARRAY:
+	{
+		const uint8* values = m_pImage->GetCodeSegment() + instruction.target;
+		for(int32 value = 0; value < immediate; ++value) PushConstant(static_cast<int32>(LoadWord(values + value * sizeof(int32))));
+	}
+		break;
+	case Opcode::LOAD:
+		Push("TranslatedLoad(" + Register("ram") + ", " + Pop() + ")");
+		break;
+	case Opcode::LOAD_LCL:
+	case Opcode::LOAD_ARG:
+	{
+		std::string offset = Pop();
+		Push("TranslatedLoad(" + Register("ram") + ", " + Register(code == Opcode::LOAD_LCL ? "lcl" : "arg") + " + " + offset + ")");
+	}
+		break;
+	case Opcode::STORE:
+	case Opcode::STORE_LCL:
+	{
+		std::string target = Pop();
+		if(code == Opcode::STORE_LCL) target = Register("lcl") + " + " + target;
+		std::string value = Pop();
+		Line() << "TranslatedStore(" << Register("ram") << ", " << target << ", " << value << ");\n";
+	}
+		break;
+	case Opcode::LOAD_I:
+		Push("TranslatedLoad(" + Register("ram") + ", " + Literal(immediate) + ")");
+		break;
+	case Opcode::LOAD_LCL_I:
+	case Opcode::LOAD_ARG_I:
+		Push("TranslatedLoad(" + Register("ram") + ", " + Offset(Register(code == Opcode::LOAD_LCL_I ? "lcl" : "arg"), immediate) + ")");
+		break;
+	case Opcode::STORE_I:
+	case Opcode::STORE_LCL_I:
+	{
+		//Popping an empty stack emits a load, it has to come before the line using the value
+		std::string value = Pop();
+		std::string target = code == Opcode::STORE_I ? Literal(immediate) : Offset(Register("lcl"), immediate);
+		Line() << "TranslatedStore(" << Register("ram") << ", " << target << ", " << value << ");\n";
+	}
+		break;
+
+	case Opcode::ALLOC:
+	{
+		std::string size = Pop();
+		std::string pointer = Temporary();
+		Line() << "const int32 " << pointer << " = static_cast<int32>(runtime.Allocate(" << size << "));\n";
+		Line() << "if(" << pointer << " == 0) return runtime.Fail(\"Out of Memory Exception, could not allocate space for variable\", " << address << ");\n";
+		m_Stack.push_back(StackValue{pointer, false, 0});
+	}
+		break;
+	case Opcode::FREE:
+	{
+		std::string pointer = Pop();
+		Line() << "runtime.Free(" << pointer << ");\n";
+	}
+		break;
+
+	case Opcode::ADD:
+	case Opcode::SUB:
+	case Opcode::LESS:
+	case Opcode::GREATER:
+	case Opcode::EQUALS:
+	{
+		bool constant = m_Stack.size() >= 2 && m_Stack[m_Stack.size() - 1].constant && m_Stack[m_Stack.size() - 2].constant;
+		int32 b = constant ? m_Stack[m_Stack.size() - 1].value : 0;
+		int32 a = constant ? m_Stack[m_Stack.size() - 2].value : 0;
+		std::string right = Pop();
+		std::string left = Pop();
+		if(constant)
+		{
+			switch(code)
+			{
+			case Opcode::ADD: PushConstant(static_cast<int32>(static_cast<uint32>(a) + static_cast<uint32>(b))); break;
+			case Opcode::SUB: PushConstant(static_cast<int32>(static_cast<uint32>(a) - static_cast<uint32>(b))); break;
+			case Opcode::LESS: PushConstant(a < b); break;
+			case Opcode::GREATER: PushConstant(a > b); break;
+			default: PushConstant(a == b); break;
+			}
+			break;
+		}
+		switch(code)
+		{
+		case Opcode::ADD: Push("TranslatedAdd(" + left + ", " + right + ")"); break;
+		case Opcode::SUB: Push("TranslatedSub(" + left + ", " + right + ")"); break;
+		case Opcode::LESS: Push("static_cast<int32>(" + left + " < " + right + ")"); break;
+		case Opcode::GREATER: Push("static_cast<int32>(" + left + " > " + right + ")"); break;
+		default: Push("static_cast<int32>(" + left + " == " + right + ")"); break;
+		}
+	}
+		break;
+	case Opcode::NOT:
+		if(!m_Stack.empty() && m_Stack.back().constant)
+		{
+			int32 value = m_Stack.back().value;
+			Pop();
+			PushConstant(!value);
+		}
+		else Push("static_cast<int32>(!" + Pop() + ")");
+		break;
+
+	case Opcode::JMP:
+	{
+		std::string target = Pop();
+		Flush();
+		Line() << Register("target") << " = static_cast<uint32>(" << target << ");\n";
+		Line() << "goto dispatch;\n";
+		m_UsesDispatch = true;
+	}
+		break;
+	case Opcode::JMP_IF:
+	{
+		std::string target = Pop();
+		std::string condition = Pop();
+		Flush();
+		Line() << "if(" << condition << ")\n";
+		Line() << "{\n";
+		Line() << "\t" << Register("target") << " = static_cast<uint32>(" << target << ");\n";
+		Line() << "\tgoto dispatch;\n";
+		Line() << "}\n";
+		m_UsesDispatch = true;
+	}
+		break;
+	case Opcode::JMP_I:
+		Flush();
+		Line() << JumpTo(instruction.target, static_cast<uint32>(immediate)) << "\n";
+		break;
+	case Opcode::JMP_IF_I:
+	{
+		std::string condition = Pop();
+		Flush();
+		Line() << "if(" << condition << ") " << JumpTo(instruction.target, static_cast<uint32>(immediate)) << "\n";
+	}
+		break;
+
+	case Opcode::CALL:
+	{
+		std::string callee = Pop();
+		Flush();
+		Line() << Register("callee") << " = " << callee << ";\n";
+		Line() << Register("callReturn") << " = " << (address + 1) << ";\n";
+		Line() << "goto call;\n";
+		m_UsesCallSwitch = true;
+	}
+		break;
+	case Opcode::CALL_I:
+		Flush();
+		TranslateCall(instruction.target, std::to_string(address + 1 + sizeof(int32)));
+		break;
+	case Opcode::RETURN:
+	{
+		//Whatever else is on the operand stack is dropped with the frame
+		std::string value = Pop();
+		m_Stack.clear();
+		std::string ram = Register("ram");
+		std::string lcl = Register("lcl");
+		std::string arg = Register("arg");
+		std::string rtn = Register("rtn");
+		std::string self = Register("self");
+		Line() << "TranslatedStore(" << ram << ", " << arg << ", " << value << ");\n";
+		Line() << Register("sp") << " = " << arg << ";\n";
+		Line() << Register("target") << " = static_cast<uint32>(" << rtn << ");\n";
+		Line() << self << " = TranslatedLoad(" << ram << ", " << lcl << " - 4);\n";
+		Line() << arg << " = TranslatedLoad(" << ram << ", " << lcl << " - 8);\n";
+		Line() << rtn << " = TranslatedLoad(" << ram << ", " << lcl << " - 16);\n";
+		Line() << lcl << " = TranslatedLoad(" << ram << ", " << lcl << " - 12);\n";
+		Line() << "goto dispatch;\n";
+		m_UsesDispatch = true;
+	}
+		break;
+	case Opcode::FRAME:
+		m_Stack.clear();
+		Line() << "return runtime.Fail(\"Entered function without a CALL\", " << address << ");\n";
+		break;
+
+	case Opcode::PRINT:
+	{
+		//Literal strings are written straight from the translation time stack
+		size_t size = m_Stack.size();
+		bool constant = size != 0 && m_Stack.back().constant && m_Stack.back().value >= 0 && static_cast<size_t>(m_Stack.back().value) < size;
+		for(size_t slot = 1; constant && slot <= static_cast<size_t>(m_Stack.back().value); ++slot)
+		{
+			constant = m_Stack[size - 1 - slot].constant;
+		}
+		if(!constant)
+		{
+			Flush();
+			Line() << Register("sp") << " = runtime.Print(" << Register("sp") << ");\n";
+			break;
+		}
+		size_t count = static_cast<size_t>(m_Stack.back().value);
+		std::string text;
+		for(size_t slot = size - 1 - count; slot < size - 1; ++slot)
+		{
+			//Low byte of each word, as octal escapes so no character can run into the next one
+			uint8 c = static_cast<uint8>(m_Stack[slot].value);
+			if(c >= 0x20 && c < 0x7F && c != '"' && c != '\\' && c != '?') text += static_cast<char>(c);
+			else
+			{
+				text += '\\';
+				text += static_cast<char>('0' + (c >> 6));
+				text += static_cast<char>('0' + ((c >> 3) & 7));
+				text += static_cast<char>('0' + (c & 7));
+			}
+		}
+		m_Stack.resize(size - 1 - count);
+		if(count != 0) Line() << "runtime.GetOutput().Write(\"" << text << "\", " << count << ");\n";
+	}
+		break;
+	case Opcode::PRINT_INT:
+	{
+		std::string value = Pop();
+		Line() << "runtime.GetOutput().WriteInt(" << value << ");\n";
+	}
+		break;
+	case Opcode::PRINT_ENDL:
+		Line() << "runtime.GetOutput().Put('\\n');\n";
+		break;
+	case Opcode::FLUSH:
+		Line() << "runtime.GetOutput().Flush();\n";
+		break;
+
+	default:
+		m_Stack.clear();
+		Line() << "return runtime.Fail(\"Invalid opcode\", " << GetAddress(index) << ");\n";
+		break;
+	}
+}
+
+void CppTranslator::TranslateCall(uint32 frameIndex, const std::string &returnAddress)
+{
+	const ProgramImage::Instruction &frame = m_pImage->GetInstruction(frameIndex);
+	if(frame.operation != Opcode::FRAME)
+	{
+		Line() << "return runtime.Fail(\"Call target is not a function\", " << frame.address << ");\n";
+		return;
+	}
+	std::string ram = Register("ram");
+	std::string sp = Register("sp");
+	std::string lcl = Register("lcl");
+	std::string arg = Register("arg");
+	std::string rtn = Register("rtn");
+	std::string self = Register("self");
+	Line() << "TranslatedStore(" << ram << ", " << sp << " + 4, " << rtn << ");\n";
+	Line() << "TranslatedStore(" << ram << ", " << sp << " + 8, " << lcl << ");\n";
+	Line() << "TranslatedStore(" << ram << ", " << sp << " + 12, " << arg << ");\n";
+	Line() << "TranslatedStore(" << ram << ", " << sp << " + 16, " << self << ");\n";
+	Line() << sp << " += 16;\n";
+	Line() << rtn << " = static_cast<int32>(" << returnAddress << ");\n";
+	Line() << arg << " = " << Offset(sp, static_cast<int32>(0u - (static_cast<uint32>(frame.immediate) + 12))) << ";\n";
+	Line() << lcl << " = " << sp << " + 4;\n";
+	Line() << sp << " = " << Offset(lcl, static_cast<int32>(frame.target)) << ";\n";
+	Line() << JumpTo(frameIndex + 1, frame.address) << "\n";
+}
+
+void CppTranslator::Push(const std::string &expression)
+{
+	std::string name = Temporary();
+	Line() << "const int32 " << name << " = " << expression << ";\n";
+	m_Stack.push_back(StackValue{name, false, 0});
+}
+
+void CppTranslator::PushConstant(int32 value)
+{
+	m_Stack.push_back(StackValue{Literal(value), true, value});
+}
+
+std::string CppTranslator::Pop()
+{
+	if(!m_Stack.empty())
+	{
+		std::string expression = m_Stack.back().expression;
+		m_Stack.pop_back();
+		return expression;
+	}
+	std::string name = Temporary();
+	Line() << "const int32 " << name << " = TranslatedLoad(" << Register("ram") << ", " << Register("sp") << ");\n";
+	Line() << "sp -= 4;\n";
+	return name;
+}
+
+void CppTranslator::Flush()
+{
+	if(m_Stack.empty()) return;
+	for(size_t slot = 0; slot < m_Stack.size(); ++slot)
+	{
+		Line() << "TranslatedStore(" << Register("ram") << ", " << Register("sp") << " + " << (slot + 1) * sizeof(int32) << ", " << m_Stack[slot].expression << ");\n";
+	}
+	Line() << "sp += " << m_Stack.size() * sizeof(int32) << ";\n";
+	m_Stack.clear();
+}
+
+std::string CppTranslator::Temporary()
+{
+	return "t" + std::to_string(m_Temporaries++);
+}
+
+std::string CppTranslator::Register(const std::string &name)
+{
+	m_Registers.insert(name);
+	return name;
+}
+
+std::string CppTranslator::JumpTo(uint32 index, uint32 address)
+{
+	if(index == m_HaltIndex) return "return runtime.Finish();";
+	if(index == 0) return "return runtime.Fail(\"Invalid opcode\", " + std::to_string(address) + ");";
+	return "goto L" + std::to_string(GetAddress(index)) + ";";
+}
+
+std::ostream& CppTranslator::Line()
+{
+	for(uint32 level = 0; level < m_Indent; ++level) m_Body << '\t';
+	return m_Body;
+}
+
+std::string CppTranslator::Offset(const std::string &base, int32 offset)
+{
+	if(offset == 0) return base;
+	if(offset < 0 && offset != INT32_MIN) return base + " - " + std::to_string(-offset);
+	return base + " + " + Literal(offset);
+}
+
+std::string CppTranslator::Literal(int32 value)
+{
+	//-2147483648 would be the negation of a literal too large for int
+	if(value == INT32_MIN) return "(-2147483647 - 1)";
+	return std::to_string(value);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "Opcode.h"
+#include "ProgramImage.h"
+
+//Ahead of time translation of a program image into one standalone C++ translation unit that links against
+//TranslatedRuntime. The program becomes a single function with a label per basic block: immediate jumps and calls are
+//gotos, RETURN and computed jumps switch on the bytecode address. Within a block the operand stack lives in C++
+//locals and is only written to RAM where the block ends or an instruction needs it there, so RAM has the same
+//layout as in the interpreter at every block boundary.
+//Computed jumps and calls can only reach return sites, functions and addresses the program pushes as literals
+class CppTranslator
+{
+public:
+	//name is only used for the comment at the top of the generated file
+	bool Translate(const ProgramImage &image, const std::string &name, std::ostream &output);
+
+private:
+	//A value on the translation time stack: a constant or a C++ expression without side effects
+	struct StackValue
+	{
+		std::string expression;
+		bool constant;
+		int32 value;
+	};
+
+	uint32 GetAddress(uint32 index) const { return m_pImage->GetInstruction(index).address; }
+	bool IsInstruction(uint32 address) const;
+
+	void TranslateInstruction(uint32 index);
+	void TranslatePart(Opcode code, const ProgramImage::Instruction &instruction, uint32 index);
+	void TranslateCall(uint32 frameIndex, const std::string &returnAddress);
+
+	void Push(const std::string &expression);
+	void PushConstant(int32 value);
+	std::string Pop();
+	//Writes the stack values to RAM above sp
+	void Flush();
+	std::string Temporary();
+	//Returns the name of a local of the generated function and declares it there
+	std::string Register(const std::string &name);
+	std::string JumpTo(uint32 index, uint32 address);
+	std::ostream& Line();
+
+	static std::string Literal(int32 value);
+	//base + offset without a + 0 or + -n
+	static std::string Offset(const std::string &base, int32 offset);
+
+	const ProgramImage* m_pImage = nullptr;
+	uint32 m_HaltIndex = 0;
+	std::set<uint32> m_Labels;			//Decoded indices gotos land on
+	std::set<uint32> m_Dispatch;		//Decoded indices the address switch can reach
+
+	std::ostringstream m_Body;
+	std::vector<StackValue> m_Stack;
+	uint32 m_Temporaries = 0;
+	uint32 m_Indent = 1;
+	std::set<std::string> m_Registers;
+	bool m_UsesDispatch = false;
+	bool m_UsesCallSwitch = false;
+};
@@ -0,0 +1,125 @@
+#include "ExecutionProfiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+#include "VirtualMachine.h"
+
+ExecutionProfiler::ExecutionProfiler()
+	:m_OpcodeCounts(256, 0)
+	,m_OpcodeCycles(256, 0)
+{
+	FunctionStats topLevel;
+	topLevel.name = "(top level)";
+	m_Functions.push_back(topLevel);
+}
+
+void ExecutionProfiler::SetFunctionName(uint32 address, const std::string &name)
+{
+	m_Functions[GetFunction(address)].name = name;
+}
+
+void ExecutionProfiler::OnInstruction(const VirtualMachine &vm, uint32 index, Opcode code)
+{
+	uint64 elapsed = ReadCycles() - m_LastCycles;
+	if(!m_Started)
+	{
+		m_Started = true;
+		EnterFunction(0);
+	}
+	else
+	{
+		//Charge the previous instruction up to now
+		m_Cycles += elapsed;
+		m_OpcodeCycles[static_cast<uint8>(m_LastOpcode)] += elapsed;
+		m_Functions[m_CallStack.back().function].exclusiveCycles += elapsed;
+		if(m_LastOpcode == Opcode::RETURN && m_CallStack.size() > 1) LeaveFunction();
+		//Calls jump past the FRAME of the function, so it's the instruction right before this one
+		else if(m_LastOpcode == Opcode::CALL || m_LastOpcode == Opcode::CALL_I) EnterFunction(GetFunction(vm.GetInstructionAddress(index - 1)));
+	}
+
+	const Superinstruction* fused = GetSuperinstruction(code);
+	uint32 parts = fused ? fused->length : 1;
+	++m_OpcodeCounts[static_cast<uint8>(code)];
+	m_Instructions += parts;
+	m_Functions[m_CallStack.back().function].exclusiveInstructions += parts;
+
+	m_LastOpcode = code;
+	m_LastCycles = ReadCycles();	//The profiler's own work isn't charged to anything
+}
+
+uint32 ExecutionProfiler::GetFunction(uint32 address)
+{
+	auto found = m_FunctionIndices.find(address);
+	if(found != m_FunctionIndices.end()) return found->second;
+
+	FunctionStats function;
+	function.name = "$" + std::to_string(address);
+	uint32 index = static_cast<uint32>(m_Functions.size());
+	m_Functions.push_back(function);
+	m_FunctionIndices[address] = index;
+	return index;
+}
+
+void ExecutionProfiler::EnterFunction(uint32 function)
+{
+	FunctionStats &stats = m_Functions[function];
+	++stats.calls;
+	++stats.activeFrames;
+	m_CallStack.push_back(Frame{function, m_Instructions, m_Cycles});
+}
+
+void ExecutionProfiler::LeaveFunction()
+{
+	Frame frame = m_CallStack.back();
+	m_CallStack.pop_back();
+	FunctionStats &stats = m_Functions[frame.function];
+	if(--stats.activeFrames == 0)
+	{
+		stats.inclusiveInstructions += m_Instructions - frame.entryInstructions;
+		stats.inclusiveCycles += m_Cycles - frame.entryCycles;
+	}
+}
+
+void ExecutionProfiler::Report(std::ostream &stream)
+{
+	static const std::string HaltName("HALT");
+
+	while(!m_CallStack.empty()) LeaveFunction();
+
+	uint64 totalCycles = m_Cycles;
+	auto percent = [totalCycles](uint64 cycles) { return totalCycles == 0 ? 0.0 : 100.0 * static_cast<double>(cycles) / static_cast<double>(totalCycles); };
+
+	stream << "[PROFILE] " << m_Instructions << " instructions, " << totalCycles << " cycles" << std::endl;
+	stream << std::fixed << std::setprecision(1);
+
+	std::vector<uint32> opcodes;
+	for(uint32 op = 0; op < m_OpcodeCounts.size(); ++op)
+	{
+		if(m_OpcodeCounts[op] != 0) opcodes.push_back(op);
+	}
+	std::sort(opcodes.begin(), opcodes.end(), [this](uint32 lhs, uint32 rhs) { return m_OpcodeCycles[lhs] > m_OpcodeCycles[rhs]; });
+	stream << std::endl << std::left << std::setw(32) << "opcode" << std::right << std::setw(14) << "count" << std::setw(16) << "cycles" << std::setw(8) << "%" << std::endl;
+	for(uint32 op : opcodes)
+	{
+		//HALT has no assembly name
+		const std::string &name = static_cast<Opcode>(op) == Opcode::HALT ? HaltName : GetOpString(static_cast<Opcode>(op));
+		stream << std::left << std::setw(32) << name << std::right
+			<< std::setw(14) << m_OpcodeCounts[op] << std::setw(16) << m_OpcodeCycles[op] << std::setw(8) << percent(m_OpcodeCycles[op]) << std::endl;
+	}
+
+	std::vector<const FunctionStats*> functions;
+	for(const auto &function : m_Functions)
+	{
+		if(function.calls != 0) functions.push_back(&function);
+	}
+	std::sort(functions.begin(), functions.end(), [](const FunctionStats* lhs, const FunctionStats* rhs) { return lhs->exclusiveCycles > rhs->exclusiveCycles; });
+	stream << std::endl << std::left << std::setw(24) << "function" << std::right << std::setw(10) << "calls"
+		<< std::setw(14) << "incl instr" << std::setw(14) << "excl instr" << std::setw(16) << "incl cycles" << std::setw(16) << "excl cycles" << std::setw(8) << "excl %" << std::endl;
+	for(const FunctionStats* function : functions)
+	{
+		stream << std::left << std::setw(24) << function->name << std::right << std::setw(10) << function->calls
+			<< std::setw(14) << function->inclusiveInstructions << std::setw(14) << function->exclusiveInstructions
+			<< std::setw(16) << function->inclusiveCycles << std::setw(16) << function->exclusiveCycles << std::setw(8) << percent(function->exclusiveCycles) << std::endl;
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "AtomicTypes.h"
+#include "Opcode.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#else
+	#include <chrono>
+#endif
+
+class VirtualMachine;
+
+//Execution hooks measuring where a program spends its time. Every dispatched opcode is counted and charged the
+//cycles until the next dispatch. Functions are tracked on a shadow call stack, entered by a CALL and left
+//by a RETURN: calls, instructions and cycles spent in the function itself (exclusive) and including its callees (inclusive).
+//Superinstructions count as one dispatch but as all of their parts in instruction totals
+class ExecutionProfiler
+{
+public:
+	static const bool SYNC_STATE = false;
+
+	ExecutionProfiler();
+
+	//Names functions by the address of their FRAME, unnamed ones are reported by address
+	void SetFunctionName(uint32 address, const std::string &name);
+
+	void OnInstruction(const VirtualMachine &vm, uint32 index, Opcode code);
+
+	//Closes the frames still open when the program ended and prints the opcode and function tables
+	void Report(std::ostream &stream);
+
+private:
+	struct FunctionStats
+	{
+		std::string name;
+		uint64 calls = 0;
+		uint64 inclusiveInstructions = 0;
+		uint64 exclusiveInstructions = 0;
+		uint64 inclusiveCycles = 0;
+		uint64 exclusiveCycles = 0;
+		uint32 activeFrames = 0;	//Recursive calls only add inclusive totals for the outermost frame
+	};
+	struct Frame
+	{
+		uint32 function;
+		uint64 entryInstructions;
+		uint64 entryCycles;
+	};
+
+	static inline uint64 ReadCycles();
+	uint32 GetFunction(uint32 address);
+	void EnterFunction(uint32 function);
+	void LeaveFunction();
+
+	std::vector<uint64> m_OpcodeCounts;
+	std::vector<uint64> m_OpcodeCycles;
+
+	std::vector<FunctionStats> m_Functions;		//0 is the code outside of any function
+	std::unordered_map<uint32, uint32> m_FunctionIndices;
+	std::vector<Frame> m_CallStack;
+
+	uint64 m_Instructions = 0;
+	uint64 m_Cycles = 0;			//Cycles charged to instructions so far, the profiler's own work isn't in here
+	uint64 m_LastCycles = 0;
+	Opcode m_LastOpcode = Opcode::INVALID;
+	bool m_Started = false;
+};
+
+uint64 ExecutionProfiler::ReadCycles()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	return __rdtsc();
+#elif defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	//No portable cycle counter, fall back to nanoseconds
+	return static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
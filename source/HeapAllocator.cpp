@@ -0,0 +1,223 @@
+#include "HeapAllocator.h"
+
+bool HeapAllocator::Init(uint8* ram, uint32 base, uint32 size)
+{
+	if(size < META_WORD_COUNT * sizeof(uint32) + MIN_BLOCK_SIZE) return false;
+	m_RAM = ram;
+	m_Base = base;
+	m_FirstBlock = Meta(META_WORD_COUNT);
+
+	m_Stats = HeapStats();
+	for(uint32 word = 0; word < META_WORD_COUNT; ++word) Store(Meta(word), 0);
+	Store(Meta(META_BUMP), m_FirstBlock);
+	Store(Meta(META_END), base + size);
+	return true;
+}
+
+uint32 HeapAllocator::AllocateSlow(uint32 blockSize)
+{
+	uint32 sizeClass = GetSizeClass(blockSize);
+
+	//Blocks in a large class differ in size, take the first one that fits
+	if(blockSize > SMALL_BLOCK_LIMIT)
+	{
+		for(uint32 block = Load(ListHead(sizeClass)); block != 0; block = Load(block + NEXT_OFFSET))
+		{
+			if((Load(block) & ~TAG_MASK) >= blockSize) return TakeBlock(block, blockSize);
+		}
+	}
+
+	//Fresh memory before splitting up bigger blocks, the block before the bump pointer is always used
+	uint32 bump = Load(Meta(META_BUMP));
+	if(Load(Meta(META_END)) - bump >= blockSize)
+	{
+		Store(bump, blockSize | USED_BIT | PREV_USED_BIT);
+		Store(Meta(META_BUMP), bump + blockSize);
+		return bump + sizeof(uint32);
+	}
+
+	//Any block in a bigger class fits
+	uint32 biggerClass = FindClassFrom(sizeClass + 1);
+	if(biggerClass < CLASS_COUNT) return TakeBlock(Load(ListHead(biggerClass)), blockSize);
+	return 0;
+}
+
+uint32 HeapAllocator::TakeBlock(uint32 block, uint32 blockSize)
+{
+	uint32 freeSize = Load(block) & ~TAG_MASK;
+	Unlink(block, freeSize);
+
+	//Return what's left to the free list of its own class if it can hold a block, its next neighbour stays marked free
+	uint32 remainder = freeSize - blockSize;
+	if(remainder >= MIN_BLOCK_SIZE)
+	{
+		Store(block, blockSize | USED_BIT | PREV_USED_BIT);
+		PushFree(block + blockSize, remainder);
+	}
+	else
+	{
+		Store(block, freeSize | USED_BIT | PREV_USED_BIT);
+		MarkNextUsed(block, freeSize);
+	}
+	return block + sizeof(uint32);
+}
+
+HeapAllocator::FreeResult HeapAllocator::Free(uint32 address)
+{
+	FreeResult result = Release(address);
+	if(result == FreeResult::FREED) ++m_Stats.frees;
+	else ++m_Stats.invalidFrees;
+	return result;
+}
+
+HeapAllocator::FreeResult HeapAllocator::Release(uint32 address)
+{
+	uint32 block = address - sizeof(uint32);
+	uint32 bump = Load(Meta(META_BUMP));
+	if(address % sizeof(uint32) != 0 || address < m_FirstBlock + sizeof(uint32) || block >= bump) return FreeResult::BAD_POINTER;
+	uint32 header = Load(block);
+	uint32 blockSize = header & ~TAG_MASK;
+	if(blockSize < MIN_BLOCK_SIZE || blockSize > bump - block) return FreeResult::BAD_POINTER;
+	if(!(header & USED_BIT)) return FreeResult::DOUBLE_FREE;
+	//The next block has to agree that this one is used
+	uint32 next = block + blockSize;
+	if(next != bump && !(Load(next) & PREV_USED_BIT)) return FreeResult::BAD_POINTER;
+
+	//Stale headers inside merged blocks read as free, so freeing them again is caught as a double free
+	Store(block, header & ~USED_BIT);
+	m_Stats.bytesInUse -= blockSize;
+
+	//Merge with the free block before, its size is in the footer right below this header
+	if(!(header & PREV_USED_BIT))
+	{
+		uint32 prevSize = Load(block - sizeof(uint32));
+		block -= prevSize;
+		Unlink(block, prevSize);
+		blockSize += prevSize;
+	}
+
+	//Give the memory back to the bump region when this is the last block
+	if(next == bump)
+	{
+		Store(Meta(META_BUMP), block);
+		return FreeResult::FREED;
+	}
+
+	//Merge with the free block after
+	uint32 nextHeader = Load(next);
+	if(!(nextHeader & USED_BIT))
+	{
+		uint32 nextSize = nextHeader & ~TAG_MASK;
+		Unlink(next, nextSize);
+		blockSize += nextSize;
+	}
+	else Store(next, nextHeader & ~PREV_USED_BIT);
+
+	PushFree(block, blockSize);
+	return FreeResult::FREED;
+}
+
+void HeapAllocator::PushFree(uint32 block, uint32 blockSize)
+{
+	uint32 sizeClass = GetSizeClass(blockSize);
+	uint32 head = ListHead(sizeClass);
+	uint32 first = Load(head);
+	Store(block, blockSize | PREV_USED_BIT);
+	Store(block + blockSize - sizeof(uint32), blockSize);
+	Store(block + NEXT_OFFSET, first);
+	Store(block + PREV_OFFSET, 0);
+	if(first != 0) Store(first + PREV_OFFSET, block);
+	Store(head, block);
+	SetClassBit(sizeClass, true);
+	++m_Stats.freeBlocks;
+}
+
+void HeapAllocator::SetClassBit(uint32 sizeClass, bool nonEmpty)
+{
+	uint32 maskWord = Meta(sizeClass < 32 ? META_CLASS_MASK_LO : META_CLASS_MASK_HI);
+	uint32 bit = 1u << (sizeClass % 32);
+	uint32 mask = Load(maskWord);
+	Store(maskWord, nonEmpty ? mask | bit : mask & ~bit);
+}
+
+uint32 HeapAllocator::FindClassFrom(uint32 sizeClass) const
+{
+	for(; sizeClass < CLASS_COUNT; sizeClass = (sizeClass / 32 + 1) * 32)
+	{
+		uint32 mask = Load(Meta(sizeClass < 32 ? META_CLASS_MASK_LO : META_CLASS_MASK_HI)) & (~0u << (sizeClass % 32));
+		if(mask == 0) continue;
+#if defined(__GNUC__) || defined(__clang__)
+		return (sizeClass / 32) * 32 + static_cast<uint32>(__builtin_ctz(mask));
+#else
+		uint32 lowest = 0;
+		while(!(mask & (1u << lowest))) ++lowest;
+		return (sizeClass / 32) * 32 + lowest;
+#endif
+	}
+	return CLASS_COUNT;
+}
+
+HeapStats HeapAllocator::GetStats() const
+{
+	HeapStats stats = m_Stats;
+	uint32 bump = Load(Meta(META_BUMP));
+	stats.bumpBytes = Load(Meta(META_END)) - bump;
+	stats.freeBytes = bump - m_FirstBlock - stats.bytesInUse;	//Everything below the bump pointer is in a block
+
+	//Only the highest non empty class can hold the largest free block
+	uint32 largest = 0;
+	for(uint32 sizeClass = CLASS_COUNT; sizeClass-- > 0;)
+	{
+		if(!(Load(Meta(sizeClass < 32 ? META_CLASS_MASK_LO : META_CLASS_MASK_HI)) & (1u << (sizeClass % 32)))) continue;
+		for(uint32 block = Load(ListHead(sizeClass)); block != 0; block = Load(block + NEXT_OFFSET))
+		{
+			uint32 blockSize = Load(block) & ~TAG_MASK;
+			if(blockSize > largest) largest = blockSize;
+		}
+		break;
+	}
+	stats.largestFreeBlock = largest > stats.bumpBytes ? largest : stats.bumpBytes;
+
+	uint64 allFree = static_cast<uint64>(stats.freeBytes) + stats.bumpBytes;
+	stats.fragmentation = allFree == 0 ? 0.f : 1.f - static_cast<float>(static_cast<double>(stats.largestFreeBlock) / static_cast<double>(allFree));
+	return stats;
+}
+
+void HeapStats::WriteJson(std::ostream &stream) const
+{
+	stream << "{\n";
+	stream << "\t\"allocations\": " << allocations << ",\n";
+	stream << "\t\"frees\": " << frees << ",\n";
+	stream << "\t\"failedAllocations\": " << failedAllocations << ",\n";
+	stream << "\t\"invalidFrees\": " << invalidFrees << ",\n";
+	stream << "\t\"bytesInUse\": " << bytesInUse << ",\n";
+	stream << "\t\"highWaterMark\": " << highWaterMark << ",\n";
+	stream << "\t\"freeBlocks\": " << freeBlocks << ",\n";
+	stream << "\t\"freeBytes\": " << freeBytes << ",\n";
+	stream << "\t\"bumpBytes\": " << bumpBytes << ",\n";
+	stream << "\t\"largestFreeBlock\": " << largestFreeBlock << ",\n";
+	stream << "\t\"fragmentation\": " << fragmentation << ",\n";
+	stream << "\t\"sizeHistogram\": [";
+	for(uint32 bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+	{
+		stream << (bucket == 0 ? "" : ", ") << sizeHistogram[bucket];
+	}
+	stream << "]\n}" << std::endl;
+}
+
+void HeapAllocator::Print(std::ostream &stream) const
+{
+	stream << "[DBG Heap]: bump: " << Load(Meta(META_BUMP)) << " end: " << Load(Meta(META_END)) << " \t";
+	for(uint32 sizeClass = 0; sizeClass < CLASS_COUNT; ++sizeClass)
+	{
+		uint32 block = Load(ListHead(sizeClass));
+		if(block == 0) continue;
+		stream << "c" << sizeClass << "{";
+		for(; block != 0; block = Load(block + NEXT_OFFSET))
+		{
+			stream << " @" << block << " s: " << (Load(block) & ~TAG_MASK);
+		}
+		stream << " } ";
+	}
+	stream << std::endl;
+}
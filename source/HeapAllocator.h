@@ -0,0 +1,183 @@
+#pragma once
+#include <ostream>
+#include <array>
+
+#include "AtomicTypes.h"
+#include "WordFormat.h"
+
+//Heap telemetry. The counters are kept up to date on every allocation and free,
+//the largest free block and fragmentation are derived when the stats are queried
+struct HeapStats
+{
+	static const uint32 HISTOGRAM_BUCKETS = 33;
+
+	uint64 allocations = 0;
+	uint64 frees = 0;
+	uint64 failedAllocations = 0;
+	uint64 invalidFrees = 0;			//Double frees and bad pointers
+	uint32 bytesInUse = 0;				//Block bytes handed out, headers included
+	uint32 highWaterMark = 0;			//Most bytes in use at once
+	uint32 freeBlocks = 0;				//Blocks on the free lists
+	uint32 freeBytes = 0;				//Bytes on the free lists
+	uint32 bumpBytes = 0;				//Memory after the bump pointer that no block covers yet
+	uint32 largestFreeBlock = 0;		//Largest contiguous free memory, including the bump region
+	float fragmentation = 0.f;			//1 - largest free block / all free memory
+	std::array<uint64, HISTOGRAM_BUCKETS> sizeHistogram{};	//Requested sizes, bucket n > 0 counts sizes in [2^(n-1), 2^n)
+
+	void WriteJson(std::ostream &stream) const;
+};
+
+//Segregated fit allocator for the VM heap. All of its state lives in VM RAM at the heap base so it can be inspected
+//from scripts and dumps: a bump pointer into fresh memory, a bitmap of non empty size classes and one free list per class.
+//Small blocks get a class per word size so allocating them is a list pop, larger blocks share a class per power of two.
+//
+//Blocks carry boundary tags so freeing coalesces with the physical neighbours without walking any list:
+//	used block:	[size | USED | PREV_USED] [payload ...]
+//	free block:	[size | PREV_USED] [next free] [previous free] ... [size]
+//Two free blocks are never adjacent and a free block never ends at the bump pointer, those get merged on free
+class HeapAllocator
+{
+public:
+	static const uint32 USED_BIT = 1;
+	static const uint32 PREV_USED_BIT = 2;
+	static const uint32 TAG_MASK = USED_BIT | PREV_USED_BIT;
+
+	static const uint32 MIN_BLOCK_SIZE = sizeof(uint32)*4;	//Header, list links and footer of a free block
+	static const uint32 SMALL_BLOCK_LIMIT = 128;			//Largest block size with a class of its own
+	static const uint32 SMALL_CLASS_COUNT = (SMALL_BLOCK_LIMIT - MIN_BLOCK_SIZE) / sizeof(uint32) + 1;
+	static const uint32 CLASS_COUNT = SMALL_CLASS_COUNT + 32 - 7;	//A class per power of two from 2^7 to 2^31
+
+	//Heap metadata words at the heap base
+	enum MetaWord : uint32
+	{
+		META_BUMP,			//Start of memory that isn't part of a block
+		META_END,			//End of the heap
+		META_CLASS_MASK_LO,	//Bit per size class with a non empty free list
+		META_CLASS_MASK_HI,
+		META_FREE_LISTS,	//First free block per size class, 0 if there is none
+
+		META_WORD_COUNT = META_FREE_LISTS + CLASS_COUNT
+	};
+
+	enum class FreeResult
+	{
+		FREED,
+		DOUBLE_FREE,	//The block at the address is already free
+		BAD_POINTER		//The address was never returned by Allocate
+	};
+
+	//Lays out the metadata at base, the heap may use [base, base + size)
+	bool Init(uint8* ram, uint32 base, uint32 size);
+
+	//Returns the address of the usable memory, 0 if the heap is exhausted
+	inline uint32 Allocate(uint32 size);
+	//Invalid frees are detected from the block tags and leave the heap untouched
+	FreeResult Free(uint32 address);
+
+	HeapStats GetStats() const;
+	//Walks all free lists
+	void Print(std::ostream &stream) const;
+
+	static uint32 GetBlockSize(uint32 size) { uint32 block = AlignWord(size) + sizeof(uint32); return block < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : block; }
+	static inline uint32 GetSizeClass(uint32 blockSize);
+
+private:
+	uint32 AllocateSlow(uint32 blockSize);
+	FreeResult Release(uint32 address);
+	uint32 TakeBlock(uint32 block, uint32 blockSize);
+	void PushFree(uint32 block, uint32 blockSize);
+	inline void Unlink(uint32 block, uint32 blockSize);
+	inline void MarkNextUsed(uint32 block, uint32 blockSize);
+	inline void CountAllocation(uint32 size, uint32 blockSize);
+
+	uint32 Load(uint32 address) const { return LoadWord(m_RAM + address); }
+	void Store(uint32 address, uint32 value) { StoreWord(m_RAM + address, value); }
+	uint32 Meta(uint32 word) const { return m_Base + word * sizeof(uint32); }
+	uint32 ListHead(uint32 sizeClass) const { return Meta(META_FREE_LISTS + sizeClass); }
+	void SetClassBit(uint32 sizeClass, bool nonEmpty);
+	uint32 FindClassFrom(uint32 sizeClass) const;
+	static inline uint32 FloorLog2(uint32 value);
+
+	static const uint32 NEXT_OFFSET = sizeof(uint32);
+	static const uint32 PREV_OFFSET = sizeof(uint32)*2;
+
+	uint8* m_RAM = nullptr;
+	uint32 m_Base = 0;
+	uint32 m_FirstBlock = 0;
+	HeapStats m_Stats;
+};
+
+uint32 HeapAllocator::FloorLog2(uint32 value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return 31 - static_cast<uint32>(__builtin_clz(value));
+#else
+	uint32 log = 0;
+	while(value >>= 1) ++log;
+	return log;
+#endif
+}
+
+uint32 HeapAllocator::GetSizeClass(uint32 blockSize)
+{
+	if(blockSize <= SMALL_BLOCK_LIMIT) return (blockSize - MIN_BLOCK_SIZE) / sizeof(uint32);
+	return SMALL_CLASS_COUNT + FloorLog2(blockSize) - FloorLog2(SMALL_BLOCK_LIMIT);
+}
+
+void HeapAllocator::Unlink(uint32 block, uint32 blockSize)
+{
+	--m_Stats.freeBlocks;
+	uint32 sizeClass = GetSizeClass(blockSize);
+	uint32 next = Load(block + NEXT_OFFSET);
+	uint32 prev = Load(block + PREV_OFFSET);
+	if(prev == 0)
+	{
+		Store(ListHead(sizeClass), next);
+		if(next == 0) SetClassBit(sizeClass, false);
+	}
+	else Store(prev + NEXT_OFFSET, next);
+	if(next != 0) Store(next + PREV_OFFSET, prev);
+}
+
+void HeapAllocator::MarkNextUsed(uint32 block, uint32 blockSize)
+{
+	//A free block is never followed by the bump pointer, so there always is a next block
+	uint32 next = block + blockSize;
+	Store(next, Load(next) | PREV_USED_BIT);
+}
+
+void HeapAllocator::CountAllocation(uint32 size, uint32 blockSize)
+{
+	++m_Stats.allocations;
+	++m_Stats.sizeHistogram[size == 0 ? 0 : FloorLog2(size) + 1];
+	m_Stats.bytesInUse += blockSize;
+	if(m_Stats.bytesInUse > m_Stats.highWaterMark) m_Stats.highWaterMark = m_Stats.bytesInUse;
+}
+
+uint32 HeapAllocator::Allocate(uint32 size)
+{
+	uint32 blockSize = GetBlockSize(size);
+	if(blockSize < size)	//Wrapped around
+	{
+		++m_Stats.failedAllocations;
+		return 0;
+	}
+	//Small blocks of a class fit exactly, so the list head can be taken without looking at it
+	if(blockSize <= SMALL_BLOCK_LIMIT)
+	{
+		uint32 sizeClass = GetSizeClass(blockSize);
+		uint32 block = Load(ListHead(sizeClass));
+		if(block != 0)
+		{
+			Unlink(block, blockSize);
+			Store(block, blockSize | USED_BIT | PREV_USED_BIT);
+			MarkNextUsed(block, blockSize);
+			CountAllocation(size, blockSize);
+			return block + sizeof(uint32);
+		}
+	}
+	uint32 address = AllocateSlow(blockSize);
+	if(address == 0) ++m_Stats.failedAllocations;
+	else CountAllocation(size, Load(address - sizeof(uint32)) & ~TAG_MASK);
+	return address;
+}
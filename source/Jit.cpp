@@ -0,0 +1,422 @@
+#include "Jit.h"
+
+#ifdef VM_JIT
+
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "Opcode.h"
+#include "ProgramImage.h"
+
+namespace
+{
+	enum Reg : uint8
+	{
+		RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+		R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+		NO_INDEX = RSP	//An SIB index of RSP means no index
+	};
+	enum Condition : uint8
+	{
+		CC_E = 0x4,
+		CC_NE = 0x5,
+		CC_L = 0xC,
+		CC_G = 0xF
+	};
+
+	//Entering and leaving native code costs about as much as interpreting this many instructions, shorter runs are
+	//left to the interpreter
+	const uint32 MIN_ENTRY_RUN = 16;
+
+	//Registers pinned while jitted code runs, all callee saved
+	const Reg RAM = R12;	//Base of VM RAM
+	const Reg SP = R13;		//VM stack pointer, sign extended so the guard word at -4 is reachable
+	const Reg LCL = R14;
+	const Reg ARG = R15;
+	const Reg STATE = RBX;	//JitRegisters the registers are loaded from and written back to
+
+	//Just the x86-64 encodings the compiler needs. Memory operands are always [base + index + disp32]
+	class Emitter
+	{
+	public:
+		std::vector<uint8> code;
+
+		size_t Offset() const { return code.size(); }
+		void Byte(uint8 value) { code.push_back(value); }
+		void Int32(int32 value)
+		{
+			uint8 bytes[sizeof(int32)];
+			std::memcpy(bytes, &value, sizeof(int32));
+			code.insert(code.end(), bytes, bytes + sizeof(int32));
+		}
+		void Patch(size_t at, size_t target)
+		{
+			int32 relative = static_cast<int32>(static_cast<int64>(target) - static_cast<int64>(at + sizeof(int32)));
+			std::memcpy(code.data() + at, &relative, sizeof(int32));
+		}
+
+		void Load32(Reg dst, Reg base, Reg index, int32 disp) { Memory(0x8B, false, dst, base, index, disp); }
+		void Store32(Reg src, Reg base, Reg index, int32 disp) { Memory(0x89, false, src, base, index, disp); }
+		void StoreImm32(Reg base, Reg index, int32 disp, int32 value) { Memory(0xC7, false, 0, base, index, disp); Int32(value); }
+		void LoadSigned32(Reg dst, Reg base, Reg index, int32 disp) { Memory(0x63, true, dst, base, index, disp); }	//movsxd
+
+		void MovImm32(Reg dst, int32 value) { Rex(false, 0, 0, dst); Byte(0xB8 + (dst & 7)); Int32(value); }
+		void Mov32(Reg dst, Reg src) { Register(0x89, false, src, dst); }
+		void Mov64(Reg dst, Reg src) { Register(0x89, true, src, dst); }
+		void Add32(Reg dst, Reg src) { Register(0x01, false, src, dst); }
+		void Sub32(Reg dst, Reg src) { Register(0x29, false, src, dst); }
+		void Cmp32(Reg lhs, Reg rhs) { Register(0x39, false, rhs, lhs); }
+		void Test32(Reg lhs, Reg rhs) { Register(0x85, false, rhs, lhs); }
+		void AddImm32(Reg dst, int32 value) { Register(0x81, false, 0, dst); Int32(value); }
+		void AddImm64(Reg dst, int8 value) { Register(0x83, true, 0, dst); Byte(static_cast<uint8>(value)); }
+		void SubImm64(Reg dst, int8 value) { Register(0x83, true, 5, dst); Byte(static_cast<uint8>(value)); }
+		//eax = condition ? 1 : 0
+		void SetEax(Condition condition)
+		{
+			Byte(0x0F); Byte(0x90 | condition); Byte(0xC0);	//setcc al
+			Byte(0x0F); Byte(0xB6); Byte(0xC0);					//movzx eax, al
+		}
+
+		void Push(Reg reg) { Rex(false, 0, 0, reg); Byte(0x50 + (reg & 7)); }
+		void Pop(Reg reg) { Rex(false, 0, 0, reg); Byte(0x58 + (reg & 7)); }
+		void Ret() { Byte(0xC3); }
+		//Return the offset of the rel32 to patch
+		size_t Jmp() { Byte(0xE9); Int32(0); return Offset() - sizeof(int32); }
+		size_t Jcc(Condition condition) { Byte(0x0F); Byte(0x80 | condition); Int32(0); return Offset() - sizeof(int32); }
+
+	private:
+		void Rex(bool wide, uint8 reg, uint8 index, uint8 base)
+		{
+			uint8 rex = static_cast<uint8>(0x40 | (wide ? 8 : 0) | ((reg >> 3) & 1) << 2 | ((index >> 3) & 1) << 1 | ((base >> 3) & 1));
+			if(rex != 0x40) Byte(rex);
+		}
+		void Memory(uint8 opcode, bool wide, uint8 reg, Reg base, Reg index, int32 disp)
+		{
+			Rex(wide, reg, index, base);
+			Byte(opcode);
+			Byte(static_cast<uint8>(0x80 | (reg & 7) << 3 | 0x4));			//mod 10: disp32, rm 100: SIB follows
+			Byte(static_cast<uint8>((index & 7) << 3 | (base & 7)));		//scale 1
+			Int32(disp);
+		}
+		void Register(uint8 opcode, bool wide, uint8 reg, Reg rm)
+		{
+			Rex(wide, reg, 0, rm);
+			Byte(opcode);
+			Byte(static_cast<uint8>(0xC0 | (reg & 7) << 3 | (rm & 7)));
+		}
+	};
+
+	bool IsCompilableOpcode(Opcode code)
+	{
+		switch(code)
+		{
+		case Opcode::LITERAL:
+		case Opcode::LOAD:
+		case Opcode::STORE:
+		case Opcode::LOAD_LCL:
+		case Opcode::STORE_LCL:
+		case Opcode::LOAD_ARG:
+		case Opcode::LOAD_I:
+		case Opcode::STORE_I:
+		case Opcode::LOAD_LCL_I:
+		case Opcode::STORE_LCL_I:
+		case Opcode::LOAD_ARG_I:
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::LESS:
+		case Opcode::GREATER:
+		case Opcode::NOT:
+		case Opcode::EQUALS:
+		case Opcode::JMP_I:
+		case Opcode::JMP_IF_I:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	class FunctionCompiler
+	{
+	public:
+		FunctionCompiler(const ProgramImage &image, uint32 begin, uint32 end) : m_Image(image), m_Begin(begin), m_End(end) {}
+
+		//Emits the function body and returns the indices worth entering at
+		std::vector<uint32> Compile();
+		//Emits a stub per entry point, then resolves all branches
+		void Link(const std::vector<uint32> &entries, std::vector<size_t> &entryOffsets);
+
+		std::vector<uint8>& GetCode() { return m_Emitter.code; }
+
+	private:
+		struct Branch
+		{
+			size_t at;
+			uint32 target;	//Decoded index
+		};
+
+		bool IsCompilable(uint32 index) const
+		{
+			for(uint32 part = 0; part < m_Image.GetInstructionLength(index); ++part)
+			{
+				if(!IsCompilableOpcode(m_Image.GetPart(index, part))) return false;
+			}
+			return true;
+		}
+		bool InRange(uint32 index) const { return index >= m_Begin && index < m_End; }
+		//Whether native code entered here loops or runs long enough before its first exit to pay for the switch
+		bool IsWorthEntering(uint32 index) const;
+
+		void EmitPart(Opcode code, const ProgramImage::Instruction &instruction);
+		void EmitExit(uint32 index);
+		void BranchTo(size_t at, uint32 target) { m_Branches.push_back(Branch{at, target}); }
+
+		const ProgramImage &m_Image;
+		uint32 m_Begin;
+		uint32 m_End;
+		Emitter m_Emitter;
+		std::vector<size_t> m_Labels;			//Code offset per decoded index in the range
+		std::vector<Branch> m_Branches;
+		std::vector<size_t> m_ExitJumps;		//Jumps to the epilogue
+	};
+
+	bool FunctionCompiler::IsWorthEntering(uint32 index) const
+	{
+		uint32 run = 0;
+		while(InRange(index) && IsCompilable(index) && run < MIN_ENTRY_RUN)
+		{
+			uint32 next = index + m_Image.GetInstructionLength(index);
+			for(uint32 part = 0; part < m_Image.GetInstructionLength(index); ++part)
+			{
+				Opcode code = m_Image.GetPart(index, part);
+				uint32 target = m_Image.GetInstruction(index + part).target;
+				if(code != Opcode::JMP_I && code != Opcode::JMP_IF_I) continue;
+				if(InRange(target) && target <= index) return true;
+				if(code == Opcode::JMP_I) next = target;
+			}
+			run += m_Image.GetInstructionLength(index);
+			index = next;
+		}
+		return run >= MIN_ENTRY_RUN;
+	}
+
+	std::vector<uint32> FunctionCompiler::Compile()
+	{
+		m_Labels.assign(m_End - m_Begin, 0);
+		std::vector<uint32> entries;
+		bool enterable = true;	//The function start and every instruction after an exit
+		for(uint32 index = m_Begin; index < m_End; index += m_Image.GetInstructionLength(index))
+		{
+			m_Labels[index - m_Begin] = m_Emitter.Offset();
+			if(!IsCompilable(index))
+			{
+				EmitExit(index);
+				enterable = true;
+				continue;
+			}
+			if(enterable) entries.push_back(index);
+			enterable = false;
+			for(uint32 part = 0; part < m_Image.GetInstructionLength(index); ++part)
+			{
+				const ProgramImage::Instruction &instruction = m_Image.GetInstruction(index + part);
+				Opcode code = m_Image.GetPart(index, part);
+				EmitPart(code, instruction);
+				if((code == Opcode::JMP_I || code == Opcode::JMP_IF_I) && InRange(instruction.target) && IsCompilable(instruction.target))
+				{
+					entries.push_back(instruction.target);
+				}
+			}
+		}
+		//Falling out of the range runs into the next function's FRAME or the end of the code segment
+		EmitExit(m_End);
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [this](uint32 index) { return !IsWorthEntering(index); }), entries.end());
+		return entries;
+	}
+
+	void FunctionCompiler::EmitPart(Opcode code, const ProgramImage::Instruction &instruction)
+	{
+		Emitter &e = m_Emitter;
+		int32 immediate = instruction.immediate;
+		switch(code)
+		{
+		case Opcode::LITERAL:
+			e.AddImm64(SP, 4);
+			e.StoreImm32(RAM, SP, 0, immediate);
+			break;
+		case Opcode::LOAD:
+		case Opcode::LOAD_LCL:
+		case Opcode::LOAD_ARG:
+			e.Load32(RAX, RAM, SP, 0);
+			if(code == Opcode::LOAD_LCL) e.Add32(RAX, LCL);
+			if(code == Opcode::LOAD_ARG) e.Add32(RAX, ARG);
+			e.Load32(RAX, RAM, RAX, 0);
+			e.Store32(RAX, RAM, SP, 0);
+			break;
+		case Opcode::STORE:
+		case Opcode::STORE_LCL:
+			e.Load32(RAX, RAM, SP, 0);
+			if(code == Opcode::STORE_LCL) e.Add32(RAX, LCL);
+			e.Load32(RCX, RAM, SP, -4);
+			e.SubImm64(SP, 8);
+			e.Store32(RCX, RAM, RAX, 0);
+			break;
+		case Opcode::LOAD_I:
+		case Opcode::LOAD_LCL_I:
+		case Opcode::LOAD_ARG_I:
+			//Addresses are unsigned 32 bit, 32 bit operations zero extend them into rax
+			if(code == Opcode::LOAD_I) e.MovImm32(RAX, immediate);
+			else
+			{
+				e.Mov32(RAX, code == Opcode::LOAD_LCL_I ? LCL : ARG);
+				e.AddImm32(RAX, immediate);
+			}
+			e.Load32(RAX, RAM, RAX, 0);
+			e.AddImm64(SP, 4);
+			e.Store32(RAX, RAM, SP, 0);
+			break;
+		case Opcode::STORE_I:
+		case Opcode::STORE_LCL_I:
+			e.Load32(RCX, RAM, SP, 0);
+			e.SubImm64(SP, 4);
+			if(code == Opcode::STORE_I) e.MovImm32(RAX, immediate);
+			else
+			{
+				e.Mov32(RAX, LCL);
+				e.AddImm32(RAX, immediate);
+			}
+			e.Store32(RCX, RAM, RAX, 0);
+			break;
+		case Opcode::ADD:
+		case Opcode::SUB:
+		case Opcode::LESS:
+		case Opcode::GREATER:
+		case Opcode::EQUALS:
+			e.Load32(RCX, RAM, SP, 0);
+			e.SubImm64(SP, 4);
+			e.Load32(RAX, RAM, SP, 0);
+			if(code == Opcode::ADD) e.Add32(RAX, RCX);
+			else if(code == Opcode::SUB) e.Sub32(RAX, RCX);
+			else
+			{
+				e.Cmp32(RAX, RCX);
+				e.SetEax(code == Opcode::LESS ? CC_L : code == Opcode::GREATER ? CC_G : CC_E);
+			}
+			e.Store32(RAX, RAM, SP, 0);
+			break;
+		case Opcode::NOT:
+			e.Load32(RAX, RAM, SP, 0);
+			e.Test32(RAX, RAX);
+			e.SetEax(CC_E);
+			e.Store32(RAX, RAM, SP, 0);
+			break;
+		case Opcode::JMP_I:
+			BranchTo(e.Jmp(), instruction.target);
+			break;
+		case Opcode::JMP_IF_I:
+			e.Load32(RAX, RAM, SP, 0);
+			e.SubImm64(SP, 4);
+			e.Test32(RAX, RAX);
+			BranchTo(e.Jcc(CC_NE), instruction.target);
+			break;
+		default:
+			break;
+		}
+	}
+
+	void FunctionCompiler::EmitExit(uint32 index)
+	{
+		m_Emitter.MovImm32(RAX, static_cast<int32>(index));
+		m_ExitJumps.push_back(m_Emitter.Jmp());
+	}
+
+	void FunctionCompiler::Link(const std::vector<uint32> &entries, std::vector<size_t> &entryOffsets)
+	{
+		Emitter &e = m_Emitter;
+
+		//Branches leaving the function exit at their target
+		for(const Branch &branch : m_Branches)
+		{
+			if(InRange(branch.target)) e.Patch(branch.at, m_Labels[branch.target - m_Begin]);
+			else
+			{
+				e.Patch(branch.at, e.Offset());
+				EmitExit(branch.target);
+			}
+		}
+
+		//Write the registers back, eax holds the index to continue at
+		size_t epilogue = e.Offset();
+		e.Store32(SP, STATE, NO_INDEX, 0);
+		e.Store32(LCL, STATE, NO_INDEX, 4);
+		e.Store32(ARG, STATE, NO_INDEX, 8);
+		e.Pop(R15);
+		e.Pop(R14);
+		e.Pop(R13);
+		e.Pop(R12);
+		e.Pop(RBX);
+		e.Ret();
+		for(size_t exit : m_ExitJumps) e.Patch(exit, epilogue);
+
+		//uint32 entry(uint8* ram (rdi), JitRegisters* registers (rsi))
+		for(uint32 entry : entries)
+		{
+			entryOffsets.push_back(e.Offset());
+			e.Push(RBX);
+			e.Push(R12);
+			e.Push(R13);
+			e.Push(R14);
+			e.Push(R15);
+			e.Mov64(STATE, RSI);
+			e.Mov64(RAM, RDI);
+			e.LoadSigned32(SP, STATE, NO_INDEX, 0);
+			e.Load32(LCL, STATE, NO_INDEX, 4);
+			e.Load32(ARG, STATE, NO_INDEX, 8);
+			e.Patch(e.Jmp(), m_Labels[entry - m_Begin]);
+		}
+	}
+}
+
+std::unique_ptr<JitFunction> JitFunction::Compile(const ProgramImage &image, uint32 begin)
+{
+	uint32 end = begin;
+	while(end < image.GetInstructionCount() && image.GetInstruction(end).operation != Opcode::FRAME && image.GetInstruction(end).operation != Opcode::HALT)
+	{
+		++end;
+	}
+
+	FunctionCompiler compiler(image, begin, end);
+	std::vector<uint32> entries = compiler.Compile();
+	if(entries.empty()) return nullptr;
+	std::sort(entries.begin(), entries.end());
+	entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+	std::vector<size_t> entryOffsets;
+	compiler.Link(entries, entryOffsets);
+
+	//Written while writable, then switched to executable so the pages are never both
+	std::vector<uint8> &code = compiler.GetCode();
+	void* pCode = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(pCode == MAP_FAILED) return nullptr;
+	std::memcpy(pCode, code.data(), code.size());
+	if(mprotect(pCode, code.size(), PROT_READ | PROT_EXEC) != 0)
+	{
+		munmap(pCode, code.size());
+		return nullptr;
+	}
+
+	std::unique_ptr<JitFunction> function(new JitFunction());
+	function->m_pCode = pCode;
+	function->m_Size = code.size();
+	for(size_t entry = 0; entry < entries.size(); ++entry)
+	{
+		uint8* pEntry = static_cast<uint8*>(pCode) + entryOffsets[entry];
+		function->m_Entries.emplace_back(entries[entry], reinterpret_cast<JitEntry>(pEntry));
+	}
+	return function;
+}
+
+JitFunction::~JitFunction()
+{
+	if(m_pCode != nullptr) munmap(m_pCode, m_Size);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "AtomicTypes.h"
+
+//Define VM_JIT to build the baseline JIT. It emits x86-64 code for the System V calling convention
+#if defined(VM_JIT) && (!defined(__x86_64__) || defined(PLATFORM_Win))
+	#undef VM_JIT
+#endif
+
+class ProgramImage;
+
+//VM registers handed to and back from jitted code
+struct JitRegisters
+{
+	int32 stackPointer;
+	uint32 localBase;
+	uint32 argumentBase;
+};
+
+//Runs jitted code from an entry point until it reaches an instruction it leaves to the interpreter,
+//returns the decoded index of that instruction
+typedef uint32 (*JitEntry)(uint8* ram, JitRegisters* registers);
+
+//Native code for one function, from after its FRAME to the next one, or for the code before the first function. Arithmetic, loads, stores and branches inside the
+//function are compiled, every other instruction (calls, returns, ALLOC, FREE, output, computed jumps) and branches out of
+//the function exit to the interpreter. The stack stays in VM RAM in the same layout, so jitted and interpreted
+//frames call each other through the interpreter's CALL and RETURN.
+//Entry points are the function body, branch targets and the instructions after an exit that start a loop or a long
+//enough run of compiled instructions
+class JitFunction
+{
+public:
+	//Compiles from the decoded index a function starts at, returns nullptr if there is no entry point worth compiling
+	static std::unique_ptr<JitFunction> Compile(const ProgramImage &image, uint32 begin);
+	~JitFunction();
+	JitFunction(const JitFunction&) = delete;
+	JitFunction& operator=(const JitFunction&) = delete;
+
+	//Decoded instruction index and native entry point
+	const std::vector<std::pair<uint32, JitEntry>>& GetEntries() const { return m_Entries; }
+	size_t GetCodeSize() const { return m_Size; }
+
+private:
+	JitFunction() = default;
+
+	void* m_pCode = nullptr;
+	size_t m_Size = 0;
+	std::vector<std::pair<uint32, JitEntry>> m_Entries;
+};
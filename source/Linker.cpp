@@ -0,0 +1,129 @@
+#include "Linker.h"
+
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+
+#include "Opcode.h"
+#include "WordFormat.h"
+
+static void WriteWord(std::vector<uint8> &target, uint32 value)
+{
+	uint8 word[sizeof(uint32)];
+	StoreWord(word, value);
+	target.insert(target.end(), word, word + sizeof(uint32));
+}
+
+void Linker::AddObject(ObjectFile object, const std::string &name)
+{
+	Module module;
+	module.name = name;
+	module.object = std::move(object);
+	m_Modules.push_back(std::move(module));
+}
+
+bool Linker::Link()
+{
+	m_Bytecode.clear();
+	if(m_Modules.empty())
+	{
+		std::cerr << "[LINK] No objects to link" << std::endl;
+		return false;
+	}
+
+	//The first module's jump to the end of the program is a JMP_I
+	static const uint32 EndJumpSize = 1 + sizeof(uint32);
+	uint32 codeSize = 0;
+	for(size_t i = 0; i < m_Modules.size(); ++i)
+	{
+		m_Modules[i].codeBase = m_StackSize + codeSize;
+		codeSize += static_cast<uint32>(m_Modules[i].object.code.size());
+		if(i == 0 && m_Modules.size() > 1) codeSize += EndJumpSize;
+	}
+	uint32 staticSize = 0;
+	for(auto &module : m_Modules)
+	{
+		module.staticBase = AlignWord(m_StackSize + codeSize) + staticSize;
+		staticSize += module.object.staticSize;
+	}
+
+	std::unordered_map<std::string, std::pair<uint32, const Module*>> functions;
+	for(const auto &module : m_Modules)
+	{
+		for(const auto &exported : module.object.exports)
+		{
+			auto added = functions.emplace(exported.first, std::make_pair(module.codeBase + exported.second, &module));
+			if(!added.second)
+			{
+				std::cerr << "[LINK] Function " << exported.first << " is defined in " << added.first->second.second->name << " and " << module.name << std::endl;
+				return false;
+			}
+		}
+	}
+
+	WriteWord(m_Bytecode, WORD_FORMAT_VERSION);
+	WriteWord(m_Bytecode, GetSuperinstructionSetId());
+	WriteWord(m_Bytecode, m_StackSize);
+	WriteWord(m_Bytecode, staticSize);
+	WriteWord(m_Bytecode, m_HeapSize);
+
+	bool linked = true;
+	for(size_t i = 0; i < m_Modules.size(); ++i)
+	{
+		const Module &module = m_Modules[i];
+		size_t start = m_Bytecode.size();
+		m_Bytecode.insert(m_Bytecode.end(), module.object.code.begin(), module.object.code.end());
+		for(const auto &relocation : module.object.relocations)
+		{
+			uint8* word = &m_Bytecode[start + relocation.offset];
+			uint32 value = LoadWord(word);
+			switch(relocation.kind)
+			{
+			case RelocationKind::CODE:
+				value += module.codeBase;
+				break;
+			case RelocationKind::STATIC:
+				value += module.staticBase;
+				break;
+			case RelocationKind::IMPORT:
+			{
+				auto found = value < module.object.imports.size() ? functions.find(module.object.imports[value]) : functions.end();
+				if(found == functions.end())
+				{
+					std::cerr << "[LINK] " << module.name << ": unresolved function " << (value < module.object.imports.size() ? module.object.imports[value] : std::to_string(value)) << std::endl;
+					linked = false;
+					break;
+				}
+				value = found->second.first;
+				break;
+			}
+			}
+			StoreWord(word, value);
+		}
+		if(i == 0 && m_Modules.size() > 1)
+		{
+			m_Bytecode.push_back(static_cast<uint8>(Opcode::JMP_I));
+			WriteWord(m_Bytecode, m_StackSize + codeSize);
+		}
+	}
+	if(!linked) m_Bytecode.clear();
+	return linked;
+}
+
+bool Linker::Save(const std::string &filename) const
+{
+	if(m_Bytecode.empty())
+	{
+		std::cerr << "[LINK] File not saved, nothing linked" << std::endl;
+		return false;
+	}
+	std::ofstream output(filename, std::ios::binary);
+	output.write(reinterpret_cast<const char*>(m_Bytecode.data()), static_cast<std::streamsize>(m_Bytecode.size()));
+	if(!output.good())
+	{
+		std::cerr << "[LINK] File not saved, writing " << filename << " failed" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "AssemblyCompiler.h"
+#include "ObjectFile.h"
+
+//Merges object files into one executable with the same header AssemblyCompiler writes. Modules are laid out in the
+//order they are added, their code first and their statics after all code. Only the first module's top level code
+//runs: when other modules follow it, it ends with a jump past them to the end of the program
+class Linker
+{
+public:
+	void SetHeapSize(uint32 heapSize) { m_HeapSize = heapSize; }
+
+	//name identifies the module in error messages
+	void AddObject(ObjectFile object, const std::string &name);
+	//Places the modules, resolves imports against the exported functions and relocates every address
+	bool Link();
+
+	const std::vector<uint8>& GetBytecode() const { return m_Bytecode; }
+	bool Save(const std::string &filename) const;
+
+private:
+	struct Module
+	{
+		std::string name;
+		ObjectFile object;
+		uint32 codeBase = 0;		//Address of the module's code
+		uint32 staticBase = 0;		//Address of the module's statics
+	};
+	std::vector<Module> m_Modules;
+	std::vector<uint8> m_Bytecode;
+
+	uint32 m_StackSize = AssemblyCompiler::DEFAULT_STACK_SIZE;
+	uint32 m_HeapSize = AssemblyCompiler::DEFAULT_HEAP_SIZE;
+};
@@ -0,0 +1,61 @@
+#include "MappedFile.h"
+
+#include <fstream>
+
+#ifndef PLATFORM_Win
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const std::string &filename)
+{
+	Close();
+#ifndef PLATFORM_Win
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	struct stat info;
+	if(fstat(fd, &info) == 0 && info.st_size > 0)
+	{
+		void* pMap = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if(pMap != MAP_FAILED)
+		{
+			close(fd);
+			m_pData = static_cast<const uint8*>(pMap);
+			m_Size = static_cast<size_t>(info.st_size);
+			m_Mapped = true;
+			return true;
+		}
+	}
+	close(fd);
+#endif
+	//Empty files and platforms without mmap
+	std::ifstream file(filename, std::ios::binary | std::ios::ate);
+	if(!file.good()) return false;
+	std::streamoff fileSize = file.tellg();
+	if(fileSize < 0) return false;
+	m_Buffer.resize(static_cast<size_t>(fileSize));
+	file.seekg(0, std::ios::beg);
+	file.read(reinterpret_cast<char*>(m_Buffer.data()), fileSize);
+	if(!file) return false;
+	m_pData = m_Buffer.data();
+	m_Size = m_Buffer.size();
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifndef PLATFORM_Win
+	if(m_Mapped) munmap(const_cast<uint8*>(m_pData), m_Size);
+#endif
+	m_Mapped = false;
+	m_pData = nullptr;
+	m_Size = 0;
+	m_Buffer.clear();
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+
+//Read only view of a whole file. Memory maps it where the platform supports it,
+//otherwise reads it with one bulk read
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string &filename);
+	void Close();
+
+	const uint8* GetData() const { return m_pData; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8* m_pData = nullptr;
+	size_t m_Size = 0;
+	bool m_Mapped = false;
+	std::vector<uint8> m_Buffer;	//Contents when the file couldn't be mapped
+};
@@ -0,0 +1,140 @@
+#include "ObjectFile.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "MappedFile.h"
+#include "Opcode.h"
+#include "WordFormat.h"
+
+static void WriteWord(std::vector<uint8> &target, uint32 value)
+{
+	uint8 word[sizeof(uint32)];
+	StoreWord(word, value);
+	target.insert(target.end(), word, word + sizeof(uint32));
+}
+
+static void WriteName(std::vector<uint8> &target, const std::string &name)
+{
+	WriteWord(target, static_cast<uint32>(name.size()));
+	target.insert(target.end(), name.begin(), name.end());
+}
+
+bool ObjectFile::Save(const std::string &filename) const
+{
+	std::vector<uint8> data;
+	WriteWord(data, OBJECT_FORMAT_VERSION);
+	WriteWord(data, WORD_FORMAT_VERSION);
+	WriteWord(data, GetSuperinstructionSetId());
+	WriteWord(data, static_cast<uint32>(code.size()));
+	WriteWord(data, staticSize);
+	WriteWord(data, static_cast<uint32>(exports.size()));
+	WriteWord(data, static_cast<uint32>(imports.size()));
+	WriteWord(data, static_cast<uint32>(relocations.size()));
+
+	data.insert(data.end(), code.begin(), code.end());
+	for(const auto &exported : exports)
+	{
+		WriteName(data, exported.first);
+		WriteWord(data, exported.second);
+	}
+	for(const auto &imported : imports) WriteName(data, imported);
+	for(const auto &relocation : relocations)
+	{
+		WriteWord(data, relocation.offset);
+		WriteWord(data, static_cast<uint32>(relocation.kind));
+	}
+
+	std::ofstream output(filename, std::ios::binary);
+	output.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	if(!output.good())
+	{
+		std::cerr << "[LINK] Could not write object file " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool ObjectFile::Load(const std::string &filename)
+{
+	MappedFile file;
+	if(!file.Open(filename))
+	{
+		std::cerr << "[LINK] Could not open object file " << filename << std::endl;
+		return false;
+	}
+	const uint8* data = file.GetData();
+	size_t size = file.GetSize();
+	size_t position = 0;
+	auto readWord = [&](uint32 &value)
+	{
+		if(size - position < sizeof(uint32)) return false;
+		value = LoadWord(data + position);
+		position += sizeof(uint32);
+		return true;
+	};
+	auto readName = [&](std::string &name)
+	{
+		uint32 length = 0;
+		if(!readWord(length) || size - position < length) return false;
+		name.assign(reinterpret_cast<const char*>(data + position), length);
+		position += length;
+		return true;
+	};
+
+	uint32 header[OBJECT_HEADER_WORD_COUNT];
+	for(uint32 &word : header)
+	{
+		if(!readWord(word))
+		{
+			std::cerr << "[LINK] " << filename << " is too small to hold an object header" << std::endl;
+			return false;
+		}
+	}
+	if(header[OBJECT_VERSION] != OBJECT_FORMAT_VERSION || header[OBJECT_WORD_FORMAT] != WORD_FORMAT_VERSION)
+	{
+		std::cerr << "[LINK] " << filename << " has an unsupported object format, reassemble it" << std::endl;
+		return false;
+	}
+	if(header[OBJECT_SUPERINSTRUCTIONS] != GetSuperinstructionSetId())
+	{
+		std::cerr << "[LINK] " << filename << " was assembled for a different superinstruction set, reassemble it" << std::endl;
+		return false;
+	}
+
+	bool valid = size - position >= header[OBJECT_CODE_SIZE];
+	if(valid)
+	{
+		code.assign(data + position, data + position + header[OBJECT_CODE_SIZE]);
+		position += header[OBJECT_CODE_SIZE];
+	}
+	staticSize = header[OBJECT_STATIC_SIZE];
+	exports.clear();
+	imports.clear();
+	relocations.clear();
+	for(uint32 i = 0; valid && i < header[OBJECT_EXPORT_COUNT]; ++i)
+	{
+		std::pair<std::string, uint32> exported;
+		valid = readName(exported.first) && readWord(exported.second) && exported.second < code.size();
+		exports.push_back(exported);
+	}
+	for(uint32 i = 0; valid && i < header[OBJECT_IMPORT_COUNT]; ++i)
+	{
+		std::string imported;
+		valid = readName(imported);
+		imports.push_back(imported);
+	}
+	for(uint32 i = 0; valid && i < header[OBJECT_RELOCATION_COUNT]; ++i)
+	{
+		uint32 offset = 0;
+		uint32 kind = 0;
+		valid = readWord(offset) && readWord(kind) && kind <= static_cast<uint32>(RelocationKind::IMPORT) && code.size() >= sizeof(uint32) && offset <= code.size() - sizeof(uint32);
+		relocations.push_back(Relocation{offset, static_cast<RelocationKind>(kind)});
+	}
+	if(!valid || position != size)
+	{
+		std::cerr << "[LINK] " << filename << " is not a valid object file" << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AtomicTypes.h"
+
+//Bump OBJECT_FORMAT_VERSION whenever the layout of object files changes
+static const uint32 OBJECT_FORMAT_VERSION = 1;
+
+//Object file header, one word per field. It is followed by the code, the exports (name length, name, code offset),
+//the imports (name length, name) and the relocations (offset, kind)
+enum ObjectHeaderWord : uint32
+{
+	OBJECT_VERSION,				//OBJECT_FORMAT_VERSION the object was written with
+	OBJECT_WORD_FORMAT,			//WORD_FORMAT_VERSION of the code
+	OBJECT_SUPERINSTRUCTIONS,	//Id of the superinstruction set the assembler fused with
+	OBJECT_CODE_SIZE,
+	OBJECT_STATIC_SIZE,
+	OBJECT_EXPORT_COUNT,
+	OBJECT_IMPORT_COUNT,
+	OBJECT_RELOCATION_COUNT,
+
+	OBJECT_HEADER_WORD_COUNT
+};
+
+enum class RelocationKind : uint8
+{
+	CODE,	//The operand is a code offset in the module
+	STATIC,	//The operand is an offset into the module's statics
+	IMPORT	//The operand is the index of an imported function
+};
+
+struct Relocation
+{
+	uint32 offset;	//Of the operand word in the module's code
+	RelocationKind kind;
+};
+
+//One module assembled by AssemblyCompiler in relocatable mode. Its code and statics are addressed from 0 until the
+//Linker places it in an executable. Functions are exported, statics and labels are private to the module
+struct ObjectFile
+{
+	std::vector<uint8> code;
+	uint32 staticSize = 0;
+	std::vector<std::pair<std::string, uint32>> exports;	//Function name and code offset
+	std::vector<std::string> imports;						//Functions the module calls but doesn't define
+	std::vector<Relocation> relocations;
+
+	bool Save(const std::string &filename) const;
+	//Fails for objects of another format version or superinstruction set, they have to be reassembled
+	bool Load(const std::string &filename);
+};
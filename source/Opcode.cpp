@@ -1,15 +1,139 @@
 #include "Opcode.h"
 
-std::string GetOpString(Opcode code)
-{
-    std::string key = "invalid code";
-    for (auto &i : OpcodeNames) 
-    {
-        if (i.second == code) 
-        {
-            key = i.first;
-            break; // to stop searching
-        }
-    }
-	return key;
+#include <vector>
+
+const std::string& GetOpString(Opcode code)
+{
+	//Built once from OpcodeNames, indexed by opcode
+	static const std::vector<std::string> s_Names = []()
+	{
+		std::vector<std::string> names(256, "invalid code");
+		for(auto &i : OpcodeNames) names[static_cast<uint8>(i.second)] = i.first;
+		return names;
+	}();
+	return s_Names[static_cast<uint8>(code)];
+}
+
+bool HasIntOperand(Opcode code)
+{
+	switch(code)
+	{
+	case Opcode::LITERAL:
+	case Opcode::LOAD_I:
+	case Opcode::STORE_I:
+	case Opcode::LOAD_LCL_I:
+	case Opcode::STORE_LCL_I:
+	case Opcode::LOAD_ARG_I:
+	case Opcode::JMP_I:
+	case Opcode::JMP_IF_I:
+	case Opcode::CALL_I:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool GetImmediateForm(Opcode code, Opcode &immediateForm)
+{
+	switch(code)
+	{
+	case Opcode::LOAD: immediateForm = Opcode::LOAD_I; return true;
+	case Opcode::STORE: immediateForm = Opcode::STORE_I; return true;
+	case Opcode::LOAD_LCL: immediateForm = Opcode::LOAD_LCL_I; return true;
+	case Opcode::STORE_LCL: immediateForm = Opcode::STORE_LCL_I; return true;
+	case Opcode::LOAD_ARG: immediateForm = Opcode::LOAD_ARG_I; return true;
+	case Opcode::JMP: immediateForm = Opcode::JMP_I; return true;
+	case Opcode::JMP_IF: immediateForm = Opcode::JMP_IF_I; return true;
+	case Opcode::CALL: immediateForm = Opcode::CALL_I; return true;
+	default:
+		return false;
+	}
+}
+
+static const Superinstruction s_Superinstructions[] =
+{
+#define SUPERINSTRUCTION2(name, a, b) {Opcode::name, 2, {Opcode::a, Opcode::b, Opcode::INVALID}},
+#define SUPERINSTRUCTION3(name, a, b, c) {Opcode::name, 3, {Opcode::a, Opcode::b, Opcode::c}},
+#include "Superinstructions.inl"
+#undef SUPERINSTRUCTION2
+#undef SUPERINSTRUCTION3
+	{Opcode::INVALID, 0, {Opcode::INVALID, Opcode::INVALID, Opcode::INVALID}} //Keeps the table valid when no superinstructions are generated
+};
+static const uint32 s_FirstSuperinstruction = static_cast<uint32>(Opcode::FRAME) + 1;
+static const uint32 s_NumSuperinstructions = sizeof(s_Superinstructions)/sizeof(s_Superinstructions[0]) - 1;
+
+const Superinstruction* GetSuperinstruction(Opcode code)
+{
+	uint32 index = static_cast<uint32>(code) - s_FirstSuperinstruction;
+	if(index < s_NumSuperinstructions) return &s_Superinstructions[index];
+	return nullptr;
+}
+
+bool FindSuperinstruction(const Opcode* sequence, uint32 length, Opcode &fused)
+{
+	for(uint32 i = 0; i < s_NumSuperinstructions; ++i)
+	{
+		const Superinstruction &super = s_Superinstructions[i];
+		if(super.length != length) continue;
+
+		bool match = true;
+		for(uint32 part = 0; part < length && match; ++part)
+		{
+			match = super.parts[part] == sequence[part];
+		}
+		if(match)
+		{
+			fused = super.code;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool IsFusable(Opcode code, bool last)
+{
+	switch(code)
+	{
+	case Opcode::LITERAL:
+	case Opcode::LOAD:
+	case Opcode::STORE:
+	case Opcode::LOAD_LCL:
+	case Opcode::STORE_LCL:
+	case Opcode::LOAD_ARG:
+	case Opcode::LOAD_I:
+	case Opcode::STORE_I:
+	case Opcode::LOAD_LCL_I:
+	case Opcode::STORE_LCL_I:
+	case Opcode::LOAD_ARG_I:
+	case Opcode::ADD:
+	case Opcode::SUB:
+	case Opcode::LESS:
+	case Opcode::GREATER:
+	case Opcode::NOT:
+	case Opcode::EQUALS:
+		return true;
+	case Opcode::JMP_I:
+	case Opcode::JMP_IF_I:
+		return last;
+	default:
+		return false;
+	}
+}
+
+uint32 GetSuperinstructionSetId()
+{
+	static const char s_Names[] = ""
+#define SUPERINSTRUCTION2(name, a, b) #name " "
+#define SUPERINSTRUCTION3(name, a, b, c) #name " "
+#include "Superinstructions.inl"
+#undef SUPERINSTRUCTION2
+#undef SUPERINSTRUCTION3
+		;
+	//FNV-1a
+	uint32 hash = 2166136261u;
+	for(const char* c = s_Names; *c; ++c)
+	{
+		hash = (hash ^ static_cast<uint8>(*c)) * 16777619u;
+	}
+	return hash;
 }
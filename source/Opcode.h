@@ -3,7 +3,9 @@
 #include <map>
 #include <string>
 
-enum class Opcode : char
+#include "AtomicTypes.h"
+
+enum class Opcode : uint8
 {
 	//Memory Manipulation
     LITERAL,
@@ -14,6 +16,13 @@ enum class Opcode : char
     LOAD_LCL,
     STORE_LCL,
     LOAD_ARG,
+
+	//Immediate address forms, the address is in the next 4 bytes instead of on the stack
+    LOAD_I,
+    STORE_I,
+    LOAD_LCL_I,
+    STORE_LCL_I,
+    LOAD_ARG_I,
 	
 	ALLOC,
 	FREE,
@@ -30,14 +39,35 @@ enum class Opcode : char
 	//Flow Control
     JMP,
     JMP_IF,
+    JMP_I,
+    JMP_IF_I,
 
 	CALL,
+	CALL_I,
 	RETURN,
 
     PRINT,
     PRINT_INT,
-    PRINT_ENDL
+    PRINT_ENDL,
+    FLUSH,
+
+	//Function prologue, emitted for $function declarations: int32 argument size, int32 local size
+	FRAME,
+
+	//Superinstructions, generated from an execution profile by SuperinstructionGen
+#define SUPERINSTRUCTION2(name, a, b) name,
+#define SUPERINSTRUCTION3(name, a, b, c) name,
+#include "Superinstructions.inl"
+#undef SUPERINSTRUCTION2
+#undef SUPERINSTRUCTION3
+
+	//Not part of the instruction set, only produced by the VM's instruction decoder
+	HALT,
+	INVALID
 };
+//Number of opcodes that can be encoded in bytecode
+static const uint8 OPCODE_COUNT = static_cast<uint8>(Opcode::HALT);
+
 static std::map<std::string, Opcode> OpcodeNames
 {
     {"LITERAL", Opcode::LITERAL},
@@ -49,6 +79,12 @@ static std::map<std::string, Opcode> OpcodeNames
     {"STORE_LCL", Opcode::STORE_LCL},
     {"LOAD_ARG", Opcode::LOAD_ARG},
 
+    {"LOAD_I", Opcode::LOAD_I},
+    {"STORE_I", Opcode::STORE_I},
+    {"LOAD_LCL_I", Opcode::LOAD_LCL_I},
+    {"STORE_LCL_I", Opcode::STORE_LCL_I},
+    {"LOAD_ARG_I", Opcode::LOAD_ARG_I},
+
     {"ALLOC", Opcode::ALLOC},
     {"FREE", Opcode::FREE},
 
@@ -62,12 +98,45 @@ static std::map<std::string, Opcode> OpcodeNames
 
     {"JMP", Opcode::JMP},
     {"JMP_IF", Opcode::JMP_IF},
+    {"JMP_I", Opcode::JMP_I},
+    {"JMP_IF_I", Opcode::JMP_IF_I},
 
     {"CALL", Opcode::CALL},
+    {"CALL_I", Opcode::CALL_I},
     {"RETURN", Opcode::RETURN},
     
     {"PRINT", Opcode::PRINT},
     {"PRINT_INT", Opcode::PRINT_INT},
-    {"PRINT_ENDL", Opcode::PRINT_ENDL}
+    {"PRINT_ENDL", Opcode::PRINT_ENDL},
+    {"FLUSH", Opcode::FLUSH},
+
+#define SUPERINSTRUCTION2(name, a, b) {#name, Opcode::name},
+#define SUPERINSTRUCTION3(name, a, b, c) {#name, Opcode::name},
+#include "Superinstructions.inl"
+#undef SUPERINSTRUCTION2
+#undef SUPERINSTRUCTION3
+};
+const std::string& GetOpString(Opcode code);
+
+//True for opcodes followed by a single int32 operand (LITERAL and the immediate address forms)
+bool HasIntOperand(Opcode code);
+//Immediate address form of an opcode that pops its address from the stack, returns false if there is none
+bool GetImmediateForm(Opcode code, Opcode &immediateForm);
+
+//A superinstruction executes a fixed run of opcodes with a single dispatch,
+//its operands are those of its parts in order
+static const uint32 MAX_SUPERINSTRUCTION_LENGTH = 3;
+struct Superinstruction
+{
+	Opcode code;
+	uint32 length;
+	Opcode parts[MAX_SUPERINSTRUCTION_LENGTH];
 };
-std::string GetOpString(Opcode code);
+//Returns nullptr if code is not a superinstruction
+const Superinstruction* GetSuperinstruction(Opcode code);
+//Superinstruction that executes exactly this sequence, returns false if there is none
+bool FindSuperinstruction(const Opcode* sequence, uint32 length, Opcode &fused);
+//True if code can be part of a superinstruction, branches can only be its last part
+bool IsFusable(Opcode code, bool last);
+//Hash of the superinstruction set this build was generated with, executables store it in their header
+uint32 GetSuperinstructionSetId();
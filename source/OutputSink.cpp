@@ -0,0 +1,68 @@
+#include "OutputSink.h"
+
+#include <iostream>
+
+void OutputSink::WriteInt(int32 value)
+{
+	char digits[12];
+	char* end = digits + sizeof(digits);
+	char* start = end;
+	//Work on the magnitude as unsigned so the minimum int32 doesn't overflow
+	uint32 magnitude = value < 0 ? 0u - static_cast<uint32>(value) : static_cast<uint32>(value);
+	do
+	{
+		*--start = static_cast<char>('0' + magnitude % 10);
+		magnitude /= 10;
+	} while(magnitude != 0);
+	if(value < 0) *--start = '-';
+	Write(start, static_cast<size_t>(end - start));
+}
+
+void OutputSink::Flush()
+{
+	if(m_Used == 0) return;
+	size_t used = m_Used;
+	m_Used = 0;
+	Emit(m_Buffer.data(), used);
+}
+
+StdoutSink::~StdoutSink()
+{
+	Flush();
+}
+
+void StdoutSink::Emit(const char* data, size_t size)
+{
+	std::cout.write(data, static_cast<std::streamsize>(size));
+	std::cout.flush();
+}
+
+FileSink::~FileSink()
+{
+	Close();
+}
+
+bool FileSink::Open(const std::string &filename)
+{
+	Close();
+	m_pFile = std::fopen(filename.c_str(), "wb");
+	if(m_pFile == nullptr)
+	{
+		std::cerr << "[VM] Could not open output file " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void FileSink::Close()
+{
+	if(m_pFile == nullptr) return;
+	Flush();
+	std::fclose(m_pFile);
+	m_pFile = nullptr;
+}
+
+void FileSink::Emit(const char* data, size_t size)
+{
+	if(m_pFile) std::fwrite(data, 1, size, m_pFile);
+}
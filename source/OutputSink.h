@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+
+//Buffered destination for program output. Writes collect in a buffer that is handed to Emit when it is full,
+//on Flush (FLUSH opcode, end of the program) and on destruction. A capacity of 0 writes straight through
+class OutputSink
+{
+public:
+	static const size_t DEFAULT_CAPACITY = 65536;
+
+	explicit OutputSink(size_t capacity = DEFAULT_CAPACITY) : m_Buffer(capacity) {}
+	virtual ~OutputSink() {}	//Derived sinks flush in their destructor, Emit is gone by the time this runs
+	OutputSink(const OutputSink&) = delete;
+	OutputSink& operator=(const OutputSink&) = delete;
+
+	inline void Write(const char* data, size_t size);
+	inline void Put(char c);
+	void WriteInt(int32 value);
+	void Flush();
+
+protected:
+	virtual void Emit(const char* data, size_t size) = 0;
+
+private:
+	std::vector<char> m_Buffer;
+	size_t m_Used = 0;
+};
+
+void OutputSink::Write(const char* data, size_t size)
+{
+	if(m_Used + size > m_Buffer.size())
+	{
+		Flush();
+		if(size >= m_Buffer.size())
+		{
+			Emit(data, size);
+			return;
+		}
+	}
+	std::memcpy(m_Buffer.data() + m_Used, data, size);
+	m_Used += size;
+}
+
+void OutputSink::Put(char c)
+{
+	if(m_Used == m_Buffer.size())
+	{
+		Flush();
+		if(m_Buffer.empty())
+		{
+			Emit(&c, 1);
+			return;
+		}
+	}
+	m_Buffer[m_Used++] = c;
+}
+
+//Writes to the process's standard output through std::cout, so it stays ordered with other console output once flushed
+class StdoutSink : public OutputSink
+{
+public:
+	explicit StdoutSink(size_t capacity = DEFAULT_CAPACITY) : OutputSink(capacity) {}
+	~StdoutSink() override;
+
+protected:
+	void Emit(const char* data, size_t size) override;
+};
+
+class FileSink : public OutputSink
+{
+public:
+	explicit FileSink(size_t capacity = DEFAULT_CAPACITY) : OutputSink(capacity) {}
+	~FileSink() override;
+
+	bool Open(const std::string &filename);
+	void Close();
+
+protected:
+	void Emit(const char* data, size_t size) override;
+
+private:
+	std::FILE* m_pFile = nullptr;
+};
+
+//Collects the output for an embedding host
+class MemorySink : public OutputSink
+{
+public:
+	explicit MemorySink(size_t capacity = DEFAULT_CAPACITY) : OutputSink(capacity) {}
+
+	const std::string& GetContents() { Flush(); return m_Contents; }
+	void Clear() { Flush(); m_Contents.clear(); }
+
+protected:
+	void Emit(const char* data, size_t size) override { m_Contents.append(data, size); }
+
+private:
+	std::string m_Contents;
+};
+
+//Discards the output, for timing programs without the cost of the destination
+class NullSink : public OutputSink
+{
+public:
+	explicit NullSink(size_t capacity = DEFAULT_CAPACITY) : OutputSink(capacity) {}
+
+protected:
+	void Emit(const char*, size_t) override {}
+};
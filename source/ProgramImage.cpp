@@ -0,0 +1,317 @@
+#include "ProgramImage.h"
+
+#include <iostream>
+#include <limits>
+
+#include "WordFormat.h"
+#include "MappedFile.h"
+#include "HeapAllocator.h"
+#include "RegisterCode.h"
+
+ProgramImage::ProgramImage()
+{
+}
+
+ProgramImage::~ProgramImage()
+{
+}
+
+bool ProgramImage::Load(const std::string &filename)
+{
+	MappedFile file;
+	if(!file.Open(filename))
+	{
+		std::cerr << "[VM] Could not open bytecode executable" << std::endl;
+		return false;
+	}
+	return SetBytecode(file.GetData(), file.GetSize());
+}
+
+bool ProgramImage::SetBytecode(const uint8* bytecode, size_t size)
+{
+	m_Loaded = false;
+	uint32 headerSize = HEADER_WORD_COUNT * sizeof(uint32);
+	if(size < headerSize)
+	{
+		std::cerr << "[VM] Bytecode is too small to hold an executable header" << std::endl;
+		return false;
+	}
+	auto header = [bytecode](HeaderWord word) { return LoadWord(bytecode + word * sizeof(uint32)); };
+	if(header(HEADER_VERSION) != WORD_FORMAT_VERSION)
+	{
+		std::cerr << "[VM] Executable format version " << header(HEADER_VERSION) << " is not supported, expected " << WORD_FORMAT_VERSION << std::endl;
+		return false;
+	}
+	if(header(HEADER_SUPERINSTRUCTIONS) != GetSuperinstructionSetId())
+	{
+		std::cerr << "[VM] Executable was compiled for a different superinstruction set, recompile it" << std::endl;
+		return false;
+	}
+	m_StackSize = header(HEADER_STACK_SIZE);
+	uint32 numStaticVars = header(HEADER_STATIC_SIZE);
+	if(m_StackSize % sizeof(uint32) != 0)
+	{
+		std::cerr << "[VM] Stack size " << m_StackSize << " is not word aligned" << std::endl;
+		return false;
+	}
+	m_HeapSize = header(HEADER_HEAP_SIZE);
+
+	if(size - headerSize > std::numeric_limits<uint32>::max())
+	{
+		std::cerr << "[VM] Code segment is too large for 32 bit addresses" << std::endl;
+		return false;
+	}
+	uint32 codeSize = static_cast<uint32>(size - headerSize);
+	uint64 heapBase = static_cast<uint64>(AlignWord(codeSize + m_StackSize)) + AlignWord(numStaticVars);
+	if(heapBase + HeapAllocator::META_WORD_COUNT * sizeof(uint32) > static_cast<uint64>(std::numeric_limits<uint32>::max()))
+	{
+		std::cerr << "[VM] Program needs " << heapBase << " bytes of RAM before the heap, more than 32 bit addresses can reach" << std::endl;
+		return false;
+	}
+	m_StaticBase = AlignWord(codeSize + m_StackSize);
+	m_HeapBase = static_cast<uint32>(heapBase);
+	m_CodeSegment.assign(bytecode + headerSize, bytecode + size);
+
+	Decode();
+#ifdef VM_THREADED_DISPATCH
+	{
+		std::lock_guard<std::mutex> lock(m_BindMutex);
+		m_BoundCode.clear();
+	}
+#endif
+	{
+		std::lock_guard<std::mutex> lock(m_RegisterMutex);
+		m_pRegisterCode.reset();
+	}
+#ifdef VM_JIT
+	{
+		std::lock_guard<std::mutex> lock(m_JitMutex);
+		m_JitFunctions.clear();
+	}
+#endif
+	m_Loaded = true;
+	return true;
+}
+
+void ProgramImage::Decode()
+{
+	uint32 codeSize = GetCodeSize();
+	auto operand = [this](uint32 offset) { return static_cast<int32>(LoadWord(m_CodeSegment.data() + offset)); };
+
+	m_Code.clear();
+	m_Code.reserve(codeSize + 2);
+	m_Translation.assign(codeSize + 1, 0);
+
+	//Entry 0 traps jumps to addresses that are not the start of an instruction
+	Instruction trap;
+	trap.operation = Opcode::INVALID;
+	m_Code.push_back(trap);
+
+	uint32 offset = 0;
+	while(offset < codeSize)
+	{
+		//A superinstruction decodes into one entry per part, each holding the operand of that part.
+		//Only the first one is reachable through the translation table, it dispatches the fused handler
+		Instruction parts[MAX_SUPERINSTRUCTION_LENGTH];
+		uint32 numParts = 1;
+
+		uint32 address = m_StackSize + offset;
+		auto operation = static_cast<Opcode>(m_CodeSegment[offset]);
+		Instruction &instruction = parts[0];
+		instruction.operation = operation;
+
+		uint32 size = 1;
+		switch(operation)
+		{
+		case Opcode::LITERAL_ARRAY:
+			size += sizeof(int32);
+			if(offset + size > codeSize) break;
+			instruction.immediate = operand(offset + 1);
+			instruction.target = offset + size;
+			//A negative or oversized count would wrap size, the elements must fit in the rest of the code
+			if(instruction.immediate < 0 || static_cast<uint32>(instruction.immediate) > (codeSize - offset - size) / sizeof(int32))
+			{
+				instruction.operation = Opcode::INVALID;
+				size = codeSize - offset;
+				break;
+			}
+			size += static_cast<uint32>(instruction.immediate) * sizeof(int32);
+			break;
+		case Opcode::FRAME:
+			size += sizeof(int32) * 2;
+			if(offset + size > codeSize) break;
+			instruction.immediate = operand(offset + 1);
+			instruction.target = static_cast<uint32>(operand(offset + 1 + sizeof(int32)));
+			break;
+		default:
+		{
+			if(static_cast<uint8>(operation) >= OPCODE_COUNT)
+			{
+				instruction.operation = Opcode::INVALID;
+				break;
+			}
+			const Superinstruction* fused = GetSuperinstruction(operation);
+			if(fused)
+			{
+				numParts = fused->length;
+				for(uint32 part = 0; part < numParts; ++part) parts[part].operation = fused->parts[part];
+			}
+			for(uint32 part = 0; part < numParts; ++part)
+			{
+				if(!HasIntOperand(parts[part].operation)) continue;
+				if(offset + size + sizeof(int32) <= codeSize) parts[part].immediate = operand(offset + size);
+				size += sizeof(int32);
+			}
+			instruction.operation = operation;
+		}
+			break;
+		}
+		if(offset + size > codeSize)
+		{
+			//Operands run past the end of the code segment
+			instruction.operation = Opcode::INVALID;
+			numParts = 1;
+			size = codeSize - offset;
+		}
+
+		m_Translation[offset] = static_cast<uint32>(m_Code.size());
+		for(uint32 part = 0; part < numParts; ++part)
+		{
+			parts[part].address = address;
+			m_Code.push_back(parts[part]);
+		}
+		offset += size;
+	}
+
+	//Falling off the end of the code segment ends the program
+	Instruction halt;
+	halt.operation = Opcode::HALT;
+	halt.address = m_StaticBase;
+	m_HaltIndex = static_cast<uint32>(m_Code.size());
+	m_Translation[codeSize] = m_HaltIndex;
+	m_Code.push_back(halt);
+
+	//Immediate jumps and calls go straight to their decoded target
+	for(auto &instruction : m_Code)
+	{
+		switch(instruction.operation)
+		{
+		case Opcode::JMP_I:
+		case Opcode::JMP_IF_I:
+		case Opcode::CALL_I:
+			instruction.target = Resolve(static_cast<uint32>(instruction.immediate));
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+const ProgramImage::Instruction* ProgramImage::GetCode(const void* const* dispatchTable) const
+{
+#ifdef VM_THREADED_DISPATCH
+	std::lock_guard<std::mutex> lock(m_BindMutex);
+	for(const BoundCode &bound : m_BoundCode)
+	{
+		if(bound.dispatchTable == dispatchTable) return bound.code.data();
+	}
+	BoundCode bound;
+	bound.dispatchTable = dispatchTable;
+	bound.code = m_Code;
+	for(auto &instruction : bound.code)
+	{
+		instruction.handler = dispatchTable[static_cast<uint8>(instruction.operation)];
+	}
+	m_BoundCode.push_back(std::move(bound));
+	return m_BoundCode.back().code.data();
+#else
+	(void)dispatchTable;
+	return m_Code.data();
+#endif
+}
+
+uint32 ProgramImage::GetFunctionBegin(uint32 index) const
+{
+	//Code before the first FRAME starts after the trap entry
+	while(index > 1 && m_Code[index - 1].operation != Opcode::FRAME) --index;
+	return index;
+}
+
+uint32 ProgramImage::GetInstructionLength(uint32 index) const
+{
+	const Superinstruction* fused = GetSuperinstruction(m_Code[index].operation);
+	return fused ? fused->length : 1;
+}
+
+Opcode ProgramImage::GetPart(uint32 index, uint32 part) const
+{
+	Opcode code = m_Code[index].operation;
+	const Superinstruction* fused = GetSuperinstruction(code);
+	return fused ? fused->parts[part] : code;
+}
+
+void ProgramImage::FindBlockEntries(std::set<uint32> &direct, std::set<uint32> &computed) const
+{
+	bool computedCalls = false;
+	for(uint32 index = 1; index < m_HaltIndex; index += GetInstructionLength(index))
+	{
+		for(uint32 part = 0; part < GetInstructionLength(index); ++part)
+		{
+			const Instruction &instruction = m_Code[index + part];
+			switch(GetPart(index, part))
+			{
+			case Opcode::JMP_I:
+			case Opcode::JMP_IF_I:
+				direct.insert(instruction.target);
+				break;
+			case Opcode::CALL_I:
+				computed.insert(Resolve(instruction.address + 1 + sizeof(int32)));
+				if(m_Code[instruction.target].operation == Opcode::FRAME) direct.insert(instruction.target + 1);
+				break;
+			case Opcode::CALL:
+				computedCalls = true;
+				computed.insert(Resolve(instruction.address + 1));
+				break;
+			case Opcode::LITERAL:
+			{
+				uint32 address = static_cast<uint32>(instruction.immediate);
+				if(address - m_StackSize < GetCodeSize() && Resolve(address) != 0) computed.insert(Resolve(address));
+			}
+				break;
+			default:
+				break;
+			}
+		}
+	}
+	//A computed call can enter any function
+	if(!computedCalls) return;
+	for(uint32 index = 1; index < m_HaltIndex; index += GetInstructionLength(index))
+	{
+		if(m_Code[index].operation == Opcode::FRAME) direct.insert(index + 1);
+	}
+}
+
+const RegisterCode& ProgramImage::GetRegisterCode() const
+{
+	std::lock_guard<std::mutex> lock(m_RegisterMutex);
+	if(!m_pRegisterCode)
+	{
+		m_pRegisterCode.reset(new RegisterCode());
+		m_pRegisterCode->Build(*this);
+	}
+	return *m_pRegisterCode;
+}
+
+#ifdef VM_JIT
+const JitFunction* ProgramImage::GetJitFunction(uint32 index) const
+{
+	uint32 begin = GetFunctionBegin(index);
+	std::lock_guard<std::mutex> lock(m_JitMutex);
+	for(const auto &function : m_JitFunctions)
+	{
+		if(function.first == begin) return function.second.get();
+	}
+	m_JitFunctions.emplace_back(begin, JitFunction::Compile(*this, begin));
+	return m_JitFunctions.back().second.get();
+}
+#endif
@@ -0,0 +1,122 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <memory>
+
+#include "AtomicTypes.h"
+#include "Opcode.h"
+#include "Jit.h"
+
+class RegisterCode;
+
+//Dispatch engine: direct threading via computed goto where the compiler supports it,
+//define VM_SWITCH_DISPATCH to build the portable switch loop instead
+#if !defined(VM_SWITCH_DISPATCH) && (defined(__GNUC__) || defined(__clang__))
+	#define VM_THREADED_DISPATCH
+#endif
+
+//Immutable part of a loaded program: the executable header, the code segment and its decoded instruction stream.
+//It is built once and shared by any number of VirtualMachine execution contexts, which only hold the mutable state
+//(stack, statics, heap and registers). All const members are safe to call from several threads at once
+class ProgramImage
+{
+public:
+	//Decoded instructions, built once so the interpreter never parses bytecode
+	struct Instruction
+	{
+#ifdef VM_THREADED_DISPATCH
+		const void* handler = nullptr;	//Address of the opcode handler in Interpret
+#endif
+		int32 immediate = 0;			//LITERAL value, LITERAL_ARRAY count, FRAME argument size
+		uint32 target = 0;				//LITERAL_ARRAY value offset in the code segment, FRAME local size
+		uint32 address = 0;				//Bytecode address the instruction was decoded from
+		Opcode operation = Opcode::INVALID;
+	};
+
+	ProgramImage();
+	~ProgramImage();
+	ProgramImage(const ProgramImage&) = delete;
+	ProgramImage& operator=(const ProgramImage&) = delete;
+
+	bool Load(const std::string &filename);
+	//Validates the header and decodes the code segment, the bytecode isn't referenced after this returns
+	bool SetBytecode(const uint8* bytecode, size_t size);
+
+	bool IsLoaded() const { return m_Loaded; }
+
+	//Memory layout every execution context uses: stack, code, statics, then the heap
+	uint32 GetStackSize() const { return m_StackSize; }
+	uint32 GetCodeSize() const { return static_cast<uint32>(m_CodeSegment.size()); }
+	uint32 GetStaticBase() const { return m_StaticBase; }
+	uint32 GetHeapBase() const { return m_HeapBase; }
+	uint32 GetHeapSize() const { return m_HeapSize; }	//From the header, contexts can override it
+
+	const uint8* GetCodeSegment() const { return m_CodeSegment.data(); }
+	const Instruction& GetInstruction(uint32 index) const { return m_Code[index]; }
+	uint32 GetInstructionCount() const { return static_cast<uint32>(m_Code.size()); }
+	uint32 GetEntryIndex() const { return Resolve(m_StackSize); }
+	//Index of the decoded instruction for a bytecode address
+	inline uint32 Resolve(uint32 address) const;
+
+	//The instruction stream with handlers from the dispatch table of one Interpret instantiation. Bound once per
+	//table and kept for the lifetime of the image
+	const Instruction* GetCode(const void* const* dispatchTable) const;
+	const Instruction* GetCode() const { return m_Code.data(); }
+
+	//Decoded index of the first instruction of the function holding an index, after its FRAME
+	uint32 GetFunctionBegin(uint32 index) const;
+	//Decoded entries a superinstruction spans, 1 for single instructions, and the opcode of each part
+	uint32 GetInstructionLength(uint32 index) const;
+	Opcode GetPart(uint32 index, uint32 part) const;
+	//Decoded indices control reaches other than by falling through. direct: immediate jump targets and function
+	//bodies, computed: return sites and literals that are instruction addresses, the possible targets of computed jumps
+	void FindBlockEntries(std::set<uint32> &direct, std::set<uint32> &computed) const;
+
+	//Register based form of the code, converted by the first VM asking for it
+	const RegisterCode& GetRegisterCode() const;
+
+#ifdef VM_JIT
+	//Native code for the function holding a decoded index, compiled by the first VM asking for it. nullptr if there is
+	//nothing worth compiling
+	const JitFunction* GetJitFunction(uint32 index) const;
+#endif
+
+private:
+	void Decode();
+
+	bool m_Loaded = false;
+	uint32 m_StackSize = 0;
+	uint32 m_StaticBase = 0;
+	uint32 m_HeapBase = 0;
+	uint32 m_HeapSize = 0;
+
+	std::vector<uint8> m_CodeSegment;
+	std::vector<Instruction> m_Code;	//Entry 0 traps jumps into the middle of an instruction
+	std::vector<uint32> m_Translation;	//Code segment offset -> index in m_Code
+	uint32 m_HaltIndex = 0;
+
+#ifdef VM_THREADED_DISPATCH
+	struct BoundCode
+	{
+		const void* const* dispatchTable;
+		std::vector<Instruction> code;
+	};
+	mutable std::mutex m_BindMutex;
+	mutable std::vector<BoundCode> m_BoundCode;
+#endif
+	mutable std::mutex m_RegisterMutex;
+	mutable std::unique_ptr<RegisterCode> m_pRegisterCode;
+#ifdef VM_JIT
+	mutable std::mutex m_JitMutex;
+	mutable std::vector<std::pair<uint32, std::unique_ptr<JitFunction>>> m_JitFunctions;	//By function begin, failed compiles too
+#endif
+};
+
+uint32 ProgramImage::Resolve(uint32 address) const
+{
+	uint32 offset = address - m_StackSize;
+	if(offset < m_Translation.size()) return m_Translation[offset];
+	return address >= m_StaticBase ? m_HaltIndex : 0;
+}
@@ -0,0 +1,521 @@
+#include "RegisterCode.h"
+
+#include <set>
+
+#include "WordFormat.h"
+
+namespace
+{
+	const Operand NO_OPERAND = { OperandKind::CONSTANT, 0 };
+
+	const char* const s_OpNames[] =
+	{
+		"MOVE", "ADD", "SUB", "LESS", "GREATER", "EQUALS", "NOT",
+		"LOAD", "LOAD_LCL", "LOAD_ARG", "STORE", "STORE_LCL", "ALLOC", "FREE", "ADJUST",
+		"JMP", "JMP_IF", "JMP_IF_NOT", "JMP_INDIRECT", "JMP_IF_INDIRECT", "CALL", "CALL_INDIRECT", "RETURN",
+		"PRINT", "PRINT_CONSTANT", "PRINT_INT", "PRINT_ENDL", "FLUSH", "HALT", "FRAME", "INVALID"
+	};
+	static_assert(sizeof(s_OpNames)/sizeof(s_OpNames[0]) == static_cast<uint8>(RegisterOp::INVALID) + 1, "Names out of sync with RegisterOp");
+
+	bool IsMemory(Operand operand)
+	{
+		return operand.kind != OperandKind::TEMP && operand.kind != OperandKind::CONSTANT;
+	}
+
+	int32 Fold(Opcode code, int32 a, int32 b)
+	{
+		switch(code)
+		{
+		case Opcode::ADD: return static_cast<int32>(static_cast<uint32>(a) + static_cast<uint32>(b));
+		case Opcode::SUB: return static_cast<int32>(static_cast<uint32>(a) - static_cast<uint32>(b));
+		case Opcode::LESS: return a < b;
+		case Opcode::GREATER: return a > b;
+		default: return a == b;
+		}
+	}
+
+	RegisterOp GetBinaryOp(Opcode code)
+	{
+		switch(code)
+		{
+		case Opcode::ADD: return RegisterOp::ADD;
+		case Opcode::SUB: return RegisterOp::SUB;
+		case Opcode::LESS: return RegisterOp::LESS;
+		case Opcode::GREATER: return RegisterOp::GREATER;
+		default: return RegisterOp::EQUALS;
+		}
+	}
+}
+
+const uint32 RegisterCode::NO_ENTRY;
+
+void RegisterCode::Build(const ProgramImage &image)
+{
+	m_pImage = &image;
+	m_Code.clear();
+	m_Constants.clear();
+	m_ConstantIndex.clear();
+	m_Strings.clear();
+	m_Stack.clear();
+	m_Popped = 0;
+	m_BlockTemps = 0;
+	m_TempCount = 0;
+	m_LastIsValue = false;
+
+	uint32 haltIndex = image.GetInstructionCount() - 1;
+	std::set<uint32> direct;
+	std::set<uint32> computed;
+	image.FindBlockEntries(direct, computed);
+	direct.insert(image.GetEntryIndex());
+	m_Entries.assign(image.GetInstructionCount(), NO_ENTRY);
+
+	//Index 0 is the trap bytecode addresses outside the code resolve to
+	m_Entries[0] = 0;
+	m_Address = image.GetInstruction(0).address;
+	Emit(RegisterOp::INVALID, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+
+	for(uint32 index = 1; index < haltIndex; index += image.GetInstructionLength(index))
+	{
+		if(direct.count(index) != 0 || computed.count(index) != 0)
+		{
+			Spill();
+			m_Entries[index] = GetInstructionCount();
+		}
+		for(uint32 part = 0; part < image.GetInstructionLength(index); ++part)
+		{
+			const ProgramImage::Instruction &instruction = image.GetInstruction(index + part);
+			m_Address = instruction.address;
+			BuildPart(image.GetPart(index, part), instruction);
+		}
+	}
+	Spill();
+	m_Entries[haltIndex] = GetInstructionCount();
+	m_Address = image.GetInstruction(haltIndex).address;
+	Emit(RegisterOp::HALT, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+	m_Entry = m_Entries[image.GetEntryIndex()];
+
+	//Immediate jumps and calls were built with decoded indices, every one of them starts a block
+	for(RegisterInstruction &instruction : m_Code)
+	{
+		switch(instruction.op)
+		{
+		case RegisterOp::JMP:
+		case RegisterOp::JMP_IF:
+		case RegisterOp::JMP_IF_NOT:
+			instruction.target = m_Entries[instruction.target];
+			break;
+		case RegisterOp::CALL:
+		{
+			//dst and a carry the argument and local sizes of the FRAME
+			const ProgramImage::Instruction &frame = image.GetInstruction(instruction.target);
+			instruction.dst.offset = frame.immediate;
+			instruction.a.offset = static_cast<int32>(frame.target);
+			instruction.target = m_Entries[instruction.target + 1];
+		}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void RegisterCode::BuildPart(Opcode code, const ProgramImage::Instruction &instruction)
+{
+	int32 immediate = instruction.immediate;
+	switch(code)
+	{
+	case Opcode::LITERAL:
+		Push(Constant(immediate));
+		break;
+	case Opcode::LITERAL_ARRAY:
+	{
+		const uint8* values = m_pImage->GetCodeSegment() + instruction.target;
+		for(int32 value = 0; value < immediate; ++value) Push(Constant(static_cast<int32>(LoadWord(values + value * sizeof(int32)))));
+	}
+		break;
+
+	//Loads from known addresses stay operands until an instruction consumes them
+	case Opcode::LOAD:
+	{
+		Operand address = Pop();
+		if(IsKnownOffset(address)) Push({ OperandKind::STATIC, GetConstant(address) });
+		else Push(EmitValue(RegisterOp::LOAD, address, NO_OPERAND));
+	}
+		break;
+	case Opcode::LOAD_LCL:
+	case Opcode::LOAD_ARG:
+	{
+		Operand offset = Pop();
+		bool local = code == Opcode::LOAD_LCL;
+		if(IsKnownOffset(offset)) Push({ local ? OperandKind::LOCAL : OperandKind::ARGUMENT, GetConstant(offset) });
+		else Push(EmitValue(local ? RegisterOp::LOAD_LCL : RegisterOp::LOAD_ARG, offset, NO_OPERAND));
+	}
+		break;
+	case Opcode::LOAD_I:
+	case Opcode::LOAD_LCL_I:
+	case Opcode::LOAD_ARG_I:
+		Push(Constant(immediate));
+		BuildPart(code == Opcode::LOAD_I ? Opcode::LOAD : code == Opcode::LOAD_LCL_I ? Opcode::LOAD_LCL : Opcode::LOAD_ARG, instruction);
+		break;
+	case Opcode::STORE:
+	case Opcode::STORE_LCL:
+	{
+		Operand address = Pop();
+		Operand value = Pop();
+		bool local = code == Opcode::STORE_LCL;
+		if(IsKnownOffset(address))
+		{
+			EmitStore({ local ? OperandKind::LOCAL : OperandKind::STATIC, GetConstant(address) }, value);
+		}
+		else
+		{
+			Materialize(nullptr);
+			Emit(local ? RegisterOp::STORE_LCL : RegisterOp::STORE, NO_OPERAND, value, address);
+		}
+	}
+		break;
+	case Opcode::STORE_I:
+	case Opcode::STORE_LCL_I:
+		Push(Constant(immediate));
+		BuildPart(code == Opcode::STORE_I ? Opcode::STORE : Opcode::STORE_LCL, instruction);
+		break;
+
+	case Opcode::ALLOC:
+	{
+		Operand size = Pop();
+		Materialize(nullptr, true);
+		Push(EmitValue(RegisterOp::ALLOC, size, NO_OPERAND));
+	}
+		break;
+	case Opcode::FREE:
+	{
+		Operand address = Pop();
+		Materialize(nullptr, true);
+		Emit(RegisterOp::FREE, NO_OPERAND, address, NO_OPERAND);
+	}
+		break;
+
+	case Opcode::ADD:
+	case Opcode::SUB:
+	case Opcode::LESS:
+	case Opcode::GREATER:
+	case Opcode::EQUALS:
+	{
+		Operand b = Pop();
+		Operand a = Pop();
+		if(IsConstant(a) && IsConstant(b)) Push(Constant(Fold(code, GetConstant(a), GetConstant(b))));
+		else Push(EmitValue(GetBinaryOp(code), a, b));
+	}
+		break;
+	case Opcode::NOT:
+	{
+		Operand a = Pop();
+		if(IsConstant(a)) Push(Constant(!GetConstant(a)));
+		else Push(EmitValue(RegisterOp::NOT, a, NO_OPERAND));
+	}
+		break;
+
+	case Opcode::JMP:
+	{
+		Operand address = Hold(Pop());
+		Spill();
+		if(IsConstant(address) && IsInstruction(static_cast<uint32>(GetConstant(address))))
+		{
+			Emit(RegisterOp::JMP, NO_OPERAND, NO_OPERAND, NO_OPERAND).target = m_pImage->Resolve(static_cast<uint32>(GetConstant(address)));
+		}
+		else
+		{
+			Emit(RegisterOp::JMP_INDIRECT, NO_OPERAND, address, NO_OPERAND);
+		}
+	}
+		break;
+	case Opcode::JMP_IF:
+	{
+		Operand address = Hold(Pop());
+		Operand condition = Pop();
+		if(IsConstant(address) && IsInstruction(static_cast<uint32>(GetConstant(address))))
+		{
+			EmitBranch(RegisterOp::JMP_IF, condition, m_pImage->Resolve(static_cast<uint32>(GetConstant(address))));
+		}
+		else
+		{
+			condition = Hold(condition);
+			Spill();
+			Emit(RegisterOp::JMP_IF_INDIRECT, NO_OPERAND, condition, address);
+		}
+	}
+		break;
+	case Opcode::JMP_I:
+		Spill();
+		Emit(RegisterOp::JMP, NO_OPERAND, NO_OPERAND, NO_OPERAND).target = instruction.target;
+		break;
+	case Opcode::JMP_IF_I:
+		EmitBranch(RegisterOp::JMP_IF, Pop(), instruction.target);
+		break;
+
+	case Opcode::CALL:
+	{
+		Operand address = Hold(Pop());
+		//The arguments are spilled, CALL moves sp past them
+		Operand pushed = { OperandKind::CONSTANT, Spill(false) };
+		RegisterInstruction &call = Emit(RegisterOp::CALL_INDIRECT, NO_OPERAND, address, pushed);
+		call.address = m_Address + 1;
+		if(IsConstant(address) && IsInstruction(static_cast<uint32>(GetConstant(address))))
+		{
+			uint32 frame = m_pImage->Resolve(static_cast<uint32>(GetConstant(address)));
+			if(m_pImage->GetInstruction(frame).operation == Opcode::FRAME)
+			{
+				call.op = RegisterOp::CALL;
+				call.target = frame;
+			}
+		}
+	}
+		break;
+	case Opcode::CALL_I:
+	{
+		Operand address = Constant(static_cast<int32>(m_pImage->GetInstruction(instruction.target).address));
+		Operand pushed = { OperandKind::CONSTANT, Spill(false) };
+		//Calls of something that isn't a function fail at run time like in the interpreter
+		bool function = m_pImage->GetInstruction(instruction.target).operation == Opcode::FRAME;
+		RegisterInstruction &call = Emit(function ? RegisterOp::CALL : RegisterOp::CALL_INDIRECT, NO_OPERAND, address, pushed);
+		call.target = instruction.target;
+		call.address = m_Address + 1 + sizeof(int32);
+	}
+		break;
+	case Opcode::RETURN:
+	{
+		//The rest of the working stack is dropped with the frame
+		Operand value = Pop();
+		m_Stack.clear();
+		m_Popped = 0;
+		Emit(RegisterOp::RETURN, NO_OPERAND, value, NO_OPERAND);
+		Spill();
+	}
+		break;
+	case Opcode::FRAME:
+		Spill();
+		Emit(RegisterOp::FRAME, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+		break;
+
+	case Opcode::PRINT:
+	{
+		//Strings pushed as literals are printed from the string pool
+		size_t count = m_Stack.size();
+		bool constant = count > 0 && IsConstant(m_Stack[count - 1]);
+		uint32 size = constant ? static_cast<uint32>(GetConstant(m_Stack[count - 1])) : 0;
+		for(uint32 character = 0; constant && character < size; ++character)
+		{
+			constant = character + 1 < count && IsConstant(m_Stack[count - 2 - character]);
+		}
+		if(constant)
+		{
+			RegisterInstruction &print = Emit(RegisterOp::PRINT_CONSTANT, NO_OPERAND, { OperandKind::CONSTANT, static_cast<int32>(m_Strings.size()) }, NO_OPERAND);
+			print.target = size;
+			for(size_t character = count - 1 - size; character < count - 1; ++character)
+			{
+				m_Strings.push_back(static_cast<char>(GetConstant(m_Stack[character])));
+			}
+			m_Stack.resize(count - 1 - size);
+		}
+		else
+		{
+			Spill();
+			Emit(RegisterOp::PRINT, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+		}
+	}
+		break;
+	case Opcode::PRINT_INT:
+		Emit(RegisterOp::PRINT_INT, NO_OPERAND, Pop(), NO_OPERAND);
+		break;
+	case Opcode::PRINT_ENDL:
+		Emit(RegisterOp::PRINT_ENDL, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+		break;
+	case Opcode::FLUSH:
+		Emit(RegisterOp::FLUSH, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+		break;
+
+	default:
+		Spill();
+		Emit(RegisterOp::INVALID, NO_OPERAND, NO_OPERAND, NO_OPERAND);
+		break;
+	}
+}
+
+Operand RegisterCode::Constant(int32 value)
+{
+	auto found = m_ConstantIndex.find(value);
+	if(found != m_ConstantIndex.end()) return { OperandKind::CONSTANT, found->second };
+	int32 offset = static_cast<int32>(m_Constants.size() * sizeof(int32));
+	m_Constants.push_back(value);
+	m_ConstantIndex[value] = offset;
+	return { OperandKind::CONSTANT, offset };
+}
+
+Operand RegisterCode::Temp()
+{
+	Operand temp = { OperandKind::TEMP, static_cast<int32>(m_BlockTemps++ * sizeof(int32)) };
+	if(m_BlockTemps > m_TempCount) m_TempCount = m_BlockTemps;
+	return temp;
+}
+
+Operand RegisterCode::Pop()
+{
+	//Below the values of this block the stack continues in RAM
+	if(m_Stack.empty()) return { OperandKind::STACK, -static_cast<int32>(m_Popped++ * sizeof(int32)) };
+	Operand top = m_Stack.back();
+	m_Stack.pop_back();
+	return top;
+}
+
+Operand RegisterCode::Hold(Operand operand)
+{
+	if(operand.kind != OperandKind::STACK) return operand;
+	Operand temp = Temp();
+	Emit(RegisterOp::MOVE, temp, operand, NO_OPERAND);
+	return temp;
+}
+
+int32 RegisterCode::Spill(bool adjust)
+{
+	//Values still read from the RAM stack can sit in the slots written here
+	for(Operand &value : m_Stack) value = Hold(value);
+	std::vector<Operand> values;
+	values.swap(m_Stack);
+	//Top first, it is the likeliest to be computed by the last instruction and written in place
+	int32 base = -static_cast<int32>(m_Popped * sizeof(int32));
+	for(size_t index = values.size(); index-- > 0;)
+	{
+		EmitStore({ OperandKind::STACK, base + static_cast<int32>((index + 1) * sizeof(int32)) }, values[index]);
+	}
+	int32 moved = static_cast<int32>((static_cast<int32>(values.size()) - m_Popped) * static_cast<int32>(sizeof(int32)));
+	m_Popped = 0;
+	if(adjust && moved != 0) Emit(RegisterOp::ADJUST, NO_OPERAND, NO_OPERAND, NO_OPERAND).target = static_cast<uint32>(moved);
+	//Nothing is left in a register, the next block can reuse all of them
+	m_BlockTemps = 0;
+	m_LastIsValue = false;
+	return moved;
+}
+
+void RegisterCode::Materialize(const Operand* written, bool heapOnly)
+{
+	for(Operand &value : m_Stack)
+	{
+		if(!IsMemory(value)) continue;
+		if(heapOnly ? value.kind != OperandKind::STATIC : written != nullptr && *written != value) continue;
+		Operand temp = Temp();
+		Emit(RegisterOp::MOVE, temp, value, NO_OPERAND);
+		value = temp;
+	}
+}
+
+bool RegisterCode::IsInstruction(uint32 address) const
+{
+	return address - m_pImage->GetStackSize() < m_pImage->GetCodeSize() && m_pImage->Resolve(address) != 0;
+}
+
+RegisterInstruction& RegisterCode::Emit(RegisterOp op, Operand dst, Operand a, Operand b)
+{
+	m_Code.push_back({ op, dst, a, b, 0, m_Address });
+	m_LastIsValue = false;
+	return m_Code.back();
+}
+
+Operand RegisterCode::EmitValue(RegisterOp op, Operand a, Operand b)
+{
+	Operand dst = Temp();
+	Emit(op, dst, a, b);
+	m_LastIsValue = true;
+	return dst;
+}
+
+void RegisterCode::EmitStore(Operand dst, Operand value)
+{
+	Materialize(&dst);
+	//A value computed by the instruction just before is written straight to its destination
+	if(m_LastIsValue && value.kind == OperandKind::TEMP && m_Code.back().dst == value)
+	{
+		m_Code.back().dst = dst;
+		m_LastIsValue = false;
+		return;
+	}
+	Emit(RegisterOp::MOVE, dst, value, NO_OPERAND);
+}
+
+void RegisterCode::EmitBranch(RegisterOp op, Operand condition, uint32 target)
+{
+	condition = Hold(condition);
+	//if(!x) branches on x
+	if(m_LastIsValue && condition.kind == OperandKind::TEMP && m_Code.back().op == RegisterOp::NOT && m_Code.back().dst == condition &&
+		m_Code.back().a.kind != OperandKind::STACK)
+	{
+		condition = m_Code.back().a;
+		m_Code.pop_back();
+		op = op == RegisterOp::JMP_IF ? RegisterOp::JMP_IF_NOT : RegisterOp::JMP_IF;
+	}
+	Spill();
+	Emit(op, NO_OPERAND, condition, NO_OPERAND).target = target;
+}
+
+void RegisterCode::Print(std::ostream &stream) const
+{
+	static const char* const s_KindNames[] = { "t", "#", "lcl", "arg", "sp", "@" };
+	auto operand = [&](Operand value)
+	{
+		stream << " ";
+		switch(value.kind)
+		{
+		case OperandKind::CONSTANT: stream << GetConstant(value); break;
+		case OperandKind::TEMP: stream << "t" << value.offset / static_cast<int32>(sizeof(int32)); break;
+		case OperandKind::STATIC: stream << "@" << value.offset; break;
+		default: stream << s_KindNames[static_cast<uint8>(value.kind)] << (value.offset < 0 ? "" : "+") << value.offset; break;
+		}
+	};
+	for(uint32 index = 0; index < GetInstructionCount(); ++index)
+	{
+		const RegisterInstruction &instruction = m_Code[index];
+		stream << index << "\t" << instruction.address << "\t" << s_OpNames[static_cast<uint8>(instruction.op)];
+		switch(instruction.op)
+		{
+		case RegisterOp::MOVE: case RegisterOp::NOT: case RegisterOp::LOAD: case RegisterOp::LOAD_LCL: case RegisterOp::LOAD_ARG: case RegisterOp::ALLOC:
+			operand(instruction.dst);
+			operand(instruction.a);
+			break;
+		case RegisterOp::ADD: case RegisterOp::SUB: case RegisterOp::LESS: case RegisterOp::GREATER: case RegisterOp::EQUALS:
+			operand(instruction.dst);
+			operand(instruction.a);
+			operand(instruction.b);
+			break;
+		case RegisterOp::STORE: case RegisterOp::STORE_LCL: case RegisterOp::JMP_IF_INDIRECT:
+			operand(instruction.a);
+			operand(instruction.b);
+			break;
+		case RegisterOp::FREE: case RegisterOp::JMP_INDIRECT: case RegisterOp::RETURN: case RegisterOp::PRINT_INT:
+			operand(instruction.a);
+			break;
+		case RegisterOp::CALL_INDIRECT:
+			operand(instruction.a);
+			stream << " sp+" << instruction.b.offset;
+			break;
+		case RegisterOp::ADJUST:
+			stream << " " << static_cast<int32>(instruction.target);
+			break;
+		case RegisterOp::JMP:
+			stream << " -> " << instruction.target;
+			break;
+		case RegisterOp::CALL:
+			stream << " -> " << instruction.target << " sp+" << instruction.b.offset;
+			break;
+		case RegisterOp::JMP_IF:
+		case RegisterOp::JMP_IF_NOT:
+			operand(instruction.a);
+			stream << " -> " << instruction.target;
+			break;
+		case RegisterOp::PRINT_CONSTANT:
+			stream << " \"" << m_Strings.substr(instruction.a.offset, instruction.target) << "\"";
+			break;
+		default:
+			break;
+		}
+		stream << "\n";
+	}
+}
@@ -0,0 +1,136 @@
+#pragma once
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "ProgramImage.h"
+
+//Register form of a program image for VirtualMachine::InterpretRegisters. Every basic block of the stack code is
+//converted once: values the stack code pushes and pops within a block become virtual registers, and loads of
+//constants, statics, locals and arguments at known offsets become operands of the instruction that consumes them.
+//Each instruction names its operands, so "acc = acc + a" is one ADD instead of four stack instructions.
+//The operand stack only exists in RAM between blocks, where its layout is the same as in the stack interpreter,
+//so calls, returns, PRINT and computed jumps keep their semantics. Values a block finds on the RAM stack are read in
+//place and the values it leaves there are written to their slots, with one sp adjustment per block.
+//Computed jumps can reach the same targets as translated C++: return sites, functions and addresses the program
+//pushes as literals
+
+//Where an operand lives. Each kind has a base pointer the operand's byte offset is added to
+enum class OperandKind : uint8
+{
+	TEMP,		//Virtual register, only alive within its block
+	CONSTANT,	//Constant pool of the register code
+	LOCAL,		//Word at LCL + offset
+	ARGUMENT,	//Word at ARG + offset
+	STACK,		//Word at sp + offset, relative to sp where the block started
+	STATIC,		//Word at an absolute address below 2GB
+	COUNT
+};
+
+struct Operand
+{
+	OperandKind kind;
+	int32 offset;
+	bool operator==(const Operand &other) const { return kind == other.kind && offset == other.offset; }
+	bool operator!=(const Operand &other) const { return !(*this == other); }
+};
+
+enum class RegisterOp : uint8
+{
+	MOVE,			//dst = a
+	ADD, SUB, LESS, GREATER, EQUALS,	//dst = a op b
+	NOT,			//dst = !a
+	LOAD, LOAD_LCL, LOAD_ARG,	//dst = word at a, LCL + a or ARG + a
+	STORE, STORE_LCL,	//word at b or LCL + b = a
+	ALLOC,			//dst = heap block of a bytes
+	FREE,			//free heap block a
+	ADJUST,			//sp += target bytes
+	JMP,			//goto target
+	JMP_IF, JMP_IF_NOT,	//if(a) / if(!a) goto target
+	JMP_INDIRECT,	//goto bytecode address a
+	JMP_IF_INDIRECT,	//if(a) goto bytecode address b
+	CALL,			//sp += b.offset, then call the FRAME at decoded index target, returning to bytecode address "address"
+	CALL_INDIRECT,	//sp += b.offset, then call the FRAME at bytecode address a
+	RETURN,			//return a
+	PRINT,			//PRINT with its characters on the RAM stack
+	PRINT_CONSTANT,	//print target characters of the string pool from offset a.offset
+	PRINT_INT, PRINT_ENDL, FLUSH,
+	HALT,
+	FRAME,			//fails, a function was entered without a CALL
+	INVALID
+};
+
+struct RegisterInstruction
+{
+	RegisterOp op;
+	Operand dst, a, b;
+	uint32 target;
+	uint32 address;		//Bytecode address of the stack instruction, the return address for calls
+};
+
+class RegisterCode
+{
+public:
+	static const uint32 NO_ENTRY = 0xFFFFFFFF;
+
+	//Converts every block of a loaded image
+	void Build(const ProgramImage &image);
+
+	const RegisterInstruction* GetCode() const { return m_Code.data(); }
+	uint32 GetInstructionCount() const { return static_cast<uint32>(m_Code.size()); }
+	//Register code index execution starts at
+	uint32 GetEntry() const { return m_Entry; }
+	//Register code index of a bytecode address, NO_ENTRY where no block starts
+	uint32 GetEntry(uint32 address) const { return m_Entries[m_pImage->Resolve(address)]; }
+	const int32* GetConstants() const { return m_Constants.data(); }
+	const char* GetStrings() const { return m_Strings.data(); }
+	//Virtual registers the largest block needs
+	uint32 GetTempCount() const { return m_TempCount; }
+
+	//Listing of the register code, one instruction per line
+	void Print(std::ostream &stream) const;
+
+private:
+	void BuildPart(Opcode code, const ProgramImage::Instruction &instruction);
+
+	Operand Constant(int32 value);
+	Operand Temp();
+	void Push(Operand operand) { m_Stack.push_back(operand); }
+	Operand Pop();
+	//Copies a STACK operand to a register, for instructions that read it after the block's values are spilled
+	Operand Hold(Operand operand);
+	//Writes the values on the conversion time stack to their RAM stack slots at the end of a block. Returns how far sp
+	//moves, the sp adjustment is emitted unless the instruction ending the block does it
+	int32 Spill(bool adjust = true);
+	//Copies stack values that read memory into registers before an instruction writes to it.
+	//STATIC operands if only the heap is written, every memory operand if written is null, else the ones reading it
+	void Materialize(const Operand* written, bool heapOnly = false);
+	bool IsConstant(Operand operand) const { return operand.kind == OperandKind::CONSTANT; }
+	int32 GetConstant(Operand operand) const { return m_Constants[operand.offset / sizeof(int32)]; }
+	//A constant that can be the offset of a STATIC, LOCAL or ARGUMENT operand, offsets are added to their base signed
+	bool IsKnownOffset(Operand operand) const { return IsConstant(operand) && GetConstant(operand) >= 0; }
+	bool IsInstruction(uint32 address) const;
+
+	RegisterInstruction& Emit(RegisterOp op, Operand dst, Operand a, Operand b);
+	Operand EmitValue(RegisterOp op, Operand a, Operand b);
+	void EmitStore(Operand dst, Operand value);
+	void EmitBranch(RegisterOp op, Operand a, uint32 target);
+
+	const ProgramImage* m_pImage = nullptr;
+	std::vector<RegisterInstruction> m_Code;
+	std::vector<uint32> m_Entries;		//Register code index per decoded index, NO_ENTRY inside blocks
+	uint32 m_Entry = 0;
+	std::vector<int32> m_Constants;
+	std::map<int32, int32> m_ConstantIndex;
+	std::string m_Strings;
+
+	//Conversion state of the current block
+	std::vector<Operand> m_Stack;
+	int32 m_Popped = 0;					//Values read off the RAM stack since sp was last adjusted
+	uint32 m_BlockTemps = 0;
+	uint32 m_TempCount = 0;
+	uint32 m_Address = 0;
+	bool m_LastIsValue = false;		//The last instruction emitted in this block computes a fresh temp into dst
+};
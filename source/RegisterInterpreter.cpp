@@ -0,0 +1,340 @@
+#include "VirtualMachine.h"
+
+#include <cassert>
+#include <iostream>
+
+#include "RegisterCode.h"
+#include "WordFormat.h"
+
+RunStatus VirtualMachine::InterpretRegisters(uint64* pDispatches)
+{
+	if(pDispatches) return ExecuteRegisters<true>(*pDispatches);
+	uint64 dispatches = 0;
+	return ExecuteRegisters<false>(dispatches);
+}
+
+template<bool COUNTED>
+RunStatus VirtualMachine::ExecuteRegisters(uint64 &dispatches)
+{
+	if(!ProgramLoaded)
+	{
+		std::cerr << "[VM] No program loaded" << std::endl;
+		return RunStatus::ERROR;
+	}
+	if(m_Ended) return m_Status;
+	//Register code only has entries where blocks start, a program stopped by Run can only be resumed by Run
+	if(m_ResumeIndex != m_pImage->GetEntryIndex())
+	{
+		std::cerr << "[VM] The register interpreter can only run a program from its start" << std::endl;
+		return RunStatus::ERROR;
+	}
+
+	const RegisterCode &code = m_pImage->GetRegisterCode();
+	const RegisterInstruction* start = code.GetCode();
+	std::vector<uint32> temps(code.GetTempCount() + 1);
+	int32 sp = m_StackPointer;
+	uint32 lcl = m_LCL;
+	uint32 arg = m_ARG;
+	//Base pointer per OperandKind, an operand is the word at its base plus its offset
+	uint8* bases[static_cast<uint8>(OperandKind::COUNT)] =
+	{
+		reinterpret_cast<uint8*>(temps.data()),
+		reinterpret_cast<uint8*>(const_cast<int32*>(code.GetConstants())),
+		m_RAM + lcl,
+		m_RAM + arg,
+		m_RAM + sp,
+		m_RAM
+	};
+	const RegisterInstruction* ip = start + code.GetEntry();
+
+	#define RVM_READ(operand) static_cast<int32>(LoadWord(bases[static_cast<uint8>((operand).kind)] + (operand).offset))
+	#define RVM_WRITE(operand, value) StoreWord(bases[static_cast<uint8>((operand).kind)] + (operand).offset, static_cast<uint32>(value))
+	#define RVM_MOVE_SP(bytes) \
+		{ \
+			sp += (bytes); \
+			assert(sp < static_cast<int32>(m_StackSize)); /*Stack Overflow*/ \
+			bases[static_cast<uint8>(OperandKind::STACK)] = m_RAM + sp; \
+		}
+	#define RVM_PUSH(value) \
+		{ \
+			RVM_MOVE_SP(sizeof(int32)); \
+			StoreWord(m_RAM + sp, static_cast<uint32>(value)); \
+		}
+	#define RVM_FRAME() \
+		{ \
+			bases[static_cast<uint8>(OperandKind::LOCAL)] = m_RAM + lcl; \
+			bases[static_cast<uint8>(OperandKind::ARGUMENT)] = m_RAM + arg; \
+			bases[static_cast<uint8>(OperandKind::STACK)] = m_RAM + sp; \
+		}
+	#define RVM_END(status) \
+		{ \
+			m_StackPointer = sp; \
+			m_LCL = lcl; \
+			m_ARG = arg; \
+			m_ProgramCounter = ip->address; \
+			m_Status = status; \
+			m_Ended = true; \
+			m_pOutput->Flush(); \
+			return status; \
+		}
+	#define RVM_FAIL() RVM_END(RunStatus::ERROR)
+	#define RVM_GOTO(to) \
+		{ \
+			uint32 entry = code.GetEntry(to); \
+			if(entry == RegisterCode::NO_ENTRY) \
+			{ \
+				std::cerr << "[VM] Jump to " << (to) << " at " << ip->address << " doesn't start a block of the register code" << std::endl; \
+				RVM_FAIL(); \
+			} \
+			ip = start + entry; \
+		}
+	//Same frame as the stack interpreter's CALL, after moving sp past the arguments the block left in RAM
+	#define RVM_CALL(argumentSize, localSize, body) \
+		{ \
+			RVM_MOVE_SP(ip->b.offset); \
+			RVM_PUSH(m_RTN); \
+			m_RTN = ip->address; \
+			RVM_PUSH(lcl); \
+			RVM_PUSH(arg); \
+			RVM_PUSH(m_THIS); \
+			arg = sp - (static_cast<int32>(argumentSize) + 12 /*difference from this to return*/); \
+			lcl = sp + sizeof(int32); \
+			sp = lcl + (localSize); \
+			RVM_FRAME(); \
+			ip = start + (body); \
+		}
+
+#ifdef VM_THREADED_DISPATCH
+	static const void* s_DispatchTable[] =
+	{
+		&&op_MOVE, &&op_ADD, &&op_SUB, &&op_LESS, &&op_GREATER, &&op_EQUALS, &&op_NOT,
+		&&op_LOAD, &&op_LOAD_LCL, &&op_LOAD_ARG, &&op_STORE, &&op_STORE_LCL, &&op_ALLOC, &&op_FREE, &&op_ADJUST,
+		&&op_JMP, &&op_JMP_IF, &&op_JMP_IF_NOT, &&op_JMP_INDIRECT, &&op_JMP_IF_INDIRECT, &&op_CALL, &&op_CALL_INDIRECT, &&op_RETURN,
+		&&op_PRINT, &&op_PRINT_CONSTANT, &&op_PRINT_INT, &&op_PRINT_ENDL, &&op_FLUSH, &&op_HALT, &&op_FRAME, &&op_INVALID
+	};
+	static_assert(sizeof(s_DispatchTable)/sizeof(s_DispatchTable[0]) == static_cast<uint8>(RegisterOp::INVALID) + 1, "Dispatch table out of sync with RegisterOp");
+
+	#define RVM_CASE(op) op_##op:
+	#define RVM_NEXT() \
+		if(COUNTED) { ++dispatches; } \
+		goto *s_DispatchTable[static_cast<uint8>(ip->op)]
+
+	RVM_NEXT();
+#else
+	#define RVM_CASE(op) case RegisterOp::op:
+	#define RVM_NEXT() continue
+
+	for(;;)
+	{
+		if(COUNTED) { ++dispatches; }
+		switch(ip->op)
+		{
+#endif
+		RVM_CASE(MOVE)
+			RVM_WRITE(ip->dst, RVM_READ(ip->a));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(ADD)
+			RVM_WRITE(ip->dst, static_cast<uint32>(RVM_READ(ip->a)) + static_cast<uint32>(RVM_READ(ip->b)));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(SUB)
+			RVM_WRITE(ip->dst, static_cast<uint32>(RVM_READ(ip->a)) - static_cast<uint32>(RVM_READ(ip->b)));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(LESS)
+			RVM_WRITE(ip->dst, RVM_READ(ip->a) < RVM_READ(ip->b));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(GREATER)
+			RVM_WRITE(ip->dst, RVM_READ(ip->a) > RVM_READ(ip->b));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(EQUALS)
+			RVM_WRITE(ip->dst, RVM_READ(ip->a) == RVM_READ(ip->b));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(NOT)
+			RVM_WRITE(ip->dst, !RVM_READ(ip->a));
+			++ip;
+			RVM_NEXT();
+
+		RVM_CASE(LOAD)
+			RVM_WRITE(ip->dst, LoadWord(m_RAM + static_cast<uint32>(RVM_READ(ip->a))));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(LOAD_LCL)
+			RVM_WRITE(ip->dst, LoadWord(m_RAM + static_cast<uint32>(lcl + RVM_READ(ip->a))));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(LOAD_ARG)
+			RVM_WRITE(ip->dst, LoadWord(m_RAM + static_cast<uint32>(arg + RVM_READ(ip->a))));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(STORE)
+			StoreWord(m_RAM + static_cast<uint32>(RVM_READ(ip->b)), static_cast<uint32>(RVM_READ(ip->a)));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(STORE_LCL)
+			StoreWord(m_RAM + static_cast<uint32>(lcl + RVM_READ(ip->b)), static_cast<uint32>(RVM_READ(ip->a)));
+			++ip;
+			RVM_NEXT();
+
+		RVM_CASE(ALLOC)
+		{
+			uint32 address = m_Heap.Allocate(RVM_READ(ip->a));
+			if(address == 0)
+			{
+				std::cerr << "[VM] Out of Memory Exception, could not allocate space for variable!" << std::endl;
+				RVM_FAIL();
+			}
+			RVM_WRITE(ip->dst, address);
+			++ip;
+		}
+			RVM_NEXT();
+		RVM_CASE(FREE)
+		{
+			uint32 address = RVM_READ(ip->a);
+			switch(m_Heap.Free(address))
+			{
+			case HeapAllocator::FreeResult::FREED:
+				break;
+			case HeapAllocator::FreeResult::DOUBLE_FREE:
+				std::cerr << "[VM] Warning, memory at " << address << " was already freed" << std::endl;
+				break;
+			case HeapAllocator::FreeResult::BAD_POINTER:
+				std::cerr << "[VM] Warning, " << address << " is not an allocated address, not freed" << std::endl;
+				break;
+			}
+			++ip;
+		}
+			RVM_NEXT();
+		RVM_CASE(ADJUST)
+			RVM_MOVE_SP(static_cast<int32>(ip->target));
+			++ip;
+			RVM_NEXT();
+
+		RVM_CASE(JMP)
+			ip = start + ip->target;
+			RVM_NEXT();
+		RVM_CASE(JMP_IF)
+			ip = RVM_READ(ip->a) ? start + ip->target : ip + 1;
+			RVM_NEXT();
+		RVM_CASE(JMP_IF_NOT)
+			ip = RVM_READ(ip->a) ? ip + 1 : start + ip->target;
+			RVM_NEXT();
+		RVM_CASE(JMP_INDIRECT)
+		{
+			uint32 address = static_cast<uint32>(RVM_READ(ip->a));
+			RVM_GOTO(address);
+		}
+			RVM_NEXT();
+		RVM_CASE(JMP_IF_INDIRECT)
+		{
+			uint32 address = static_cast<uint32>(RVM_READ(ip->b));
+			if(RVM_READ(ip->a))
+			{
+				RVM_GOTO(address);
+			}
+			else
+			{
+				++ip;
+			}
+		}
+			RVM_NEXT();
+
+		RVM_CASE(CALL)
+			RVM_CALL(ip->dst.offset, ip->a.offset, ip->target);
+			RVM_NEXT();
+		RVM_CASE(CALL_INDIRECT)
+		{
+			uint32 frameIndex = m_pImage->Resolve(static_cast<uint32>(RVM_READ(ip->a)));
+			const Instruction &frame = m_pImage->GetInstruction(frameIndex);
+			if(frame.operation != Opcode::FRAME)
+			{
+				std::cerr << "[VM] Call target at " << frame.address << " is not a function" << std::endl;
+				RVM_FAIL();
+			}
+			//Every function body starts a block when the program has computed calls
+			RVM_CALL(frame.immediate, frame.target, code.GetEntry(m_pImage->GetInstruction(frameIndex + 1).address));
+		}
+			RVM_NEXT();
+		RVM_CASE(RETURN)
+		{
+			StoreWord(m_RAM + arg, static_cast<uint32>(RVM_READ(ip->a)));
+			uint32 ret = m_RTN;
+			sp = arg;
+			m_THIS = LoadWord(m_RAM + lcl - (sizeof(int32) * 1));
+			arg = LoadWord(m_RAM + lcl - (sizeof(int32) * 2));
+			m_RTN = LoadWord(m_RAM + lcl - (sizeof(int32) * 4));
+			lcl = LoadWord(m_RAM + lcl - (sizeof(int32) * 3));
+			RVM_FRAME();
+			RVM_GOTO(ret);
+		}
+			RVM_NEXT();
+
+		RVM_CASE(PRINT)
+		{
+			uint32 size = LoadWord(m_RAM + sp);
+			sp -= sizeof(int32);
+			int32 first = sp - static_cast<int32>(size * sizeof(int32)) + static_cast<int32>(sizeof(int32));
+			for(int32 address = first; address <= sp; address += sizeof(int32))
+			{
+				m_pOutput->Put(static_cast<char>(m_RAM[address]));
+			}
+			sp = first - static_cast<int32>(sizeof(int32));
+			bases[static_cast<uint8>(OperandKind::STACK)] = m_RAM + sp;
+			++ip;
+		}
+			RVM_NEXT();
+		RVM_CASE(PRINT_CONSTANT)
+		{
+			const char* characters = code.GetStrings() + ip->a.offset;
+			for(uint32 character = 0; character < ip->target; ++character) m_pOutput->Put(characters[character]);
+			++ip;
+		}
+			RVM_NEXT();
+		RVM_CASE(PRINT_INT)
+			m_pOutput->WriteInt(RVM_READ(ip->a));
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(PRINT_ENDL)
+			m_pOutput->Put('\n');
+			++ip;
+			RVM_NEXT();
+		RVM_CASE(FLUSH)
+			m_pOutput->Flush();
+			++ip;
+			RVM_NEXT();
+
+		RVM_CASE(HALT)
+			RVM_END(RunStatus::FINISHED);
+		RVM_CASE(FRAME)
+			std::cerr << "[VM] Entered function at " << ip->address << " without a CALL" << std::endl;
+			RVM_FAIL();
+		RVM_CASE(INVALID)
+#ifndef VM_THREADED_DISPATCH
+		default:
+#endif
+			std::cerr << "Invalid opcode at " << ip->address << std::endl;
+			RVM_FAIL();
+#ifndef VM_THREADED_DISPATCH
+		}
+	}
+#endif
+
+	#undef RVM_CASE
+	#undef RVM_NEXT
+	#undef RVM_CALL
+	#undef RVM_GOTO
+	#undef RVM_FAIL
+	#undef RVM_END
+	#undef RVM_FRAME
+	#undef RVM_PUSH
+	#undef RVM_MOVE_SP
+	#undef RVM_WRITE
+	#undef RVM_READ
+}
+
+template RunStatus VirtualMachine::ExecuteRegisters<true>(uint64 &dispatches);
+template RunStatus VirtualMachine::ExecuteRegisters<false>(uint64 &dispatches);
@@ -0,0 +1,60 @@
+#include "SequenceProfiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+SequenceProfiler::SequenceProfiler()
+	:m_PairCounts(OPCODE_COUNT * OPCODE_COUNT, 0)
+	,m_TripleCounts(OPCODE_COUNT * OPCODE_COUNT * OPCODE_COUNT, 0)
+{
+}
+
+bool SequenceProfiler::Save(const std::string &filename) const
+{
+	struct Sequence
+	{
+		uint64 count;
+		uint32 length;
+		uint32 index;
+	};
+	std::vector<Sequence> sequences;
+	for(uint32 i = 0; i < m_PairCounts.size(); ++i)
+	{
+		if(m_PairCounts[i] > 0) sequences.push_back(Sequence{m_PairCounts[i], 2, i});
+	}
+	for(uint32 i = 0; i < m_TripleCounts.size(); ++i)
+	{
+		if(m_TripleCounts[i] > 0) sequences.push_back(Sequence{m_TripleCounts[i], 3, i});
+	}
+	std::sort(sequences.begin(), sequences.end(), [](const Sequence &a, const Sequence &b)
+	{
+		return a.count > b.count;
+	});
+
+	std::ofstream output(filename);
+	if(!(output.good()))
+	{
+		std::cerr << "[PROFILE] File " << filename << " could not be created" << std::endl;
+		return false;
+	}
+	output << "//Opcode sequence profile: [length] [executions] [opcodes]\n";
+	for(const auto &sequence : sequences)
+	{
+		output << sequence.length << ' ' << sequence.count;
+		std::vector<uint32> ops;
+		uint32 index = sequence.index;
+		for(uint32 i = 0; i < sequence.length; ++i)
+		{
+			ops.push_back(index % OPCODE_COUNT);
+			index /= OPCODE_COUNT;
+		}
+		for(auto op = ops.rbegin(); op != ops.rend(); ++op)
+		{
+			output << ' ' << GetOpString(static_cast<Opcode>(*op));
+		}
+		output << '\n';
+	}
+	std::cout << "[PROFILE] " << sequences.size() << " sequences saved to " << filename << std::endl;
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "Opcode.h"
+
+class VirtualMachine;
+
+//Execution hooks counting how often each pair and triple of adjacent opcodes executes.
+//Only instructions that follow each other in the code segment are counted as a sequence,
+//since those are the ones the assembler can fuse into a superinstruction
+class SequenceProfiler
+{
+public:
+	static const bool SYNC_STATE = false;
+
+	SequenceProfiler();
+
+	inline void OnInstruction(const VirtualMachine&, uint32 index, Opcode code);
+
+	bool Save(const std::string &filename) const;
+
+private:
+	inline void Record(Opcode code);
+
+	uint32 m_NextIndex = 0;		//Decoded index of the instruction following the previous one
+	Opcode m_History[2];
+	uint32 m_HistorySize = 0;
+
+	std::vector<uint64> m_PairCounts;
+	std::vector<uint64> m_TripleCounts;
+};
+
+void SequenceProfiler::OnInstruction(const VirtualMachine&, uint32 index, Opcode code)
+{
+	//Reached through a jump, call or return
+	if(index != m_NextIndex) m_HistorySize = 0;
+
+	//Superinstructions count as their parts, so profiles stay valid across superinstruction sets
+	const Superinstruction* fused = GetSuperinstruction(code);
+	if(fused)
+	{
+		for(uint32 part = 0; part < fused->length; ++part) Record(fused->parts[part]);
+		m_NextIndex = index + fused->length;
+		return;
+	}
+	Record(code);
+	m_NextIndex = index + 1;
+}
+
+void SequenceProfiler::Record(Opcode code)
+{
+	uint32 op = static_cast<uint32>(code);
+	if(op >= OPCODE_COUNT)
+	{
+		m_HistorySize = 0;
+		return;
+	}
+	if(m_HistorySize >= 1)
+	{
+		uint32 prev = static_cast<uint32>(m_History[1]);
+		++m_PairCounts[prev * OPCODE_COUNT + op];
+		if(m_HistorySize >= 2)
+		{
+			uint32 first = static_cast<uint32>(m_History[0]);
+			++m_TripleCounts[(first * OPCODE_COUNT + prev) * OPCODE_COUNT + op];
+		}
+	}
+	m_History[0] = m_History[1];
+	m_History[1] = code;
+	if(m_HistorySize < 2) ++m_HistorySize;
+}
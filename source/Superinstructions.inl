@@ -0,0 +1,11 @@
+//Generated by SuperinstructionGen from Programs/Profiles/Functions.prof, do not edit
+//Included with SUPERINSTRUCTION2(name, a, b) and SUPERINSTRUCTION3(name, a, b, c) defined
+//Comments hold the profiled executions and the dispatches saved on top of the superinstructions above
+SUPERINSTRUCTION3(LESS__NOT__JMP_IF_I, LESS, NOT, JMP_IF_I) //31 62
+SUPERINSTRUCTION2(LOAD_LCL_I__LOAD_ARG_I, LOAD_LCL_I, LOAD_ARG_I) //59 59
+SUPERINSTRUCTION2(ADD__STORE_LCL_I, ADD, STORE_LCL_I) //56 56
+SUPERINSTRUCTION3(ADD__STORE_LCL_I__JMP_I, ADD, STORE_LCL_I, JMP_I) //28 28
+SUPERINSTRUCTION2(LOAD_LCL_I__LITERAL, LOAD_LCL_I, LITERAL) //28 28
+SUPERINSTRUCTION2(LITERAL__STORE_LCL_I, LITERAL, STORE_LCL_I) //6 6
+SUPERINSTRUCTION3(STORE_I__LOAD_I__LOAD_I, STORE_I, LOAD_I, LOAD_I) //3 6
+SUPERINSTRUCTION2(LOAD_ARG_I__LOAD_ARG_I, LOAD_ARG_I, LOAD_ARG_I) //3 3
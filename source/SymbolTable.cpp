@@ -1,75 +1,74 @@
 #include "SymbolTable.h"
+#include "WordFormat.h"
 
 #include <cassert>
 #include <iostream>
 
+const uint32 SymbolTable::NO_SYMBOL;
+const uint32 SymbolTable::NO_FUNCTION;
+
 SymbolTable::SymbolTable(uint32 stackSize)
 	:m_StackSize(stackSize)
 {
 	m_CurrentFunc = SymbolTable::Func();
 }
 
-bool SymbolTable::AddFunction(const std::string &name, std::string &arguments)
+uint32 SymbolTable::Intern(const char* text, uint32 length)
+{
+	m_Lookup.assign(text, length);
+	auto found = m_Names.find(m_Lookup);
+	if(found != m_Names.end()) return found->second;
+
+	uint32 name = static_cast<uint32>(m_Entries.size());
+	auto inserted = m_Names.emplace(m_Lookup, name);
+	Entry entry;
+	entry.name = &inserted.first->first;
+	m_Entries.push_back(entry);
+	return name;
+}
+
+bool SymbolTable::AddFunction(uint32 name)
 {
-	if(HasSymbol(name))
+	if(!Define(name))
 		return false;
 
 	//Add Symbol
 	auto sbl = SymbolTable::Symbol();
-	sbl.name = name;
+	sbl.name = m_Entries[name].name;
 	sbl.value = m_StackSize + m_NumInstructions;
 	sbl.type = SymbolType::FUNCTION;
 	m_Table.push_back(sbl);
 
 	//The following variables are not static anymore
-	SetParsingStatic(false, name);
-	m_NumInstructions += 8;//First two instructions are int32 numArgs and int32 numLoc
-	
-	//Also add function arguments (parameters)
-	while(!arguments.empty())
-	{
-		std::string arg;
-		std::size_t nDelim = arguments.find(' ', 1);
-		if(nDelim == std::string::npos)
-		{
-			arg = arguments;
-			arguments = std::string();
-		}
-		else
-		{
-			arg = arguments.substr(0, nDelim);
-			arguments = arguments.substr(nDelim+1);
-		}
-		if(!(AddVariable(arg, true))) return false;
-	}
+	SetParsingStatic(false, GetName(name));
+	//The function's counts are stored once the next one starts
+	m_Entries[name].function = static_cast<uint32>(m_FuncTable.size());
+	m_NumInstructions += 9;//FRAME opcode followed by int32 numArgs and int32 numLoc
 	return true;
 }
 
-bool SymbolTable::AddLabel(const std::string &name)
+bool SymbolTable::AddLabel(uint32 name)
 {
-	if(HasSymbol(name))
+	if(!Define(name))
 		return false;
 	auto sbl = SymbolTable::Symbol();
-	sbl.name = name;
+	sbl.name = m_Entries[name].name;
 	sbl.value = m_StackSize + m_NumInstructions;
 	sbl.type = SymbolType::LABEL;
 	m_Table.push_back(sbl);
 	return true;
 }
 
-bool SymbolTable::AddVariable(const std::string &name, bool isArg)
+bool SymbolTable::AddVariable(uint32 name, bool isArg)
 {
-	if(HasSymbol(name))
+	if(isArg && m_ParsingStatic)
+		return false;//Static segments don't have arguments
+	if(!Define(name))
 		return false;
 	auto sbl = SymbolTable::Symbol();
-	sbl.name = name;
+	sbl.name = m_Entries[name].name;
 
-	if(isArg) 
-	{
-		if(m_ParsingStatic)
-			return false;//Static segments don't have arguments
-		sbl.type = SymbolType::ARG;
-	}
+	if(isArg) sbl.type = SymbolType::ARG;
 	else if(m_ParsingStatic) sbl.type = SymbolType::STATIC;
 	else sbl.type = SymbolType::LOCAL;
 	
@@ -101,7 +100,8 @@ void SymbolTable::SetParsingStatic(bool staticSection /*= true*/, std::string fu
 	if (!m_CurrentFunc.name.empty())
 	{
 		m_FuncTable.push_back(m_CurrentFunc);
-		std::cout << "[SYMBOL] function: " << m_CurrentFunc.name << "; args: " << m_CurrentFunc.numArg << "; vars: " << m_CurrentFunc.numLoc << std::endl;
+		if(m_Listing)
+			std::cout << "[SYMBOL] function: " << m_CurrentFunc.name << "; args: " << m_CurrentFunc.numArg << "; vars: " << m_CurrentFunc.numLoc << std::endl;
 	}
 	m_CurrentFunc = SymbolTable::Func();
 	m_CurrentFunc.name = functionName;
@@ -109,62 +109,85 @@ void SymbolTable::SetParsingStatic(bool staticSection /*= true*/, std::string fu
 
 void SymbolTable::AllocateStatic()
 {
-    std::cout << "[SYMBOL] Instruction count: " << m_NumInstructions << "; Symbols: " << std::endl;
-    uint32 staticBase = m_StackSize + m_NumInstructions;
+    m_StaticBase = AlignWord(m_StackSize + m_NumInstructions);
     for(auto & sbl : m_Table)
     {
         if(sbl.type == SymbolType::STATIC)
         {
-            sbl.value += staticBase;
+            sbl.value += m_StaticBase;
         }
-        std::cout << "[SYMBOL] name: " << sbl.name << "; value: " << sbl.value << std::endl;
+    }
+    if(!m_Listing) return;
+
+    std::cout << "[SYMBOL] Instruction count: " << m_NumInstructions << "; Symbols: " << std::endl;
+    for(const auto & sbl : m_Table)
+    {
+        //One flush for the whole listing, machine generated sources have 100k symbols and more
+        std::cout << "[SYMBOL] name: " << *sbl.name << "; value: " << sbl.value << "\n";
         if(sbl.type == SymbolType::FUNCTION)
         {
-			std::cout << "[SYMBOL]     instruction pointer: " << sbl.value - m_StackSize << std::endl;
+			std::cout << "[SYMBOL]     instruction pointer: " << sbl.value - m_StackSize << "\n";
         }
     }
+    std::cout.flush();
 }
 
-bool SymbolTable::HasSymbol(const std::string &name) const
+bool SymbolTable::Define(uint32 name)
 {
-	for(auto sbl : m_Table)
-	{
-		if(sbl.name == name) return true;
-	}
-	return false;
+	Entry &entry = m_Entries[name];
+	if(entry.symbol != NO_SYMBOL) return false;
+	entry.symbol = static_cast<uint32>(m_Table.size());
+	return true;
 }
 
-uint32 SymbolTable::GetValue(const std::string &name) const
+bool SymbolTable::HasSymbol(uint32 name) const
 {
-	for(auto sbl : m_Table)
-	{
-		if(sbl.name == name) return sbl.value;
-	}
-	std::cerr << "[SYMBOL] Could not find Symbol " << name << std::endl;
+	return m_Entries[name].symbol != NO_SYMBOL;
+}
+
+uint32 SymbolTable::GetValue(uint32 name) const
+{
+	const Entry &entry = m_Entries[name];
+	if(entry.symbol != NO_SYMBOL) return m_Table[entry.symbol].value;
+	std::cerr << "[SYMBOL] Could not find Symbol " << *entry.name << std::endl;
 	return 0;
 }
 
-uint32 SymbolTable::GetFunctionArgCount(const std::string &name) const
+SymbolType SymbolTable::GetType(uint32 name) const
 {
-	for(auto func : m_FuncTable)
-	{
-		if(func.name == name) return func.numArg;
-	}
-	std::cerr << "[SYMBOL] Could not find Function " << name << std::endl;
+	const Entry &entry = m_Entries[name];
+	if(entry.symbol != NO_SYMBOL) return m_Table[entry.symbol].type;
+	std::cerr << "[SYMBOL] Could not find Symbol " << *entry.name << std::endl;
+	return SymbolType::LABEL;
+}
+
+uint32 SymbolTable::GetFunctionArgCount(uint32 name) const
+{
+	const Entry &entry = m_Entries[name];
+	if(entry.function < m_FuncTable.size()) return m_FuncTable[entry.function].numArg;
+	std::cerr << "[SYMBOL] Could not find Function " << *entry.name << std::endl;
 	return 0;
 }
 
-uint32 SymbolTable::GetFunctionVarCount(const std::string &name) const
+uint32 SymbolTable::GetFunctionVarCount(uint32 name) const
 {
-	for(auto func : m_FuncTable)
-	{
-		if(func.name == name) return func.numLoc;
-	}
-	std::cerr << "[SYMBOL] Could not find Function " << name << std::endl;
+	const Entry &entry = m_Entries[name];
+	if(entry.function < m_FuncTable.size()) return m_FuncTable[entry.function].numLoc;
+	std::cerr << "[SYMBOL] Could not find Function " << *entry.name << std::endl;
 	return 0;
 }
 
 uint32 SymbolTable::GetStaticVarCount() const
 {
 	return m_StaticCounter;
+}
+
+std::vector<std::pair<std::string, uint32>> SymbolTable::GetFunctions() const
+{
+	std::vector<std::pair<std::string, uint32>> functions;
+	for(const auto &sbl : m_Table)
+	{
+		if(sbl.type == SymbolType::FUNCTION) functions.emplace_back(*sbl.name, sbl.value);
+	}
+	return functions;
 }
\ No newline at end of file
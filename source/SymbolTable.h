@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <utility>
+#include <unordered_map>
 
 #include "AtomicTypes.h"
 
@@ -13,36 +15,66 @@ enum class SymbolType : uint8
 	ARG
 };
 
+//Symbols share one namespace, functions also keep their argument and local counts. Names are interned once in a
+//hash map and symbols are added and looked up by the interned id, so lookups don't depend on the symbol count
 class SymbolTable
 {
 public:
 	SymbolTable(uint32 stackSize);
 
-	bool AddFunction(const std::string &name, std::string &arguments);
-	bool AddLabel(const std::string &name);
-	bool AddVariable(const std::string &name, bool isArg = false);
+	//Id of a name, the same for every occurrence whether or not a symbol is defined for it yet
+	uint32 Intern(const char* text, uint32 length);
+	const std::string& GetName(uint32 name) const { return *m_Entries[name].name; }
+
+	//Arguments are added after their function with AddVariable(name, true)
+	bool AddFunction(uint32 name);
+	bool AddLabel(uint32 name);
+	bool AddVariable(uint32 name, bool isArg = false);
 	
 	void SetParsingStatic(bool staticSection = true, std::string functionName = "");
 	void AllocateStatic();
+	//Whether functions and symbols are listed on stdout as they are allocated
+	void SetListing(bool listing){m_Listing = listing;}
 
-	bool HasSymbol(const std::string &name) const;
-	uint32 GetValue(const std::string &name) const;
-	uint32 GetFunctionArgCount(const std::string &name) const;
-	uint32 GetFunctionVarCount(const std::string &name) const;
+	bool HasSymbol(uint32 name) const;
+	uint32 GetValue(uint32 name) const;
+	SymbolType GetType(uint32 name) const;
+	//Address of the first static variable, valid after AllocateStatic
+	uint32 GetStaticBase() const {return m_StaticBase;}
+	uint32 GetFunctionArgCount(uint32 name) const;
+	uint32 GetFunctionVarCount(uint32 name) const;
 	uint32 GetStaticVarCount()const;
+	//Name and code address of every $function, in declaration order
+	std::vector<std::pair<std::string, uint32>> GetFunctions() const;
 
 	uint32 m_NumInstructions = 0;
 
 private:
 	uint32 m_StackSize;
 
+	static const uint32 NO_SYMBOL = 0xFFFFFFFF;
+	static const uint32 NO_FUNCTION = 0xFFFFFFFF;
+
+	//Index of a symbol in m_Table and of its function in m_FuncTable, per interned name
+	struct Entry
+	{
+		const std::string* name;	//Key in m_Names
+		uint32 symbol = NO_SYMBOL;
+		uint32 function = NO_FUNCTION;
+	};
+	//Claims an interned name for the next symbol, false if it is already taken
+	bool Define(uint32 name);
+
     struct Symbol
     {
-        std::string name;
+        const std::string* name;	//Key in m_Names
         uint32 value = 0;
 		SymbolType type;
     };
     std::vector<SymbolTable::Symbol> m_Table;
+	std::unordered_map<std::string, uint32> m_Names;
+	std::vector<Entry> m_Entries;
+	std::string m_Lookup;	//Reused for lookups of names that are not interned yet
 
 	struct Func
 	{
@@ -55,6 +87,9 @@ private:
 
 	bool m_ParsingStatic = true;
 	
+	bool m_Listing = true;
+	
 	//Base addresses for static / automatic memory allocation
 	uint32 m_StaticCounter = 0;
+	uint32 m_StaticBase = 0;
 };
@@ -0,0 +1,21 @@
+#include "Tracer.h"
+
+#include "VirtualMachine.h"
+
+void OpcodeTracer::OnInstruction(const VirtualMachine &vm, uint32 index, Opcode code)
+{
+	m_Stream << "[TRACE] " << vm.GetInstructionAddress(index) << ": " << GetOpString(code) << '\n';
+}
+
+void StateTracer::OnInstruction(const VirtualMachine &vm, uint32 index, Opcode code)
+{
+	int32 sp = vm.GetStackPointer();
+	m_Stream << "[TRACE] " << vm.GetInstructionAddress(index) << ": " << GetOpString(code)
+		<< " \tSP: " << sp << " LCL: " << vm.GetLocalBase() << " ARG: " << vm.GetArgumentBase() << " RTN: " << vm.GetReturnAddress()
+		<< " \tstack:";
+	for(int32 entry = 0; entry < STACK_WORDS && sp >= 0; ++entry, sp -= static_cast<int32>(sizeof(int32)))
+	{
+		m_Stream << ' ' << vm.ReadWord(static_cast<uint32>(sp));
+	}
+	m_Stream << '\n';
+}
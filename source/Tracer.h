@@ -0,0 +1,37 @@
+#pragma once
+#include <ostream>
+
+#include "AtomicTypes.h"
+#include "Opcode.h"
+
+class VirtualMachine;
+
+//Execution hooks printing every dispatched instruction with its bytecode address
+class OpcodeTracer
+{
+public:
+	static const bool SYNC_STATE = false;
+
+	explicit OpcodeTracer(std::ostream &stream) : m_Stream(stream) {}
+
+	void OnInstruction(const VirtualMachine &vm, uint32 index, Opcode code);
+
+private:
+	std::ostream &m_Stream;
+};
+
+//Execution hooks printing every dispatched instruction with the registers and the top of the stack
+class StateTracer
+{
+public:
+	static const bool SYNC_STATE = true;
+
+	explicit StateTracer(std::ostream &stream) : m_Stream(stream) {}
+
+	void OnInstruction(const VirtualMachine &vm, uint32 index, Opcode code);
+
+private:
+	static const int32 STACK_WORDS = 4;	//Stack entries printed, starting at the top
+
+	std::ostream &m_Stream;
+};
@@ -0,0 +1,76 @@
+#include "TranslatedRuntime.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+TranslatedRuntime::~TranslatedRuntime()
+{
+	m_Output.Flush();
+	std::free(m_RAM);
+}
+
+bool TranslatedRuntime::Init(uint32 heapBase, uint32 heapSize)
+{
+	heapSize = AlignWord(heapSize);
+	uint64 ramSize = static_cast<uint64>(heapBase) + HeapAllocator::META_WORD_COUNT * sizeof(uint32) + heapSize;
+	if(ramSize > static_cast<uint64>(std::numeric_limits<uint32>::max()))
+	{
+		std::cerr << "[VM] Program needs " << ramSize << " bytes of RAM, more than 32 bit addresses can reach" << std::endl;
+		return false;
+	}
+	//calloc leaves large blocks to zeroed pages the OS maps on first touch, like the interpreter's reserved RAM
+	m_RAM = static_cast<uint8*>(std::calloc(static_cast<size_t>(ramSize), 1));
+	if(m_RAM == nullptr)
+	{
+		std::cerr << "[VM] Could not reserve " << ramSize << " bytes of RAM" << std::endl;
+		return false;
+	}
+	if(!m_Heap.Init(m_RAM, heapBase, static_cast<uint32>(ramSize) - heapBase))
+	{
+		std::cerr << "[VM] Heap size " << heapSize << " can't hold a segment header" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+void TranslatedRuntime::Free(int32 address)
+{
+	switch(m_Heap.Free(static_cast<uint32>(address)))
+	{
+	case HeapAllocator::FreeResult::FREED:
+		break;
+	case HeapAllocator::FreeResult::DOUBLE_FREE:
+		std::cerr << "[VM] Warning, memory at " << address << " was already freed" << std::endl;
+		break;
+	case HeapAllocator::FreeResult::BAD_POINTER:
+		std::cerr << "[VM] Warning, " << address << " is not an allocated address, not freed" << std::endl;
+		break;
+	}
+}
+
+int32 TranslatedRuntime::Print(int32 sp)
+{
+	//Same as the interpreter: one character per word with the first one deepest
+	uint32 size = static_cast<uint32>(TranslatedLoad(m_RAM, sp));
+	sp -= sizeof(int32);
+	int32 first = sp - static_cast<int32>(size * sizeof(int32)) + static_cast<int32>(sizeof(int32));
+	for(int32 address = first; address <= sp; address += sizeof(int32))
+	{
+		m_Output.Put(static_cast<char>(m_RAM[address]));
+	}
+	return first - static_cast<int32>(sizeof(int32));
+}
+
+int TranslatedRuntime::Finish()
+{
+	m_Output.Flush();
+	return 0;
+}
+
+int TranslatedRuntime::Fail(const char* message, uint32 address)
+{
+	m_Output.Flush();
+	std::cerr << "[VM] " << message << " at " << address << std::endl;
+	return 1;
+}
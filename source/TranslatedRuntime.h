@@ -0,0 +1,58 @@
+#pragma once
+#include "AtomicTypes.h"
+#include "WordFormat.h"
+#include "HeapAllocator.h"
+#include "OutputSink.h"
+
+//Support for programs the translate command turned into C++. It owns the VM RAM with the interpreter's memory
+//layout, the heap and the program output. Translated code keeps the registers in locals and reaches RAM through a
+//local base pointer with the free functions below, so stores through it can't make the compiler reload anything.
+//Build a translated program together with TranslatedRuntime.cpp, HeapAllocator.cpp and OutputSink.cpp
+class TranslatedRuntime
+{
+public:
+	TranslatedRuntime() = default;
+	~TranslatedRuntime();
+	TranslatedRuntime(const TranslatedRuntime&) = delete;
+	TranslatedRuntime& operator=(const TranslatedRuntime&) = delete;
+
+	//Allocates RAM up to the heap and sets up the heap after it, both come from the executable header
+	bool Init(uint32 heapBase, uint32 heapSize);
+
+	uint8* GetRAM() { return m_RAM; }
+	OutputSink& GetOutput() { return m_Output; }
+
+	//ALLOC and FREE, Allocate returns 0 when the heap is full
+	uint32 Allocate(int32 size) { return m_Heap.Allocate(static_cast<uint32>(size)); }
+	void Free(int32 address);
+	//PRINT on the stack in RAM, returns the stack pointer after popping the count and the characters
+	int32 Print(int32 sp);
+
+	//Exit codes of the translated program: the program ended, or was stopped by a runtime error
+	int Finish();
+	int Fail(const char* message, uint32 address);
+
+private:
+	uint8* m_RAM = nullptr;
+	HeapAllocator m_Heap;
+	StdoutSink m_Output;
+};
+
+inline int32 TranslatedLoad(const uint8* ram, uint32 address)
+{
+	return static_cast<int32>(LoadWord(ram + address));
+}
+inline void TranslatedStore(uint8* ram, uint32 address, int32 value)
+{
+	StoreWord(ram + address, static_cast<uint32>(value));
+}
+
+//VM arithmetic wraps around
+inline int32 TranslatedAdd(int32 a, int32 b)
+{
+	return static_cast<int32>(static_cast<uint32>(a) + static_cast<uint32>(b));
+}
+inline int32 TranslatedSub(int32 a, int32 b)
+{
+	return static_cast<int32>(static_cast<uint32>(a) - static_cast<uint32>(b));
+}
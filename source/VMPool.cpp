@@ -0,0 +1,123 @@
+#include "VMPool.h"
+
+#include <chrono>
+
+#include "VirtualMachine.h"
+
+namespace
+{
+	//Lets Submit keep jobs from a worker on that worker's own deque
+	thread_local const VMPool* s_pCurrentPool = nullptr;
+	thread_local uint32 s_CurrentWorker = 0;
+}
+
+VMPool::VMPool(uint32 threadCount)
+{
+	if(threadCount == 0) threadCount = std::thread::hardware_concurrency();
+	if(threadCount == 0) threadCount = 1;
+	for(uint32 index = 0; index < threadCount; ++index) m_Workers.emplace_back(new Worker());
+	//Start the threads only once every deque exists, they steal from all of them
+	for(uint32 index = 0; index < threadCount; ++index)
+	{
+		m_Workers[index]->thread = std::thread(&VMPool::WorkerLoop, this, index);
+	}
+}
+
+VMPool::~VMPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		m_Stopping = true;
+	}
+	m_Wake.notify_all();
+	for(auto &worker : m_Workers) worker->thread.join();
+}
+
+std::future<VMJobResult> VMPool::Submit(VMJob job)
+{
+	auto task = std::make_shared<std::packaged_task<VMJobResult()>>([job]() { return Execute(job); });
+	std::future<VMJobResult> result = task->get_future();
+
+	//Counted before it is pushed, so a worker taking it right away never counts the pending tasks below zero
+	{
+		std::lock_guard<std::mutex> lock(m_WakeMutex);
+		++m_Pending;
+	}
+	uint32 index = s_pCurrentPool == this ? s_CurrentWorker : m_NextWorker.fetch_add(1) % GetThreadCount();
+	{
+		Worker &worker = *m_Workers[index];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.emplace_back([task]() { (*task)(); });
+	}
+	m_Wake.notify_one();
+	return result;
+}
+
+VMJobResult VMPool::Execute(const VMJob &job)
+{
+	VMJobResult result;
+	auto start = std::chrono::steady_clock::now();
+
+	VirtualMachine vm;
+	vm.SetHeapSize(job.heapSize);
+	if(!vm.SetProgram(job.image)) return result;
+	MemorySink captured;
+	NullSink discarded;
+	if(job.captureOutput) vm.SetOutput(&captured);
+	else vm.SetOutput(&discarded);
+	result.succeeded = vm.Interpret() == RunStatus::FINISHED;
+	if(job.captureOutput) result.output = captured.GetContents();
+	result.durationNs = static_cast<uint64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+	return result;
+}
+
+void VMPool::WorkerLoop(uint32 index)
+{
+	s_pCurrentPool = this;
+	s_CurrentWorker = index;
+	for(;;)
+	{
+		Task task;
+		if(PopTask(index, task) || StealTask(index, task))
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_WakeMutex);
+				--m_Pending;
+			}
+			task();
+			continue;
+		}
+
+		//A task can be counted before Submit pushed it, then this just looks again
+		std::unique_lock<std::mutex> lock(m_WakeMutex);
+		m_Wake.wait(lock, [this]() { return m_Pending != 0 || m_Stopping; });
+		if(m_Pending == 0 && m_Stopping) return;
+	}
+}
+
+bool VMPool::PopTask(uint32 index, Task &task)
+{
+	//Newest first, its program is most likely still in this core's caches
+	Worker &worker = *m_Workers[index];
+	std::lock_guard<std::mutex> lock(worker.mutex);
+	if(worker.tasks.empty()) return false;
+	task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+	return true;
+}
+
+bool VMPool::StealTask(uint32 thief, Task &task)
+{
+	//Oldest first, starting at the next worker so thieves spread out
+	uint32 count = GetThreadCount();
+	for(uint32 offset = 1; offset < count; ++offset)
+	{
+		Worker &victim = *m_Workers[(thief + offset) % count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if(victim.tasks.empty()) continue;
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
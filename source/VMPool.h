@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AtomicTypes.h"
+#include "ProgramImage.h"
+
+//A program run to submit to the pool. The VM has no input channel, so a job is the program and the settings of its context
+struct VMJob
+{
+	std::shared_ptr<const ProgramImage> image;
+	uint32 heapSize = 0;			//0 uses the heap size from the executable header
+	bool captureOutput = false;		//Otherwise the output is discarded
+};
+
+struct VMJobResult
+{
+	bool succeeded = false;			//False if the VM couldn't be set up for the program or a runtime error stopped it
+	std::string output;				//Program output if the job captured it
+	uint64 durationNs = 0;
+};
+
+//Runs jobs on a fixed set of worker threads, each job in a VM context of its own. Every worker has a deque of tasks:
+//it takes the newest task from its own deque and steals the oldest from the others when that is empty.
+//Jobs submitted from outside are spread over the workers round robin, jobs submitted from a worker stay with it
+class VMPool
+{
+public:
+	//0 threads uses one per hardware thread
+	explicit VMPool(uint32 threadCount = 0);
+	//Finishes every submitted job before joining the workers
+	~VMPool();
+	VMPool(const VMPool&) = delete;
+	VMPool& operator=(const VMPool&) = delete;
+
+	std::future<VMJobResult> Submit(VMJob job);
+
+	uint32 GetThreadCount() const { return static_cast<uint32>(m_Workers.size()); }
+
+	static VMJobResult Execute(const VMJob &job);
+
+private:
+	using Task = std::function<void()>;
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+
+	void WorkerLoop(uint32 index);
+	bool PopTask(uint32 index, Task &task);
+	bool StealTask(uint32 thief, Task &task);
+
+	std::vector<std::unique_ptr<Worker>> m_Workers;
+	std::atomic<uint32> m_NextWorker{0};
+
+	//Sleeping workers wait for the pending count to rise
+	std::mutex m_WakeMutex;
+	std::condition_variable m_Wake;
+	uint64 m_Pending = 0;
+	bool m_Stopping = false;
+};
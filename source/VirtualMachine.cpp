@@ -1,422 +1,673 @@
 #include "VirtualMachine.h"
 
-#include <fstream>
-#include <iterator>
 #include <cassert>
 #include <iostream>
 
 #include "Opcode.h"
 #include "AtomicTypes.h"
+#include "SequenceProfiler.h"
+#include "Tracer.h"
+#include "ExecutionProfiler.h"
+#include "WordFormat.h"
 #include <limits>
+#include <cstring>
+#include <type_traits>
+
+#ifdef PLATFORM_Win
+        #include <windows.h>
+#else
+        #include <sys/mman.h>
+#endif
 
 VirtualMachine::VirtualMachine()
 {
-        m_RAM = new uint8[MAX_RAM];
 }
 VirtualMachine::~VirtualMachine()
 {
-        delete[] m_RAM;
+        ReleaseRAM();
 }
 
-bool VirtualMachine::LoadProgram(std::string filename)
+bool VirtualMachine::ReserveRAM(uint32 size)
 {
-        std::ifstream file( filename, std::ios::binary );
-        if(!file.good())
+        ReleaseRAM();
+        //The guard word below address 0 holds the cached top of stack slot while the stack is empty
+        size_t blockSize = static_cast<size_t>(size) + STACK_GUARD_SIZE;
+#ifdef PLATFORM_Win
+        //Committed pages only get physical memory once they are touched
+        void* pBlock = VirtualAlloc(nullptr, blockSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if(pBlock == nullptr)
+#else
+        void* pBlock = mmap(nullptr, blockSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(pBlock == MAP_FAILED)
+#endif
         {
-                std::cerr << "[VM] Could not open bytecode executable" << std::endl;
+                std::cerr << "[VM] Could not reserve " << size << " bytes of RAM" << std::endl;
                 return false;
         }
-
-        file.unsetf(std::ios::skipws);
-
-        // get its size:
-        std::streampos fileSize;
-
-        file.seekg(0, std::ios::end);
-        fileSize = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        // reserve capacity
-        std::vector<uint8> bytecode;
-        bytecode.reserve(static_cast<uint32>(fileSize));
-
-        // read the data:
-        bytecode.insert(bytecode.begin(),
-                        std::istream_iterator<uint8>(file),
-                        std::istream_iterator<uint8>());
-
-        SetProgram(bytecode);
-
+        m_RAMBlock = static_cast<uint8*>(pBlock);
+        m_RAM = m_RAMBlock + STACK_GUARD_SIZE;
+        m_RAMSize = size;
         return true;
 }
-void VirtualMachine::SetProgram(std::vector<uint8> bytecode)
+void VirtualMachine::ReleaseRAM()
 {
-        uint32 headerSize = sizeof(uint32)*2;
-        m_StackSize = Unpack<uint32>(0, bytecode);
-        auto numStaticVars = Unpack<uint32>(1 * sizeof(uint32), bytecode);
+        if(m_RAMBlock == nullptr) return;
+#ifdef PLATFORM_Win
+        VirtualFree(m_RAMBlock, 0, MEM_RELEASE);
+#else
+        munmap(m_RAMBlock, static_cast<size_t>(m_RAMSize) + STACK_GUARD_SIZE);
+#endif
+        m_RAMBlock = nullptr;
+        m_RAM = nullptr;
+        m_RAMSize = 0;
+}
 
-        m_NumInstructions = bytecode.size()- headerSize; //Header size for now
-        m_StaticBase = m_NumInstructions + m_StackSize;
-        for(uint32 i = 0; i < m_NumInstructions; ++i)
+bool VirtualMachine::LoadProgram(const std::string &filename)
+{
+        auto image = std::make_shared<ProgramImage>();
+        if(!image->Load(filename)) return false;
+        return SetProgram(image);
+}
+bool VirtualMachine::SetProgram(const uint8* bytecode, size_t size)
+{
+        auto image = std::make_shared<ProgramImage>();
+        if(!image->SetBytecode(bytecode, size)) return false;
+        return SetProgram(image);
+}
+bool VirtualMachine::SetProgram(std::shared_ptr<const ProgramImage> image)
+{
+        ProgramLoaded = false;
+        if(!image || !image->IsLoaded())
         {
-                m_RAM[i+m_StackSize] = bytecode[i+ headerSize];
+                std::cerr << "[VM] Program image is not loaded" << std::endl;
+                return false;
+        }
+        m_StackSize = image->GetStackSize();
+        m_StaticBase = image->GetStaticBase();
+        m_HeapBase = image->GetHeapBase();
+
+        uint32 heapSize = AlignWord(m_HeapSizeOverride != 0 ? m_HeapSizeOverride : image->GetHeapSize());
+        if(heapSize < HeapAllocator::MIN_BLOCK_SIZE)
+        {
+                std::cerr << "[VM] Heap size " << heapSize << " can't hold a heap block, it needs at least " << HeapAllocator::MIN_BLOCK_SIZE << " bytes" << std::endl;
+                return false;
+        }
+
+        //VM addresses are 32 bit
+        uint64 ramSize = static_cast<uint64>(m_HeapBase) + HeapAllocator::META_WORD_COUNT * sizeof(uint32) + heapSize;
+        if(ramSize > static_cast<uint64>(std::numeric_limits<uint32>::max()))
+        {
+                std::cerr << "[VM] Program needs " << ramSize << " bytes of RAM, more than 32 bit addresses can reach" << std::endl;
+                return false;
         }
+        if(!ReserveRAM(static_cast<uint32>(ramSize))) return false;
+        m_pImage = std::move(image);
+        m_Code = m_pImage->GetCode();
+        m_BoundTable = nullptr;
+
+        //Fresh registers, the stack starts out empty
+        m_ProgramCounter = 0;
+        m_ResumeIndex = m_pImage->GetEntryIndex();
+        m_Ended = false;
+#ifdef VM_JIT
+        uint32 instructionCount = m_JitThreshold != 0 ? m_pImage->GetInstructionCount() : 0;
+        m_HotCounts.assign(instructionCount, 0);
+        m_JitEntries.assign(instructionCount, nullptr);
+#endif
+        m_StackPointer = -4;
+        m_LCL = 0;
+        m_ARG = 0;
+        m_RTN = 0;
+        m_THIS = 0;
 
         //Initialize Dynamic memory allocation
-        m_FirstSegmentPtr = m_StaticBase + numStaticVars;
-        m_HeapBase = m_FirstSegmentPtr+sizeof(uint32);
-        Pack<uint32>(m_FirstSegmentPtr, m_HeapBase);
-        Pack<uint32>(m_HeapBase, MAX_RAM - m_HeapBase);
-        Pack<uint32>(m_HeapBase + sizeof(uint32), 0);
+        if(!m_Heap.Init(m_RAM, m_HeapBase, static_cast<uint32>(ramSize) - m_HeapBase))
+        {
+                std::cerr << "[VM] Heap of " << heapSize << " bytes could not be initialized" << std::endl;
+                return false;
+        }
 
   #ifdef VM_DEBUG_HEAP
-        PrintHeap();
+        m_Heap.Print(std::cout);
   #endif
 
         ProgramLoaded = true;
+        return true;
+}
+
+//Semantics of the instructions that can be fused into superinstructions, shared by their single opcode handler
+//and the generated superinstruction handlers. "in" holds the operands, "next" is the instruction that follows
+#ifdef VM_CACHE_TOS
+//The top of stack lives in the local tos and sp holds the address of its slot, which is stale in RAM.
+//Instructions that need the stack in memory write it back with VM_SYNC_STACK and reload it afterwards
+#define VM_PUSH(value) \
+        { \
+                int32 pushed = (value); \
+                assert(sp + static_cast<int32>(sizeof(int32)) < static_cast<int32>(m_StackSize)); /*Stack Overflow*/ \
+                StoreStackWord(sp, tos); \
+                sp += sizeof(int32); \
+                tos = pushed; \
+        }
+#define VM_POP() PopCached(tos, sp)
+#define VM_SYNC_STACK() { StoreStackWord(sp, tos); m_StackPointer = sp; }
+#define VM_RELOAD_STACK() { sp = m_StackPointer; tos = LoadStackWord(sp); }
+#else
+#define VM_PUSH(value) Push(value)
+#define VM_POP() Pop()
+#define VM_SYNC_STACK()
+#define VM_RELOAD_STACK()
+#endif
+
+#define VM_SEM_LITERAL(in, next) { VM_PUSH((in).immediate); ip = (next); }
+#define VM_SEM_STORE(in, next) { int32 address = VM_POP(); Pack<int32>(address, VM_POP()); ip = (next); }
+#define VM_SEM_STORE_LCL(in, next) { int32 address = m_LCL+VM_POP(); Pack<int32>(address, VM_POP()); ip = (next); }
+#define VM_SEM_LOAD_I(in, next) { VM_PUSH(Unpack<int32>((in).immediate)); ip = (next); }
+#define VM_SEM_STORE_I(in, next) { Pack<int32>((in).immediate, VM_POP()); ip = (next); }
+#define VM_SEM_LOAD_LCL_I(in, next) { VM_PUSH(Unpack<int32>(m_LCL+(in).immediate)); ip = (next); }
+#define VM_SEM_STORE_LCL_I(in, next) { Pack<int32>(m_LCL+(in).immediate, VM_POP()); ip = (next); }
+#define VM_SEM_LOAD_ARG_I(in, next) { VM_PUSH(Unpack<int32>(m_ARG+(in).immediate)); ip = (next); }
+#ifdef VM_CACHE_TOS
+//Operations on the top of stack work on the cached register in place
+#define VM_SEM_LOAD(in, next) { tos = Unpack<int32>(tos); ip = (next); }
+#define VM_SEM_LOAD_LCL(in, next) { tos = Unpack<int32>(m_LCL+tos); ip = (next); }
+#define VM_SEM_LOAD_ARG(in, next) { tos = Unpack<int32>(m_ARG+tos); ip = (next); }
+#define VM_SEM_BINARY(expression, next) { int32 b = tos; sp -= sizeof(int32); int32 a = LoadStackWord(sp); tos = (expression); ip = (next); }
+#define VM_SEM_NOT(in, next) { tos = !tos; ip = (next); }
+#else
+#define VM_SEM_LOAD(in, next) { VM_PUSH(Unpack<int32>(VM_POP())); ip = (next); }
+#define VM_SEM_LOAD_LCL(in, next) { VM_PUSH(Unpack<int32>(m_LCL+VM_POP())); ip = (next); }
+#define VM_SEM_LOAD_ARG(in, next) { VM_PUSH(Unpack<int32>(m_ARG+VM_POP())); ip = (next); }
+#define VM_SEM_BINARY(expression, next) { int32 b = VM_POP(); int32 a = VM_POP(); VM_PUSH(expression); ip = (next); }
+#define VM_SEM_NOT(in, next) { int32 a = VM_POP(); VM_PUSH(!a); ip = (next); }
+#endif
+#define VM_SEM_ADD(in, next) VM_SEM_BINARY(a + b, next)
+#define VM_SEM_SUB(in, next) VM_SEM_BINARY(a - b, next)
+#define VM_SEM_LESS(in, next) VM_SEM_BINARY(a < b, next)
+#define VM_SEM_GREATER(in, next) VM_SEM_BINARY(a > b, next)
+#define VM_SEM_EQUALS(in, next) VM_SEM_BINARY(a == b, next)
+//Branches can only end a superinstruction
+#define VM_SEM_JMP_I(in, next) { VM_BRANCH(in, &m_Code[(in).target]); }
+#define VM_SEM_JMP_IF_I(in, next) { if(VM_POP()) { VM_BRANCH(in, &m_Code[(in).target]); } else ip = (next); }
+
+//Instruction budget of Run. It is only charged when control leaves a straight run of instructions, with the length of
+//that run, and only checked at backward branches and calls, which every loop and recursion passes through.
+//Interpret instantiates the loop without a budget, where all of this compiles away
+#define VM_ACCOUNT(from) if(BUDGETED) { budget -= (&(from) - segment) + 1; }
+#define VM_SEGMENT() if(BUDGETED) { segment = ip; }
+#define VM_CHECK_BUDGET() if(BUDGETED && budget <= 0) { VM_YIELD(); }
+#define VM_BRANCH(from, to) \
+        { \
+                VM_ACCOUNT(from) \
+                const Instruction* branchTarget = (to); \
+                bool backward = branchTarget <= &(from); \
+                ip = branchTarget; \
+                VM_SEGMENT() \
+                if(backward) { VM_CHECK_BUDGET() VM_JIT_HOT() } \
+        }
+
+#ifdef VM_JIT
+//Interpreted code switches to native code at calls, returns and backward branches that land on a jit entry point.
+//Function bodies and loop heads reached often enough get their function compiled
+#define VM_JIT_ENTER() \
+        if(jit && m_JitEntries[ip - m_Code]) \
+        { \
+                VM_SYNC_STACK(); \
+                ip = &m_Code[RunJit(m_JitEntries[ip - m_Code])]; \
+                VM_RELOAD_STACK(); \
+        }
+#define VM_JIT_HOT() \
+        if(jit) \
+        { \
+                uint32 hotIndex = static_cast<uint32>(ip - m_Code); \
+                if(++m_HotCounts[hotIndex] == m_JitThreshold) CompileFunction(hotIndex); \
+                VM_JIT_ENTER() \
+        }
+#else
+#define VM_JIT_ENTER()
+#define VM_JIT_HOT()
+#endif
+
+RunStatus VirtualMachine::Interpret()
+{
+        NullHooks hooks;
+        return Execute<NullHooks, false>(hooks, 0);
+}
+
+template<typename THooks>
+RunStatus VirtualMachine::Interpret(THooks &hooks)
+{
+        return Execute<THooks, false>(hooks, 0);
+}
+
+RunStatus VirtualMachine::Run(uint64 maxInstructions)
+{
+        NullHooks hooks;
+        int64 budget = maxInstructions > static_cast<uint64>(std::numeric_limits<int64>::max()) ? std::numeric_limits<int64>::max() : static_cast<int64>(maxInstructions);
+        return Execute<NullHooks, true>(hooks, budget);
 }
 
-void VirtualMachine::Interpret()
+template<typename THooks, bool BUDGETED>
+RunStatus VirtualMachine::Execute(THooks &hooks, int64 budget)
 {
         if(!ProgramLoaded)
         {
                 std::cerr << "[VM] No program loaded" << std::endl;
-                return;
+                return RunStatus::ERROR;
         }
+        if(m_Ended) return m_Status;
+#ifdef VM_JIT
+        //Jitted code runs without hooks and can't stop for a budget
+        const bool jit = !BUDGETED && std::is_same<THooks, NullHooks>::value && !m_JitEntries.empty();
+#endif
 
-        m_ProgramCounter = m_StackSize;
-        while( m_ProgramCounter < m_StaticBase)
-        {
-                assert(m_ProgramCounter - m_StackSize < m_NumInstructions);
-
-                auto operation = static_cast<Opcode>(m_RAM[m_ProgramCounter]);
+#ifdef VM_CACHE_TOS
+        int32 sp;
+        int32 tos;
+        VM_RELOAD_STACK();
+#endif
 
-                std::cout << "[DBG] operation: " << GetOpString(operation) << std::endl;
+        #define VM_END(status) { VM_SYNC_STACK(); m_ProgramCounter = ip->address; m_Status = status; m_Ended = true; m_pOutput->Flush(); return status; }
+        #define VM_HALT() VM_END(RunStatus::FINISHED)
+        #define VM_FAIL() VM_END(RunStatus::ERROR)
+        #define VM_YIELD() \
+                { \
+                        VM_SYNC_STACK(); \
+                        m_ResumeIndex = static_cast<uint32>(ip - m_Code); \
+                        m_ProgramCounter = ip->address; \
+                        return RunStatus::BUDGET_EXHAUSTED; \
+                }
+        #define VM_HOOK() \
+                if(THooks::SYNC_STATE) { VM_SYNC_STACK(); } \
+                hooks.OnInstruction(*this, static_cast<uint32>(ip - m_Code), ip->operation)
+        #define VM_ENTER_FRAME(frame, ret) \
+                if(frame->operation != Opcode::FRAME) \
+                { \
+                        std::cerr << "[VM] Call target at " << frame->address << " is not a function" << std::endl; \
+                        VM_FAIL(); \
+                } \
+                VM_ACCOUNT(*ip) \
+                VM_SYNC_STACK(); \
+                Push(m_RTN); \
+                m_RTN = ret; \
+                Push(m_LCL); \
+                Push(m_ARG); \
+                Push(m_THIS); /*This stays the same because we are doing a function not a method*/ \
+                m_ARG = m_StackPointer - (frame->immediate + 12 /*difference from this to return*/); \
+                m_LCL = m_StackPointer + sizeof(int32); \
+                m_StackPointer = m_LCL + frame->target; \
+                VM_RELOAD_STACK(); \
+                ip = frame + 1; \
+                VM_SEGMENT() \
+                VM_CHECK_BUDGET() \
+                VM_JIT_HOT()
+
+#ifdef VM_THREADED_DISPATCH
+        //Direct threading: every decoded instruction carries the address of its handler
+        //and each handler ends in its own indirect jump to the next one
+        static const void* s_DispatchTable[] =
+        {
+                &&op_LITERAL, &&op_LITERAL_ARRAY,
+                &&op_LOAD, &&op_STORE, &&op_LOAD_LCL, &&op_STORE_LCL, &&op_LOAD_ARG,
+                &&op_LOAD_I, &&op_STORE_I, &&op_LOAD_LCL_I, &&op_STORE_LCL_I, &&op_LOAD_ARG_I,
+                &&op_ALLOC, &&op_FREE,
+                &&op_ADD, &&op_SUB,
+                &&op_LESS, &&op_GREATER, &&op_NOT, &&op_EQUALS,
+                &&op_JMP, &&op_JMP_IF, &&op_JMP_I, &&op_JMP_IF_I,
+                &&op_CALL, &&op_CALL_I, &&op_RETURN,
+                &&op_PRINT, &&op_PRINT_INT, &&op_PRINT_ENDL, &&op_FLUSH,
+                &&op_FRAME,
+        #define SUPERINSTRUCTION2(name, a, b) &&op_##name,
+        #define SUPERINSTRUCTION3(name, a, b, c) &&op_##name,
+        #include "Superinstructions.inl"
+        #undef SUPERINSTRUCTION2
+        #undef SUPERINSTRUCTION3
+                &&op_HALT, &&op_INVALID
+        };
+        static_assert(sizeof(s_DispatchTable)/sizeof(s_DispatchTable[0]) == static_cast<uint8>(Opcode::INVALID) + 1, "Dispatch table out of sync with Opcode");
+
+        //Bound once per instantiation, time slices of the same one go straight back to the stream
+        if(m_BoundTable != s_DispatchTable)
+        {
+                m_Code = m_pImage->GetCode(s_DispatchTable);
+                m_BoundTable = s_DispatchTable;
+        }
+        const Instruction* ip = &m_Code[m_ResumeIndex];
+        const Instruction* segment = ip;        //Start of the straight run the budget hasn't been charged for yet
+        (void)segment;
+
+        #define VM_CASE(op) op_##op:
+        #define VM_NEXT() \
+                VM_HOOK(); \
+                goto *ip->handler
+
+        VM_NEXT();
+#else
+        #define VM_CASE(op) case Opcode::op:
+        #define VM_NEXT() continue
+
+        const Instruction* ip = &m_Code[m_ResumeIndex];
+        const Instruction* segment = ip;        //Start of the straight run the budget hasn't been charged for yet
+        (void)segment;
+        for(;;)
+        {
+                VM_HOOK();
 
-                switch(operation)
+                switch(ip->operation)
                 {
+#endif
                 //MEMORY OPERATIONS
                 //Add a byte to the stack
-                case Opcode::LITERAL:
-                {
-                        Push(Unpack<int32>(++m_ProgramCounter));
-                        m_ProgramCounter+=sizeof(int32);
-                }
-                        continue;
+                VM_CASE(LITERAL)
+                        VM_SEM_LITERAL(*ip, ip + 1)
+                        VM_NEXT();
 
                 //Add multiple bytes to the stack
-                case Opcode::LITERAL_ARRAY:
+                VM_CASE(LITERAL_ARRAY)
                 {
-                        auto numValues = Unpack<int32>(++m_ProgramCounter);
-                        m_ProgramCounter+=sizeof(int32);
-                        while(numValues > 0)
+                        //The values are read from the image, the code segment isn't in RAM
+                        VM_SYNC_STACK();
+                        const uint8* values = m_pImage->GetCodeSegment() + ip->target;
+                        for(int32 numValues = ip->immediate; numValues > 0; --numValues)
                         {
-                                Push(Unpack<int32>(m_ProgramCounter));
-                                m_ProgramCounter+=sizeof(int32);
-                                --numValues;
+                                Push(static_cast<int32>(LoadWord(values)));
+                                values += sizeof(int32);
                         }
+                        VM_RELOAD_STACK();
+                        ++ip;
                 }
-                        continue;
+                        VM_NEXT();
 
                 //put memory at address on stack
-                case Opcode::LOAD:
-                {
-                        Push(Unpack<int32>(Pop()));
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(LOAD)
+                        VM_SEM_LOAD(*ip, ip + 1)
+                        VM_NEXT();
                 //store a in memory at b
-                case Opcode::STORE:
-                {
-                        int32 address = Pop();
-                        Pack<int32>(address, Pop());
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(STORE)
+                        VM_SEM_STORE(*ip, ip + 1)
+                        VM_NEXT();
                 //put memory at local address on stack
-                case Opcode::LOAD_LCL:
-                {
-                        Push(Unpack<int32>(m_LCL+Pop()));
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(LOAD_LCL)
+                        VM_SEM_LOAD_LCL(*ip, ip + 1)
+                        VM_NEXT();
                 //store a in memory at local b
-                case Opcode::STORE_LCL:
-                {
-                        int32 address = m_LCL+Pop();
-                        Pack<int32>(address, Pop());
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(STORE_LCL)
+                        VM_SEM_STORE_LCL(*ip, ip + 1)
+                        VM_NEXT();
                 //put memory at argument address on stack
-                case Opcode::LOAD_ARG:
-                {
-                        Push(Unpack<int32>(m_ARG+Pop()));
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(LOAD_ARG)
+                        VM_SEM_LOAD_ARG(*ip, ip + 1)
+                        VM_NEXT();
+
+                //put memory at immediate address on stack
+                VM_CASE(LOAD_I)
+                        VM_SEM_LOAD_I(*ip, ip + 1)
+                        VM_NEXT();
+                //store a in memory at immediate address
+                VM_CASE(STORE_I)
+                        VM_SEM_STORE_I(*ip, ip + 1)
+                        VM_NEXT();
+                //put memory at immediate local address on stack
+                VM_CASE(LOAD_LCL_I)
+                        VM_SEM_LOAD_LCL_I(*ip, ip + 1)
+                        VM_NEXT();
+                //store a in memory at immediate local address
+                VM_CASE(STORE_LCL_I)
+                        VM_SEM_STORE_LCL_I(*ip, ip + 1)
+                        VM_NEXT();
+                //put memory at immediate argument address on stack
+                VM_CASE(LOAD_ARG_I)
+                        VM_SEM_LOAD_ARG_I(*ip, ip + 1)
+                        VM_NEXT();
 
                 //Mark (a) bytes on the heap as used and push a pointer to the base
-                case Opcode::ALLOC:
+                VM_CASE(ALLOC)
                 {
-                        uint32 requestedSize = Pop();
-                        uint32 requiredSize = requestedSize + sizeof(uint32);//First 4 bytes of segment hold segment size -- maybe in future 4 more bytes for reference count
-
-                        auto firstSegment = Unpack<uint32>(m_FirstSegmentPtr);
-                        uint32 nextSegment = firstSegment;
-
-                        uint32 bestFitSize = std::numeric_limits<uint32>::max();
-                        uint32 bestFitPtr = 0;
-                        uint32 prevNextPtr = m_FirstSegmentPtr;
-
-                        //Get best fitting segment
-                        bool earlyOut = false;
-                        while (nextSegment != 0 && !earlyOut)
-                        {
-                                auto segmentSize = Unpack<uint32>(nextSegment);
-                                if (segmentSize >= requiredSize && segmentSize < bestFitSize)
-                                {
-                                        if (segmentSize == requiredSize) earlyOut = true;
-                                        bestFitPtr = nextSegment;
-                                        bestFitSize = segmentSize;
-                                        if(nextSegment != firstSegment) prevNextPtr = nextSegment + sizeof(uint32);
-                                }
-                                nextSegment = Unpack<uint32>(nextSegment + sizeof(uint32));
-                        }
-                        if (bestFitPtr == 0)
+                        uint32 address = m_Heap.Allocate(VM_POP());
+                        if (address == 0)
                         {
                                 std::cerr << "[VM] Out of Memory Exception, could not allocate space for variable!" << std::endl;
-                                return;
-                        }
-                        //use best found segment
-                        uint32 remainingSize = bestFitSize - requiredSize;
-                        if (remainingSize >= sizeof(uint32)*2)//Split segment in two if the remainder is big enough to allocate (ie its bigger than a segment header)
-                        {
-                                uint32 newSegPtr = bestFitPtr + requiredSize;
-                                Pack<uint32>(newSegPtr, remainingSize); //set the new segment size
-                                Pack<uint32>(newSegPtr + sizeof(uint32), Unpack<uint32>(bestFitPtr+sizeof(uint32))); //set the new segments nextPtr to the value of the allocated segments next ptr
-                                Pack<uint32>(prevNextPtr, newSegPtr);//Link the previous segment to the new segment
-
-                                Pack<uint32>(bestFitPtr, requiredSize); //Tell the allocated segment how big it is
-                        }
-                        else //Allocate the entire segment
-                        {
-                                Pack<uint32>(prevNextPtr, Unpack<uint32>(bestFitPtr+sizeof(uint32)));//Link the previous segment to next segment
+                                VM_FAIL();
                         }
-                        Push(bestFitPtr+sizeof(uint32));
-                        ++m_ProgramCounter;
+                        VM_PUSH(address);
+                        ++ip;
 
         #ifdef VM_DEBUG_HEAP
-                        PrintHeap();
+                        m_Heap.Print(std::cout);
         #endif
                 }
-                        continue;
-                //Mark the space at (a) as unused
-                case Opcode::FREE:
+                        VM_NEXT();
+                //Mark the space at (a) as unused, invalid frees are reported and skipped
+                VM_CASE(FREE)
                 {
-                        uint32 segmentPtr = Pop()-sizeof(uint32);
-                        auto segmentSize = Unpack<uint32>(segmentPtr);
-
-                        uint32 existingNextPtr = m_FirstSegmentPtr;
-                        auto nextSegment = Unpack<uint32>(existingNextPtr);
-                        uint32 existingSegment = existingNextPtr;
-
-                        bool earlyOut = false;
-                        while (nextSegment != 0 && !earlyOut)
-                        {
-                                if (segmentPtr < nextSegment)
-                                {
-                                        //insert
-                                        bool standalone = true;
-                                        if ((nextSegment != m_FirstSegmentPtr) && (existingSegment + Unpack<uint32>(existingSegment) == segmentPtr))//Merge EXISTING+INSERTED
-                                        {
-                                                //simply expand the existing segment to accomodate our size
-                                                segmentPtr = existingSegment;
-                                                segmentSize += Unpack<uint32>(existingSegment);
-                                                Pack<uint32>(segmentPtr, segmentSize);
-                                                standalone = false;
-                                        }
-                                        else
-                                        {
-                                                Pack<uint32>(segmentPtr + sizeof(uint32), nextSegment);//next = existing.next
-                                                Pack<uint32>(existingNextPtr, segmentPtr); //existing.next = this
-                                        }
-                                        if (segmentPtr + segmentSize == nextSegment)//Merge INSERTED+NEXT
-                                        {
-                                                segmentSize += Unpack<uint32>(nextSegment);
-                                                Pack<uint32>(segmentPtr, segmentSize);
-                                                Pack<uint32>(segmentPtr + sizeof(uint32), Unpack<uint32>(nextSegment + sizeof(uint32))); //next = next.next
-                                        }
-                                        else if(standalone) Pack<uint32>(segmentPtr + sizeof(uint32), nextSegment);
-                                        earlyOut = true;
-                                }
-                                existingSegment = nextSegment;
-                                existingNextPtr = existingSegment + sizeof(uint32);
-                                nextSegment = Unpack<uint32>(existingNextPtr);
-                        }
-                        if (!earlyOut)
+                        uint32 address = VM_POP();
+                        switch (m_Heap.Free(address))
                         {
-                                std::cerr << "[VM] Failed to free memory at " << segmentPtr << "; " << segmentSize << " bytes" << std::endl;
-                                return;
+                        case HeapAllocator::FreeResult::FREED:
+                                break;
+                        case HeapAllocator::FreeResult::DOUBLE_FREE:
+                                std::cerr << "[VM] Warning, memory at " << address << " was already freed" << std::endl;
+                                break;
+                        case HeapAllocator::FreeResult::BAD_POINTER:
+                                std::cerr << "[VM] Warning, " << address << " is not an allocated address, not freed" << std::endl;
+                                break;
                         }
-                        ++m_ProgramCounter;
+                        ++ip;
 
         #ifdef VM_DEBUG_HEAP
-                        PrintHeap();
+                        m_Heap.Print(std::cout);
         #endif
                 }
-                        continue;
+                        VM_NEXT();
 
                 //ARITHMETIC OPERATIONS
                 //Add values together
-                case Opcode::ADD:
-                {
-                        int32 b = Pop();
-                        int32 a = Pop();
-                        Push(a + b);
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(ADD)
+                        VM_SEM_ADD(*ip, ip + 1)
+                        VM_NEXT();
                 //a - b
-                case Opcode::SUB:
-                {
-                        int32 b = Pop();
-                        int32 a = Pop();
-                        Push(a - b);
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(SUB)
+                        VM_SEM_SUB(*ip, ip + 1)
+                        VM_NEXT();
 
                 //LOGICAL OPERATIONS
                 //a < b
-                case Opcode::LESS:
-                {
-                        int32 b = Pop();
-                        int32 a = Pop();
-                        Push(a < b);
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(LESS)
+                        VM_SEM_LESS(*ip, ip + 1)
+                        VM_NEXT();
                 //a > b
-                case Opcode::GREATER:
-                {
-                        int32 b = Pop();
-                        int32 a = Pop();
-                        Push(a > b);
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(GREATER)
+                        VM_SEM_GREATER(*ip, ip + 1)
+                        VM_NEXT();
                 //!a
-                case Opcode::NOT:
-                {
-                        int32 a = Pop();
-                        Push(!a);
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(NOT)
+                        VM_SEM_NOT(*ip, ip + 1)
+                        VM_NEXT();
                 //a == b
-                case Opcode::EQUALS:
-                {
-                        int32 b = Pop();
-                        int32 a = Pop();
-                        Push(a == b);
-                        ++m_ProgramCounter;
-                }
-                        continue;
+                VM_CASE(EQUALS)
+                        VM_SEM_EQUALS(*ip, ip + 1)
+                        VM_NEXT();
 
                 //FLOW CONTROL
                 //goto a
-                case Opcode::JMP:
+                VM_CASE(JMP)
                 {
-                        int32 address = Pop();
-                        m_ProgramCounter = static_cast<uint32>(address);
+                        VM_BRANCH(*ip, &m_Code[Resolve(static_cast<uint32>(VM_POP()))]);
                 }
-                        continue;
+                        VM_NEXT();
                 //if(a) goto b
-                case Opcode::JMP_IF:
+                VM_CASE(JMP_IF)
                 {
-                        int32 address = Pop();
-                        int32 condition = Pop();
+                        int32 address = VM_POP();
+                        int32 condition = VM_POP();
                         if(condition)
                         {
-                                m_ProgramCounter = static_cast<uint32>(address);
+                                VM_BRANCH(*ip, &m_Code[Resolve(static_cast<uint32>(address))]);
                         }
                         else
                         {
-                                ++m_ProgramCounter;
+                                ++ip;
                         }
                 }
-                        continue;
+                        VM_NEXT();
+
+                //goto immediate address
+                VM_CASE(JMP_I)
+                        VM_SEM_JMP_I(*ip, ip + 1)
+                        VM_NEXT();
+                //if(a) goto immediate address
+                VM_CASE(JMP_IF_I)
+                        VM_SEM_JMP_IF_I(*ip, ip + 1)
+                        VM_NEXT();
 
                 //FUNCTIONS
                 //put a new frame on the stack with n arguments and k local variables
-                case Opcode::CALL:
+                VM_CASE(CALL)
                 {
-                        uint32 ret = m_ProgramCounter + 1;
-                        m_ProgramCounter = static_cast<uint32>(Pop());
-                        Push(m_RTN);
-                        m_RTN = ret;
-                        Push(m_LCL);
-                        Push(m_ARG);
-                        Push(m_THIS); //This stays the same because we are doing a function not a method
-                        m_ARG = m_StackPointer - (Unpack<int32>(m_ProgramCounter) + 12 /*difference from this to return*/);
-                        m_ProgramCounter += sizeof(int32);
-                        m_LCL = m_StackPointer + sizeof(int32);
-                        m_StackPointer = m_LCL + Unpack<int32>(m_ProgramCounter);
-                        m_ProgramCounter += sizeof(int32);
+                        uint32 ret = ip->address + 1;
+                        const Instruction* frame = &m_Code[Resolve(static_cast<uint32>(VM_POP()))];
+                        VM_ENTER_FRAME(frame, ret);
                 }
-                        continue;
+                        VM_NEXT();
+                //call immediate address
+                VM_CASE(CALL_I)
+                {
+                        uint32 ret = ip->address + 1 + sizeof(int32);
+                        const Instruction* frame = &m_Code[ip->target];
+                        VM_ENTER_FRAME(frame, ret);
+                }
+                        VM_NEXT();
                 //Return from current function to previous function on stack and copy end values over
-                case Opcode::RETURN: //#todo stop assuming return value size
+                VM_CASE(RETURN) //#todo stop assuming return value size
                 {
-                        m_ProgramCounter = m_RTN;
+                        VM_SYNC_STACK();
+                        VM_ACCOUNT(*ip)
+                        ip = &m_Code[Resolve(m_RTN)];
+                        VM_SEGMENT()
                         Pack<int32>(m_ARG, Pop());
                         m_StackPointer = m_ARG;
                         m_THIS = Unpack<int32>(m_LCL - (sizeof(int32) * 1));
                         m_ARG = Unpack<int32>(m_LCL - (sizeof(int32) * 2));
                         m_RTN = Unpack<int32>(m_LCL - (sizeof(int32) * 4));
                         m_LCL = Unpack<int32>(m_LCL - (sizeof(int32) * 3));
+                        VM_RELOAD_STACK();
+                        VM_JIT_ENTER()
+                }
+                        VM_NEXT();
+                //function prologue, only valid as the target of CALL
+                VM_CASE(FRAME)
+                {
+                        std::cerr << "[VM] Entered function at " << ip->address << " without a CALL" << std::endl;
+                        VM_FAIL();
                 }
-                        continue;
 
                 //"Library functions" should later be implemented differently
                 //print x chars to console
-                case Opcode::PRINT:
+                VM_CASE(PRINT)
                 {
+                        //The characters are one per word with the first one deepest, written straight from the stack
+                        VM_SYNC_STACK();
                         uint32 size = Pop();
-                        std::string out;
-                        for(uint32 j = 0; j<size; ++j)
+                        int32 first = m_StackPointer - static_cast<int32>(size * sizeof(int32)) + static_cast<int32>(sizeof(int32));
+                        for(int32 address = first; address <= m_StackPointer; address += sizeof(int32))
                         {
-                                out = static_cast<char>(Pop()) + out;
+                                m_pOutput->Put(static_cast<char>(m_RAM[address])); //Low byte of the little endian word
                         }
-                        std::cout << out;
-                        ++m_ProgramCounter;
+                        m_StackPointer = first - static_cast<int32>(sizeof(int32));
+                        VM_RELOAD_STACK();
+                        ++ip;
                 }
-                        continue;
+                        VM_NEXT();
                 //print one integer to console
-                case Opcode::PRINT_INT:
+                VM_CASE(PRINT_INT)
                 {
-                        std::cout << Pop();
-                        ++m_ProgramCounter;
+                        m_pOutput->WriteInt(VM_POP());
+                        ++ip;
                 }
-                        continue;
+                        VM_NEXT();
                 //print one integer to console
-                case Opcode::PRINT_ENDL:
+                VM_CASE(PRINT_ENDL)
                 {
-                        std::cout << std::endl;
-                        ++m_ProgramCounter;
+                        m_pOutput->Put('\n');
+                        ++ip;
                 }
-                        continue;
+                        VM_NEXT();
+                //write buffered output through to its destination
+                VM_CASE(FLUSH)
+                {
+                        m_pOutput->Flush();
+                        ++ip;
+                }
+                        VM_NEXT();
+
+                //SUPERINSTRUCTIONS
+                //generated from an execution profile, each runs the semantics of its parts back to back
+        #define SUPERINSTRUCTION2(name, a, b) \
+                VM_CASE(name) \
+                { \
+                        const Instruction* in = ip; \
+                        VM_SEM_##a(in[0], in + 1) \
+                        VM_SEM_##b(in[1], in + 2) \
+                } \
+                        VM_NEXT();
+        #define SUPERINSTRUCTION3(name, a, b, c) \
+                VM_CASE(name) \
+                { \
+                        const Instruction* in = ip; \
+                        VM_SEM_##a(in[0], in + 1) \
+                        VM_SEM_##b(in[1], in + 2) \
+                        VM_SEM_##c(in[2], in + 3) \
+                } \
+                        VM_NEXT();
+        #include "Superinstructions.inl"
+        #undef SUPERINSTRUCTION2
+        #undef SUPERINSTRUCTION3
+
+                //end of the code segment reached
+                VM_CASE(HALT)
+                        VM_HALT();
 
                 //INVALID
+                VM_CASE(INVALID)
+#ifndef VM_THREADED_DISPATCH
                 default:
-                        std::cerr << "Invalid opcode: " << GetOpString(operation) << std::endl;
+#endif
+                        std::cerr << "Invalid opcode at " << ip->address << std::endl;
                         assert(false);
-                        continue;
+                        VM_FAIL();
+#ifndef VM_THREADED_DISPATCH
                 }
         }
+#endif
+
+        #undef VM_CASE
+        #undef VM_NEXT
+        #undef VM_END
+        #undef VM_HALT
+        #undef VM_FAIL
+        #undef VM_YIELD
+        #undef VM_ENTER_FRAME
+        #undef VM_HOOK
 }
 
+#ifdef VM_JIT
+void VirtualMachine::CompileFunction(uint32 index)
+{
+        const JitFunction* function = m_pImage->GetJitFunction(index);
+        if(function == nullptr) return;
+        for(const auto &entry : function->GetEntries()) m_JitEntries[entry.first] = entry.second;
+}
+
+uint32 VirtualMachine::RunJit(JitEntry entry)
+{
+        JitRegisters registers{m_StackPointer, m_LCL, m_ARG};
+        uint32 next = entry(m_RAM, &registers);
+        m_StackPointer = registers.stackPointer;
+        m_LCL = registers.localBase;
+        m_ARG = registers.argumentBase;
+        return next;
+}
+#endif
+
 void VirtualMachine::Push(int32 value)
 {
         assert(m_StackPointer + sizeof(int32) < m_StackSize); //Stack Overflow
@@ -430,67 +681,37 @@ int VirtualMachine::Pop()
         return value;
 }
 
-template<typename T>
-T VirtualMachine::Unpack(uint32 address)
+//Stack slots for the cached top of stack, sp can be -4 (the guard word) while the stack is empty
+int32 VirtualMachine::LoadStackWord(int32 sp)
 {
-#ifdef WORD_BIG_ENDIAN
-        uint32 value =  static_cast<uint8>(m_RAM[address+3]) << 24 |
-                       static_cast<uint8>(m_RAM[address+2]) << 16 |
-                       static_cast<uint8>(m_RAM[address+1]) << 8 |
-                       static_cast<uint8>(m_RAM[address+0]);
-#elif
-        uint32 value =  static_cast<uint8>(m_RAM[address+0]) << 24 |
-                       static_cast<uint8>(m_RAM[address+1]) << 16 |
-                       static_cast<uint8>(m_RAM[address+2]) << 8 |
-                       static_cast<uint8>(m_RAM[address+3]);
-#endif
-        return static_cast<T>(value);
+        return static_cast<int32>(LoadWord(m_RAM + sp));
+}
+void VirtualMachine::StoreStackWord(int32 sp, int32 value)
+{
+        StoreWord(m_RAM + sp, static_cast<uint32>(value));
 }
+int32 VirtualMachine::PopCached(int32 &tos, int32 &sp)
+{
+        assert(sp >= 0); //Stack underflow
+        int32 value = tos;
+        sp -= sizeof(int32);
+        tos = LoadStackWord(sp);
+        return value;
+}
+
 template<typename T>
-T VirtualMachine::Unpack(uint32 address, std::vector<uint8> data)
+T VirtualMachine::Unpack(uint32 address)
 {
-        assert(data.size() > address + 3);
-#ifdef WORD_BIG_ENDIAN
-        uint32 value =  static_cast<uint8>(data[address+3]) << 24 |
-                       static_cast<uint8>(data[address+2]) << 16 |
-                       static_cast<uint8>(data[address+1]) << 8 |
-                       static_cast<uint8>(data[address+0]);
-#elif
-        uint32 value =  static_cast<uint8>(data[address+0]) << 24 |
-                       static_cast<uint8>(data[address+1]) << 16 |
-                       static_cast<uint8>(data[address+2]) << 8 |
-                       static_cast<uint8>(data[address+3]);
-#endif
-        return static_cast<T>(value);
+        return static_cast<T>(LoadWord(m_RAM + address));
 }
 template<typename T>
 void VirtualMachine::Pack(uint32 address, T value)
 {
-        auto n = static_cast<uint32>(value);
-#ifdef WORD_BIG_ENDIAN
-        m_RAM[address+3] = (n >> 24) & 0xFF;
-        m_RAM[address+2] = (n >> 16) & 0xFF;
-        m_RAM[address+1] = (n >> 8) & 0xFF;
-        m_RAM[address+0] = n & 0xFF;
-#elif //WORD_LITTLE_ENDIAN
-        m_RAM[address+0] = (n >> 24) & 0xFF;
-        m_RAM[address+1] = (n >> 16) & 0xFF;
-        m_RAM[address+2] = (n >> 8) & 0xFF;
-        m_RAM[address+3] = n & 0xFF;
-#endif
+        StoreWord(m_RAM + address, static_cast<uint32>(value));
 }
 
-void VirtualMachine::PrintHeap(bool baseOffset)
-{
-        uint32 offset = baseOffset ? m_HeapBase : 0;
-        auto nextSegment = Unpack<uint32>(m_FirstSegmentPtr);
-
-        std::cout << "[DBG Heap]: "<< m_FirstSegmentPtr-offset << " first: " << nextSegment-offset << " \t";
-        while (nextSegment != 0)
-        {
-                std::cout << "@" << nextSegment-offset << "{s: " << Unpack<uint32>(nextSegment);
-                nextSegment = Unpack<uint32>(nextSegment + sizeof(uint32));
-                std::cout << "; n: " << nextSegment-offset << "} ";
-        }
-        std::cout << std::endl;
-}
+template RunStatus VirtualMachine::Interpret<SequenceProfiler>(SequenceProfiler &hooks);
+template RunStatus VirtualMachine::Interpret<OpcodeTracer>(OpcodeTracer &hooks);
+template RunStatus VirtualMachine::Interpret<StateTracer>(StateTracer &hooks);
+template RunStatus VirtualMachine::Interpret<ExecutionProfiler>(ExecutionProfiler &hooks);
+template RunStatus VirtualMachine::Interpret<DispatchCounter>(DispatchCounter &hooks);
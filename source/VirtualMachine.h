@@ -2,10 +2,54 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 
 #include "AtomicTypes.h"
+#include "Opcode.h"
+#include "HeapAllocator.h"
+#include "WordFormat.h"
+#include "OutputSink.h"
+#include "ProgramImage.h"
 
-#define VM_DEBUG_HEAP
+//Define VM_DEBUG_HEAP to print every free list after each ALLOC and FREE
+
+//Keep the top of stack in a register while interpreting, define VM_NO_TOS_CACHE to always go through RAM
+#ifndef VM_NO_TOS_CACHE
+    #define VM_CACHE_TOS
+#endif
+
+class VirtualMachine;
+
+enum class RunStatus
+{
+    FINISHED,           //The program ended, running it again does nothing
+    BUDGET_EXHAUSTED,   //Run used up its instructions, the next Run or Interpret resumes where this one stopped
+    ERROR               //The program was stopped by a runtime error
+};
+
+//Interpret is instantiated per hook type and calls OnInstruction before every dispatched instruction,
+//with the index of the decoded instruction. The default NullHooks compile away entirely.
+//Hooks that set SYNC_STATE get the cached top of stack written back to RAM before each call, so the stack
+//and registers can be read through the VM accessors
+struct NullHooks
+{
+    static const bool SYNC_STATE = false;
+    void OnInstruction(const VirtualMachine&, uint32, Opcode) {}
+};
+
+//Counts dispatches, and instructions with every superinstruction counted as all of its parts
+struct DispatchCounter
+{
+    static const bool SYNC_STATE = false;
+    uint64 dispatches = 0;
+    uint64 instructions = 0;
+    void OnInstruction(const VirtualMachine&, uint32, Opcode code)
+    {
+        const Superinstruction* fused = GetSuperinstruction(code);
+        ++dispatches;
+        instructions += fused ? fused->length : 1;
+    }
+};
 
 class VirtualMachine
 {
@@ -13,42 +57,116 @@ class VirtualMachine
     VirtualMachine();
     ~VirtualMachine();
 
-    bool LoadProgram(std::string filename);
-    void SetProgram(std::vector<uint8> bytecode);
-
-    void Interpret();
+    //Loads or decodes an image of its own for this VM
+    bool LoadProgram(const std::string &filename);
+    bool SetProgram(const uint8* bytecode, size_t size);
+    bool SetProgram(const std::vector<uint8> &bytecode) { return SetProgram(bytecode.data(), bytecode.size()); }
+    //Runs a shared image, the VM only allocates its own stack, statics and heap. The code segment isn't copied
+    //into this VM's RAM, its addresses stay reserved so the layout is the same for every VM running the image
+    bool SetProgram(std::shared_ptr<const ProgramImage> image);
+    const std::shared_ptr<const ProgramImage>& GetProgram() const { return m_pImage; }
+    //Overrides the heap size from the executable header for programs set after this, 0 uses the header
+    void SetHeapSize(uint32 heapSize) { m_HeapSizeOverride = heapSize; }
+    //Destination of PRINT, PRINT_INT and PRINT_ENDL, flushed when the program ends. nullptr restores stdout.
+    //The sink isn't owned and has to outlive the calls to Interpret
+    void SetOutput(OutputSink* pSink) { m_pOutput = pSink ? pSink : &m_StdOutput; }
+    static const uint32 DEFAULT_JIT_THRESHOLD = 100;
+    //Calls or loop iterations after which Interpret compiles a function to native code, 0 turns the JIT off. Applies to programs set
+    //after this, builds without VM_JIT always interpret
+    void SetJitThreshold(uint32 threshold) { m_JitThreshold = threshold; }
+
+    //Runs until the program ends, returns FINISHED or ERROR if a runtime error stopped it
+    RunStatus Interpret();
+    template<typename THooks>
+    RunStatus Interpret(THooks &hooks);
+    //Runs at least maxInstructions instructions unless the program ends first. The budget is only checked at
+    //backward jumps and calls, so it can overshoot by the longest straight run of code in the program
+    RunStatus Run(uint64 maxInstructions);
+    //Runs the program from its start on the register form of its image instead of the stack code, with the same
+    //output and RAM. Counts the dispatched register instructions into pDispatches if it isn't nullptr
+    RunStatus InterpretRegisters(uint64* pDispatches = nullptr);
+
+    //Heap telemetry, cheap to query. PrintHeap walks every free list
+    HeapStats GetHeapStats() const { return m_Heap.GetStats(); }
+    void PrintHeap(std::ostream &stream) const { m_Heap.Print(stream); }
+
+    //State access for hooks, the stack is only up to date in RAM for hooks with SYNC_STATE
+    uint32 GetInstructionAddress(uint32 index) const { return m_pImage->GetInstruction(index).address; }
+    int32 GetStackPointer() const { return m_StackPointer; }
+    uint32 GetLocalBase() const { return m_LCL; }
+    uint32 GetArgumentBase() const { return m_ARG; }
+    uint32 GetReturnAddress() const { return m_RTN; }
+    int32 ReadWord(uint32 address) const { return static_cast<int32>(LoadWord(m_RAM + address)); }
 
 private:
+    template<typename THooks, bool BUDGETED>
+    RunStatus Execute(THooks &hooks, int64 budget);
+    template<bool COUNTED>
+    RunStatus ExecuteRegisters(uint64 &dispatches);
+#ifdef VM_JIT
+    void CompileFunction(uint32 index);
+    //Runs native code with the VM registers, returns the decoded index to continue interpreting at
+    uint32 RunJit(JitEntry entry);
+#endif
+
     //Stack Manipulation
     void Push(int32 value);
     int32 Pop();
+    //Stack access for the cached top of stack, addresses are signed so the guard word is reachable
+    inline int32 LoadStackWord(int32 sp);
+    inline void StoreStackWord(int32 sp, int32 value);
+    inline int32 PopCached(int32 &tos, int32 &sp);
 
     //Manipulate memory with 4 bytes
     template<typename T>
     T Unpack(uint32 address);
     template<typename T>
-    T Unpack(uint32 address, std::vector<uint8> data);
-    template<typename T>
     void Pack(uint32 address, T value);
 
-	void PrintHeap(bool baseOffset = false);
+	//Reserve address space for stack, code, statics and heap, pages are committed when first touched
+	bool ReserveRAM(uint32 size);
+	void ReleaseRAM();
+
+	uint32 Resolve(uint32 address) const { return m_pImage->Resolve(address); }
 
 private:
     //Static Sizes
-    static const uint32 MAX_RAM = 536870912; //500 MB
+    static const uint32 STACK_GUARD_SIZE = sizeof(int32);
+    uint32 m_RAMSize = 0;
+    uint32 m_HeapSizeOverride = 0;
     uint32 m_StackSize;
-    uint32 m_NumInstructions = 0;
 	uint32 m_StaticBase = 0;
     uint32 m_HeapBase = 0;
 
 	//State
     bool ProgramLoaded = false;
 
+    //Output
+    StdoutSink m_StdOutput;
+    OutputSink* m_pOutput = &m_StdOutput;
+
     //RAM
-    uint8* m_RAM;
+    uint8* m_RAMBlock = nullptr;
+    uint8* m_RAM = nullptr;
+
+    //Program
+    using Instruction = ProgramImage::Instruction;
+    std::shared_ptr<const ProgramImage> m_pImage;
+    const Instruction* m_Code = nullptr;    //Stream of the image bound to the running Interpret instantiation
+    const void* const* m_BoundTable = nullptr; //Dispatch table m_Code is bound to, rebinding takes the image's lock
+
+    //Baseline JIT, only used by Interpret without hooks
+    uint32 m_JitThreshold = DEFAULT_JIT_THRESHOLD;
+#ifdef VM_JIT
+    std::vector<uint32> m_HotCounts;        //Times a function body or loop head was reached, per decoded index
+    std::vector<JitEntry> m_JitEntries;     //Native entry point per decoded index, nullptr where there is none
+#endif
 
     //Registers
     uint32 m_ProgramCounter = 0;
+    uint32 m_ResumeIndex = 0;           //Decoded instruction the next Run or Interpret starts at
+    RunStatus m_Status = RunStatus::FINISHED;
+    bool m_Ended = false;
 
 	//Stack frame, potentially static variables if so desired
 	//***********
@@ -78,5 +196,5 @@ private:
 
 	//Dynamic Memory Allocation
 	//***************
-	uint32 m_FirstSegmentPtr = 0;
+	HeapAllocator m_Heap;	//Keeps its free lists in RAM at m_HeapBase
 };
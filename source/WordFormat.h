@@ -0,0 +1,53 @@
+#pragma once
+#include <cstring>
+
+#include "AtomicTypes.h"
+
+//Words in executables and in VM memory are 32 bit little endian. The stack, static variables and heap segments
+//are 4 byte aligned so word access compiles down to single native loads and stores; code is byte packed.
+//Bump WORD_FORMAT_VERSION whenever the encoding, the opcode numbering or the executable header changes
+static const uint32 WORD_FORMAT_VERSION = 3;
+
+//Executable header, one word per field, followed by the code segment
+enum HeaderWord : uint32
+{
+	HEADER_VERSION,				//WORD_FORMAT_VERSION the executable was compiled with
+	HEADER_SUPERINSTRUCTIONS,	//Id of the superinstruction set the assembler fused with
+	HEADER_STACK_SIZE,
+	HEADER_STATIC_SIZE,
+	HEADER_HEAP_SIZE,			//Maximum heap size in bytes, the VM reserves but doesn't commit it
+
+	HEADER_WORD_COUNT
+};
+
+inline uint32 ByteSwap32(uint32 value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_bswap32(value);
+#else
+	return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+#endif
+}
+
+inline uint32 LoadWord(const uint8* source)
+{
+	uint32 value;
+	std::memcpy(&value, source, sizeof(uint32));
+#ifdef HOST_BIG_ENDIAN
+	value = ByteSwap32(value);
+#endif
+	return value;
+}
+
+inline void StoreWord(uint8* target, uint32 value)
+{
+#ifdef HOST_BIG_ENDIAN
+	value = ByteSwap32(value);
+#endif
+	std::memcpy(target, &value, sizeof(uint32));
+}
+
+inline uint32 AlignWord(uint32 size)
+{
+	return (size + sizeof(uint32) - 1) & ~static_cast<uint32>(sizeof(uint32) - 1);
+}
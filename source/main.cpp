@@ -1,12 +1,38 @@
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <limits>
+#include <stdexcept>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <sys/stat.h>
+
+#ifdef PLATFORM_Win
+    #include <windows.h>
+#else
+    #include <dirent.h>
+#endif
 
 #include "VirtualMachine.h"
 #include "AssemblyCompiler.h"
+#include "SymbolTable.h"
 #include "Opcode.h"
+#include "SequenceProfiler.h"
+#include "Tracer.h"
+#include "ExecutionProfiler.h"
+#include "VMPool.h"
+#include "CppTranslator.h"
+#include "RegisterCode.h"
+#include "ObjectFile.h"
+#include "Linker.h"
+#include "BytecodeCache.h"
 
 static const std::string AssemblyExtension(".bca");
 static const std::string ExecutableExtension(".bce");
+static const std::string ObjectExtension(".bco");
 
 bool hasEnding (std::string const &fullString, std::string const &ending) 
 {
@@ -20,14 +46,419 @@ bool hasEnding (std::string const &fullString, std::string const &ending)
     }
 }
 
+enum class TraceMode
+{
+    NONE,
+    OPCODE, //--trace
+    STATE   //--trace=full
+};
+
+//Options following the filename
+struct Options
+{
+    uint32 heapSize = 0;        //--heap=[bytes]
+    std::string heapStatsFile;  //--heap-stats=[file], - for stdout
+    TraceMode trace = TraceMode::NONE;
+    std::string outputFile;     //--output=[file], program output goes to stdout without it
+    uint32 threads = 0;         //--threads=[count], most worker threads parallel tries and assemble uses, 0 for all hardware threads
+    uint32 repeat = 1;          //--repeat=[count], times parallel runs every program
+    uint32 jitThreshold = VirtualMachine::DEFAULT_JIT_THRESHOLD; //--jit-threshold=[count], 0 interprets everything
+    bool registers = false;     //--registers, run the register code instead of the stack code
+    bool cache = true;          //--no-cache, cRun always assembles and leaves the bytecode cache alone
+    uint32 cacheSize = static_cast<uint32>(BytecodeCache::DEFAULT_SIZE_CAP); //--cache-size=[bytes]
+};
+
+//Returns false if an option is malformed
+bool ParseOptions(int argc, char** argv, Options &options)
+{
+    static const std::string HeapFlag("--heap=");
+    static const std::string HeapStatsFlag("--heap-stats=");
+    static const std::string OutputFlag("--output=");
+    static const std::string ThreadsFlag("--threads=");
+    static const std::string RepeatFlag("--repeat=");
+    static const std::string JitThresholdFlag("--jit-threshold=");
+    static const std::string CacheSizeFlag("--cache-size=");
+    for(int i = 3; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        if(arg == "--trace")
+        {
+            options.trace = TraceMode::OPCODE;
+            continue;
+        }
+        if(arg == "--trace=full")
+        {
+            options.trace = TraceMode::STATE;
+            continue;
+        }
+        if(arg == "--registers")
+        {
+            options.registers = true;
+            continue;
+        }
+        if(arg == "--no-cache")
+        {
+            options.cache = false;
+            continue;
+        }
+        if(arg.compare(0, OutputFlag.size(), OutputFlag) == 0)
+        {
+            options.outputFile = arg.substr(OutputFlag.size());
+            continue;
+        }
+        if(arg.compare(0, HeapStatsFlag.size(), HeapStatsFlag) == 0)
+        {
+            options.heapStatsFile = arg.substr(HeapStatsFlag.size());
+            continue;
+        }
+        uint32* pCount = nullptr;
+        size_t flagSize = 0;
+        if(arg.compare(0, HeapFlag.size(), HeapFlag) == 0)
+        {
+            pCount = &options.heapSize;
+            flagSize = HeapFlag.size();
+        }
+        else if(arg.compare(0, ThreadsFlag.size(), ThreadsFlag) == 0)
+        {
+            pCount = &options.threads;
+            flagSize = ThreadsFlag.size();
+        }
+        else if(arg.compare(0, RepeatFlag.size(), RepeatFlag) == 0)
+        {
+            pCount = &options.repeat;
+            flagSize = RepeatFlag.size();
+        }
+        else if(arg.compare(0, JitThresholdFlag.size(), JitThresholdFlag) == 0)
+        {
+            pCount = &options.jitThreshold;
+            flagSize = JitThresholdFlag.size();
+        }
+        else if(arg.compare(0, CacheSizeFlag.size(), CacheSizeFlag) == 0)
+        {
+            pCount = &options.cacheSize;
+            flagSize = CacheSizeFlag.size();
+        }
+        else continue;
+        try
+        {
+            unsigned long value = std::stoul(arg.substr(flagSize));
+            if(value > std::numeric_limits<uint32>::max()) throw std::out_of_range(arg);
+            *pCount = static_cast<uint32>(value);
+        }
+        catch(const std::exception&)
+        {
+            std::cerr << "invalid number: " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//Dumps the heap telemetry as JSON once the program ended
+void WriteHeapStats(const VirtualMachine* pVM, const Options &options)
+{
+    if(options.heapStatsFile.empty()) return;
+    if(options.heapStatsFile == "-")
+    {
+        pVM->GetHeapStats().WriteJson(std::cout);
+        return;
+    }
+    std::ofstream file(options.heapStatsFile);
+    if(!file.good())
+    {
+        std::cerr << "could not write heap stats to " << options.heapStatsFile << std::endl;
+        return;
+    }
+    pVM->GetHeapStats().WriteJson(file);
+}
+
+//Interprets with the hooks for the trace mode, each mode is its own instantiation of the interpreter loop
+void RunProgram(VirtualMachine* pVM, const Options &options)
+{
+    //Traces go to std::cout directly, so program output can't sit in a buffer in between
+    StdoutSink unbuffered(0);
+    FileSink file;
+    if(!options.outputFile.empty())
+    {
+        if(!file.Open(options.outputFile)) return;
+        pVM->SetOutput(&file);
+    }
+    else if(options.trace != TraceMode::NONE) pVM->SetOutput(&unbuffered);
+
+    switch(options.trace)
+    {
+    case TraceMode::NONE:
+        if(options.registers) pVM->InterpretRegisters();
+        else pVM->Interpret();
+        break;
+    case TraceMode::OPCODE:
+    {
+        OpcodeTracer tracer(std::cout);
+        pVM->Interpret(tracer);
+        break;
+    }
+    case TraceMode::STATE:
+    {
+        StateTracer tracer(std::cout);
+        pVM->Interpret(tracer);
+        break;
+    }
+    }
+    pVM->SetOutput(nullptr);
+    WriteHeapStats(pVM, options);
+}
+
+//Compiles assembly files, loads executables. Functions compiled from assembly are named in the profiler if there is one
+bool SetupProgram(VirtualMachine* pVM, const std::string &filename, ExecutionProfiler* pProfiler = nullptr)
+{
+    if(!hasEnding(filename, AssemblyExtension))
+    {
+        return pVM->LoadProgram(filename);
+    }
+
+    AssemblyCompiler* pCmp = new AssemblyCompiler();
+    pCmp->LoadSource(filename);
+    pCmp->Compile();
+    bool compiled = pCmp->GetState() == AssemblyCompiler::CompState::COMPILED;
+    if(compiled)
+    {
+        compiled = pVM->SetProgram(pCmp->GetBytecode());
+    }
+    if(compiled && pProfiler)
+    {
+        for(const auto &function : pCmp->GetSymbolTable()->GetFunctions())
+        {
+            pProfiler->SetFunctionName(function.second, function.first);
+        }
+    }
+    delete pCmp; 
+    pCmp = nullptr;
+    return compiled;
+}
+
+//Adds the executables and assembly files in a directory, or the path itself if it isn't a directory
+void AddProgramFiles(const std::string &path, std::vector<std::string> &files)
+{
+    std::vector<std::string> found;
+#ifdef PLATFORM_Win
+    WIN32_FIND_DATAA entry;
+    HANDLE hFind = FindFirstFileA((path + "\\*").c_str(), &entry);
+    if(hFind == INVALID_HANDLE_VALUE)
+    {
+        files.push_back(path);
+        return;
+    }
+    do
+    {
+        found.push_back(path + "/" + entry.cFileName);
+    } while(FindNextFileA(hFind, &entry));
+    FindClose(hFind);
+#else
+    DIR* pDir = opendir(path.c_str());
+    if(pDir == nullptr)
+    {
+        files.push_back(path);
+        return;
+    }
+    while(dirent* pEntry = readdir(pDir))
+    {
+        found.push_back(path + "/" + pEntry->d_name);
+    }
+    closedir(pDir);
+#endif
+    std::sort(found.begin(), found.end());
+    for(const auto &file : found)
+    {
+        if(hasEnding(file, ExecutableExtension) || hasEnding(file, AssemblyExtension)) files.push_back(file);
+    }
+}
+
+//Loads executables, compiles assembly files
+std::shared_ptr<const ProgramImage> LoadImage(const std::string &filename)
+{
+    auto image = std::make_shared<ProgramImage>();
+    if(!hasEnding(filename, AssemblyExtension))
+    {
+        if(!image->Load(filename)) return nullptr;
+        return image;
+    }
+
+    AssemblyCompiler* pCmp = new AssemblyCompiler();
+    pCmp->LoadSource(filename);
+    pCmp->Compile();
+    bool compiled = pCmp->GetState() == AssemblyCompiler::CompState::COMPILED && image->SetBytecode(pCmp->GetBytecode().data(), pCmp->GetBytecode().size());
+    delete pCmp; 
+    pCmp = nullptr;
+    if(!compiled) return nullptr;
+    return image;
+}
+
+//Object file assemble writes for an assembly file, next to it
+std::string GetObjectName(const std::string &filename)
+{
+    if(hasEnding(filename, AssemblyExtension)) return filename.substr(0, filename.size() - AssemblyExtension.size()) + ObjectExtension;
+    return filename + ObjectExtension;
+}
+
+//Modification time of a file in nanoseconds where the platform records them, false if it doesn't exist
+bool GetModificationTime(const std::string &filename, uint64 &time)
+{
+    struct stat info;
+    if(stat(filename.c_str(), &info) != 0) return false;
+#ifdef PLATFORM_Linux
+    time = static_cast<uint64>(info.st_mtim.tv_sec) * 1000000000ull + static_cast<uint64>(info.st_mtim.tv_nsec);
+#else
+    time = static_cast<uint64>(info.st_mtime) * 1000000000ull;
+#endif
+    return true;
+}
+
+//Like make, an object is up to date if it was written after its source was last changed
+bool IsUpToDate(const std::string &source, const std::string &object)
+{
+    uint64 sourceTime;
+    uint64 objectTime;
+    if(!GetModificationTime(source, sourceTime) || !GetModificationTime(object, objectTime)) return false;
+    return objectTime >= sourceTime;
+}
+
+//Assembles .bca files into objects next to them on up to --threads worker threads, only if their object is missing or
+//older than the source. .bco files are loaded as they are. objects holds the modules in the order of the files
+bool AssembleObjects(const std::vector<std::string> &files, const Options &options, std::vector<ObjectFile> &objects)
+{
+    enum class Result
+    {
+        FAILED,
+        UP_TO_DATE,
+        ASSEMBLED
+    };
+    std::vector<Result> results(files.size(), Result::FAILED);
+    objects.assign(files.size(), ObjectFile());
+    std::atomic<size_t> next(0);
+    auto work = [&]()
+    {
+        for(size_t i = next++; i < files.size(); i = next++)
+        {
+            const std::string &file = files[i];
+            if(!hasEnding(file, AssemblyExtension))
+            {
+                if(objects[i].Load(file)) results[i] = Result::UP_TO_DATE;
+                continue;
+            }
+            //Objects of another format or superinstruction set fail to load and are reassembled
+            std::string objectFile = GetObjectName(file);
+            if(IsUpToDate(file, objectFile) && objects[i].Load(objectFile))
+            {
+                results[i] = Result::UP_TO_DATE;
+                continue;
+            }
+            AssemblyCompiler compiler;
+            compiler.SetQuiet(true);
+            compiler.SetRelocatable(true);
+            if(compiler.LoadSource(file) && compiler.Compile() && compiler.Save(objectFile))
+            {
+                objects[i] = compiler.GetObject();
+                results[i] = Result::ASSEMBLED;
+            }
+        }
+    };
+
+    size_t threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    threads = std::max<size_t>(std::min(threads, files.size()), 1);
+    std::vector<std::thread> workers;
+    for(size_t i = 1; i < threads; ++i) workers.emplace_back(work);
+    work();
+    for(auto &worker : workers) worker.join();
+
+    bool succeeded = true;
+    for(size_t i = 0; i < files.size(); ++i)
+    {
+        switch(results[i])
+        {
+        case Result::FAILED:
+            std::cout << "failed      " << files[i] << std::endl;
+            succeeded = false;
+            break;
+        case Result::UP_TO_DATE:
+            std::cout << "up to date  " << files[i] << std::endl;
+            break;
+        case Result::ASSEMBLED:
+            std::cout << "assembled   " << files[i] << " >> " << GetObjectName(files[i]) << std::endl;
+            break;
+        }
+    }
+    return succeeded;
+}
+
+//Runs every program repeat times on pools of 1, 2, 4 ... threads and reports how throughput scales
+bool RunParallel(const std::vector<std::string> &files, const Options &options)
+{
+    std::vector<std::shared_ptr<const ProgramImage>> images;
+    for(const auto &file : files)
+    {
+        auto image = LoadImage(file);
+        if(!image)
+        {
+            std::cerr << "could not load " << file << std::endl;
+            return false;
+        }
+        images.push_back(image);
+    }
+
+    uint32 maxThreads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+    if(maxThreads == 0) maxThreads = 1;
+    std::vector<uint32> threadCounts;
+    for(uint32 threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    uint64 jobCount = static_cast<uint64>(images.size()) * options.repeat;
+    std::cout << files.size() << " programs, " << jobCount << " jobs per run" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "seconds" << std::setw(12) << "jobs/s" << std::setw(10) << "speedup" << std::setw(12) << "efficiency" << std::endl;
+
+    double baseSeconds = 0.0;
+    for(uint32 threads : threadCounts)
+    {
+        VMPool pool(threads);
+        std::vector<std::future<VMJobResult>> results;
+        results.reserve(static_cast<size_t>(jobCount));
+        auto start = std::chrono::steady_clock::now();
+        for(uint32 round = 0; round < options.repeat; ++round)
+        {
+            for(const auto &image : images)
+            {
+                VMJob job;
+                job.image = image;
+                job.heapSize = options.heapSize;
+                results.push_back(pool.Submit(job));
+            }
+        }
+        uint32 failed = 0;
+        for(auto &result : results)
+        {
+            if(!result.get().succeeded) ++failed;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if(threads == threadCounts.front()) baseSeconds = seconds;
+
+        double speedup = seconds > 0.0 ? baseSeconds / seconds : 0.0;
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(3) << std::setw(12) << seconds 
+            << std::setprecision(1) << std::setw(12) << (seconds > 0.0 ? static_cast<double>(jobCount - failed) / seconds : 0.0)
+            << std::setprecision(2) << std::setw(10) << speedup << std::setw(12) << speedup / threads << std::endl;
+        if(failed != 0) std::cout << failed << " jobs failed" << std::endl;
+    }
+    return true;
+}
+
 int main(int argc, char** argv)
 {
-    if(argc != 3)	
+    if(argc < 3)	
     {
         std::cout << "usage: [operation] [filename]" << std::endl; 
         return 1; 
     }
     std::string filename = argv[2];
+    Options options;
+    if(!ParseOptions(argc, argv, options)) return 1;
     if(std::string(argv[1]) == "run")
     {
         std::cout << "running " << filename << std::endl; 
@@ -35,8 +466,16 @@ int main(int argc, char** argv)
         
         //Create a new VM / interpreter
         VirtualMachine* pVM = new VirtualMachine();
-        pVM->LoadProgram(filename);
-        pVM->Interpret();
+        pVM->SetHeapSize(options.heapSize);
+        pVM->SetJitThreshold(options.jitThreshold);
+        if(!pVM->LoadProgram(filename))
+        {
+            std::cout << "script loading failed!" << std::endl; 
+            delete pVM;
+            pVM = nullptr;
+            return 4;
+        }
+        RunProgram(pVM, options);
         delete pVM;
         pVM = nullptr;
         
@@ -50,6 +489,7 @@ int main(int argc, char** argv)
         std::cout << std::endl; 
 
         AssemblyCompiler* pCmp = new AssemblyCompiler();
+        if(options.heapSize != 0) pCmp->SetHeapSize(options.heapSize);
         pCmp->LoadSource(filename);
 
         pCmp->Compile();
@@ -85,37 +525,205 @@ int main(int argc, char** argv)
         std::cout << std::endl; 
 
         AssemblyCompiler* pCmp = new AssemblyCompiler();
+        if(options.heapSize != 0) pCmp->SetHeapSize(options.heapSize);
         pCmp->LoadSource(filename);
 
-        pCmp->Compile();
+        VirtualMachine* pVM = new VirtualMachine();
+        pVM->SetJitThreshold(options.jitThreshold);
+
+        //Entries are keyed by the source text, a hit loads the executable without assembling it
+        BytecodeCache cache(options.cache ? BytecodeCache::GetDefaultDirectory() : std::string(), options.cacheSize);
+        std::string entry;
+        if(cache.IsEnabled() && pCmp->GetState() == AssemblyCompiler::CompState::SOURCE) entry = cache.GetEntry(pCmp->GetSource(), options.heapSize);
+        bool cached = !entry.empty() && cache.Find(entry) && pVM->LoadProgram(entry);
+        if(cached) std::cout << "[CACHE] Using cached executable " << entry << std::endl;
+        else pCmp->Compile();
 
         std::cout << std::endl; 
         std::cout << "=======================" << std::endl; 
-        if(!(pCmp->GetState() == AssemblyCompiler::CompState::COMPILED))
+        if(!cached && !(pCmp->GetState() == AssemblyCompiler::CompState::COMPILED))
         {
             std::cout << "script compilation failed!" << std::endl; 
             delete pCmp; 
             pCmp = nullptr;
+            delete pVM;
+            pVM = nullptr;
             return 3;
         }
+        //Only executables the VM accepted go into the cache
+        if(!cached && !pVM->SetProgram(pCmp->GetBytecode()))
+        {
+            std::cout << "script loading failed!" << std::endl; 
+            delete pCmp; 
+            pCmp = nullptr;
+            delete pVM;
+            pVM = nullptr;
+            return 4;
+        }
+        if(!cached && !entry.empty()) cache.Store(entry, pCmp->GetBytecode());
+
+        delete pCmp; 
+        pCmp = nullptr;
+
         std::cout << "running " << filename << std::endl; 
         std::cout << std::endl; 
 
+        RunProgram(pVM, options);
+
+        delete pVM;
+        pVM = nullptr;
+
+        std::cout << std::endl; 
+        std::cout << "=======================" << std::endl; 
+
+    }
+    else if(std::string(argv[1]) == "seqProfile")
+    {
+        if(argc < 4)
+        {
+            std::cout << "usage: seqProfile [filename] [profile]" << std::endl; 
+            return 1; 
+        }
+        std::cout << "profiling " << filename << std::endl; 
+        std::cout << std::endl; 
+
         VirtualMachine* pVM = new VirtualMachine();
+        pVM->SetHeapSize(options.heapSize);
+        if(!SetupProgram(pVM, filename))
+        {
+            delete pVM;
+            pVM = nullptr;
+            return 3;
+        }
 
-        pVM->SetProgram(pCmp->GetBytecode());
+        SequenceProfiler profiler;
+        pVM->Interpret(profiler);
+        WriteHeapStats(pVM, options);
+        delete pVM;
+        pVM = nullptr;
 
-        delete pCmp; 
-        pCmp = nullptr;
+        std::cout << std::endl; 
+        std::cout << "=======================" << std::endl; 
+        if(!profiler.Save(argv[3])) return 4;
+    }
+    else if(std::string(argv[1]) == "profile")
+    {
+        std::cout << "profiling " << filename << std::endl; 
+        std::cout << std::endl; 
 
-        pVM->Interpret();
+        VirtualMachine* pVM = new VirtualMachine();
+        pVM->SetHeapSize(options.heapSize);
+        ExecutionProfiler profiler;
+        if(!SetupProgram(pVM, filename, &profiler))
+        {
+            delete pVM;
+            pVM = nullptr;
+            return 3;
+        }
 
+        pVM->Interpret(profiler);
+        WriteHeapStats(pVM, options);
         delete pVM;
         pVM = nullptr;
 
         std::cout << std::endl; 
         std::cout << "=======================" << std::endl; 
+        profiler.Report(std::cout);
+    }
+    else if(std::string(argv[1]) == "translate")
+    {
+        auto image = LoadImage(filename);
+        if(!image)
+        {
+            std::cerr << "could not load " << filename << std::endl;
+            return 3;
+        }
+        //--output names the C++ file, it defaults to the program's name with a .cpp extension
+        std::string outputFile = options.outputFile;
+        if(outputFile.empty())
+        {
+            outputFile = filename;
+            size_t extension = outputFile.find_last_of('.');
+            if(extension != std::string::npos && outputFile.find_first_of("/\\", extension) == std::string::npos) outputFile.erase(extension);
+            outputFile += ".cpp";
+        }
+        std::ofstream file(outputFile);
+        CppTranslator translator;
+        if(!file || !translator.Translate(*image, filename, file))
+        {
+            std::cerr << "could not write " << outputFile << std::endl;
+            return 4;
+        }
+        std::cout << "translated " << filename << " to " << outputFile << std::endl;
+    }
+    else if(std::string(argv[1]) == "registers")
+    {
+        auto image = LoadImage(filename);
+        if(!image)
+        {
+            std::cerr << "could not load " << filename << std::endl;
+            return 3;
+        }
+        image->GetRegisterCode().Print(std::cout);
+    }
+    else if(std::string(argv[1]) == "assemble")
+    {
+        std::vector<std::string> files;
+        for(int i = 2; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            if(arg.compare(0, 2, "--") != 0) AddProgramFiles(arg, files);
+        }
+        files.erase(std::remove_if(files.begin(), files.end(), [](const std::string &file) { return !hasEnding(file, AssemblyExtension); }), files.end());
+        if(files.empty())
+        {
+            std::cout << "no assembly files found" << std::endl; 
+            return 1; 
+        }
+        std::vector<ObjectFile> objects;
+        if(!AssembleObjects(files, options, objects)) return 3;
+    }
+    else if(std::string(argv[1]) == "link")
+    {
+        //The output comes first, then the modules in the order they are laid out
+        std::vector<std::string> files;
+        for(int i = 3; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            if(arg.compare(0, 2, "--") != 0) files.push_back(arg);
+        }
+        if(files.empty())
+        {
+            std::cout << "usage: link [output] [modules...]" << std::endl; 
+            return 1; 
+        }
+        std::vector<ObjectFile> objects;
+        if(!AssembleObjects(files, options, objects)) return 3;
 
+        Linker linker;
+        if(options.heapSize != 0) linker.SetHeapSize(options.heapSize);
+        for(size_t i = 0; i < files.size(); ++i) linker.AddObject(std::move(objects[i]), files[i]);
+        if(!linker.Link() || !linker.Save(filename)) 
+        {
+            std::cout << "linking failed!" << std::endl; 
+            return 4;
+        }
+        std::cout << "linked " << files.size() << " modules >> output file: " << filename << std::endl; 
+    }
+    else if(std::string(argv[1]) == "parallel")
+    {
+        std::vector<std::string> files;
+        for(int i = 2; i < argc; ++i)
+        {
+            std::string arg(argv[i]);
+            if(arg.compare(0, 2, "--") != 0) AddProgramFiles(arg, files);
+        }
+        if(files.empty())
+        {
+            std::cout << "no programs found" << std::endl; 
+            return 1; 
+        }
+        if(!RunParallel(files, options)) return 3;
     }
     else
     {
@@ -124,6 +732,25 @@ int main(int argc, char** argv)
         std::cout << "operations: " << std::endl; 
         std::cout << "\trun >> Run virtual machine with executable bytecode" << std::endl; 
         std::cout << "\tcompile >> compile assembly code to executable bytecode" << std::endl; 
+        std::cout << "\tcRun >> compile and run assembly code without saving the executable, reusing executables from the bytecode cache" << std::endl; 
+        std::cout << "\tseqProfile [profile] >> run an executable or assembly file and save how often opcode sequences execute" << std::endl; 
+        std::cout << "\tprofile >> run an executable or assembly file and report time spent per opcode and per function" << std::endl; 
+        std::cout << "\ttranslate >> translate an executable or assembly file to a standalone C++ file, --output=[file] names it" << std::endl; 
+        std::cout << "\tregisters >> print the register code run and cRun use with --registers" << std::endl; 
+        std::cout << "\tparallel [files or directories...] >> run programs on a pool of worker threads and report how throughput scales" << std::endl; 
+        std::cout << "\tassemble [files or directories...] >> assemble modules to relocatable .bco objects in parallel, skipping objects newer than their source" << std::endl; 
+        std::cout << "\tlink [output] [modules...] >> link .bco objects and .bca modules into an executable, the first module's top level code runs" << std::endl; 
+        std::cout << "options: " << std::endl; 
+        std::cout << "\t--heap=[bytes] >> maximum heap size, compile writes it to the executable header and run overrides the header" << std::endl; 
+        std::cout << "\t--trace >> print every executed instruction, --trace=full also prints registers and the top of the stack" << std::endl; 
+        std::cout << "\t--registers >> run and cRun execute the register form of the program, traces always run the stack code" << std::endl; 
+        std::cout << "\t--output=[file] >> write the program output to a file instead of stdout, for translate the C++ file" << std::endl; 
+        std::cout << "\t--heap-stats=[file] >> write heap statistics as JSON when the program ends, - writes them to stdout" << std::endl; 
+        std::cout << "\t--threads=[count] >> most worker threads for parallel, assemble and link, all hardware threads by default" << std::endl; 
+        std::cout << "\t--repeat=[count] >> times parallel runs every program" << std::endl; 
+        std::cout << "\t--no-cache >> cRun always assembles and neither reads nor writes the bytecode cache" << std::endl; 
+        std::cout << "\t--cache-size=[bytes] >> size cap of the bytecode cache, 64 MiB by default, least recently used entries are evicted" << std::endl; 
+        std::cout << "\t--jit-threshold=[count] >> calls or loop iterations before run and cRun compile a function to native code, 0 disables the JIT (builds with VM_JIT only)" << std::endl; 
         return 2;
     }
     return 0;
@@ -0,0 +1,179 @@
+//Generates source/Superinstructions.inl from opcode sequence profiles written by "Bytecode seqProfile".
+//The VirtualMachine and the assembler pick up the new set on their next build.
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "../source/Opcode.h"
+
+struct Candidate
+{
+	std::vector<std::string> parts;
+	uint64 count = 0;
+	uint64 saved = 0;	//Dispatches a superinstruction would save over the profiled run, given the ones chosen before it
+};
+
+std::string GetKey(const std::vector<std::string> &parts)
+{
+	std::string key;
+	for(const auto &part : parts) key += (key.empty() ? "" : "__") + part;
+	return key;
+}
+
+//Positions at which inner occurs in outer
+uint32 CountOccurrences(const std::vector<std::string> &inner, const std::vector<std::string> &outer)
+{
+	uint32 occurrences = 0;
+	for(size_t start = 0; start + inner.size() <= outer.size(); ++start)
+	{
+		if(std::equal(inner.begin(), inner.end(), outer.begin() + start)) ++occurrences;
+	}
+	return occurrences;
+}
+
+//Executions of the merged sequence where the end of first overlaps the start of second by overlap opcodes. Taken from
+//the profile when it holds the merged sequence, otherwise at most every execution of the rarer of the two overlaps
+uint64 CountOverlaps(const Candidate &first, const Candidate &second, size_t overlap, const std::map<std::string, Candidate> &candidates)
+{
+	if(!std::equal(first.parts.end() - overlap, first.parts.end(), second.parts.begin())) return 0;
+	std::vector<std::string> merged(first.parts);
+	merged.insert(merged.end(), second.parts.begin() + overlap, second.parts.end());
+	auto found = candidates.find(GetKey(merged));
+	if(found != candidates.end()) return found->second.count;
+	return merged.size() <= MAX_SUPERINSTRUCTION_LENGTH ? 0 : std::min(first.count, second.count);
+}
+
+//The assembler replaces each site with one superinstruction only. Executions of a candidate inside a chosen one are
+//already fused, executions overlapping a chosen one only fuse one of the two, and executions containing a chosen
+//one only save the dispatches the chosen one doesn't
+uint64 Rescore(const Candidate &candidate, const std::vector<Candidate> &chosen, const std::map<std::string, Candidate> &candidates)
+{
+	uint64 covered = 0;
+	uint64 savedPerExecution = candidate.parts.size() - 1;
+	for(const auto &other : chosen)
+	{
+		if(candidate.parts.size() <= other.parts.size() && CountOccurrences(candidate.parts, other.parts) != 0)
+		{
+			covered += other.count * CountOccurrences(candidate.parts, other.parts);
+			continue;
+		}
+		if(CountOccurrences(other.parts, candidate.parts) != 0)
+		{
+			savedPerExecution = std::min<uint64>(savedPerExecution, candidate.parts.size() - other.parts.size());
+			continue;
+		}
+		for(size_t overlap = 1; overlap < std::min(candidate.parts.size(), other.parts.size()); ++overlap)
+		{
+			covered += CountOverlaps(candidate, other, overlap, candidates) + CountOverlaps(other, candidate, overlap, candidates);
+		}
+	}
+	return candidate.count > covered ? (candidate.count - covered) * savedPerExecution : 0;
+}
+
+bool IsCandidate(const std::vector<std::string> &parts)
+{
+	if(parts.size() < 2 || parts.size() > MAX_SUPERINSTRUCTION_LENGTH) return false;
+	for(uint32 i = 0; i < parts.size(); ++i)
+	{
+		auto it = OpcodeNames.find(parts[i]);
+		if(it == OpcodeNames.end()) return false;
+		if(GetSuperinstruction(it->second)) return false;
+		if(!IsFusable(it->second, i == parts.size() - 1)) return false;
+	}
+	return true;
+}
+
+bool ReadProfile(const std::string &filename, std::map<std::string, Candidate> &candidates)
+{
+	std::ifstream file(filename);
+	if(!file.good())
+	{
+		std::cerr << "[SUPERGEN] Could not open profile " << filename << std::endl;
+		return false;
+	}
+	std::string line;
+	while(std::getline(file, line))
+	{
+		if(line.empty() || line[0] == '/') continue;
+
+		std::istringstream stream(line);
+		uint32 length = 0;
+		uint64 count = 0;
+		stream >> length >> count;
+		Candidate candidate;
+		std::string opname;
+		while(stream >> opname) candidate.parts.push_back(opname);
+		if(candidate.parts.size() != length || !IsCandidate(candidate.parts)) continue;
+
+		auto &entry = candidates[GetKey(candidate.parts)];
+		entry.parts = candidate.parts;
+		entry.count += count;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 4)
+	{
+		std::cout << "usage: [count] [output] [profile...]" << std::endl;
+		return 1;
+	}
+	uint32 count = static_cast<uint32>(std::stoul(argv[1]));
+	std::string outname = argv[2];
+
+	//Opcodes are encoded in one byte and the decoder needs two internal ones
+	uint32 maxCount = 256 - (static_cast<uint32>(Opcode::FRAME) + 1) - 2;
+	if(count > maxCount)
+	{
+		std::cerr << "[SUPERGEN] At most " << maxCount << " superinstructions fit in the opcode space" << std::endl;
+		count = maxCount;
+	}
+
+	std::map<std::string, Candidate> candidates;
+	std::string sources;
+	for(int arg = 3; arg < argc; ++arg)
+	{
+		if(!ReadProfile(argv[arg], candidates)) return 2;
+		sources += std::string(sources.empty() ? "" : " ") + argv[arg];
+	}
+
+	//Greedy: take the candidate saving the most dispatches, then score the rest again against everything taken so far
+	std::vector<Candidate> remaining;
+	for(const auto &entry : candidates) remaining.push_back(entry.second);
+	std::vector<Candidate> ranked;
+	while(ranked.size() < count && !remaining.empty())
+	{
+		auto best = remaining.end();
+		for(auto it = remaining.begin(); it != remaining.end(); ++it)
+		{
+			it->saved = Rescore(*it, ranked, candidates);
+			if(best == remaining.end() || it->saved > best->saved) best = it;
+		}
+		if(best->saved == 0) break;
+		ranked.push_back(*best);
+		remaining.erase(best);
+	}
+
+	std::ofstream output(outname);
+	if(!output.good())
+	{
+		std::cerr << "[SUPERGEN] Output file " << outname << " could not be created" << std::endl;
+		return 3;
+	}
+	output << "//Generated by SuperinstructionGen from " << sources << ", do not edit\n";
+	output << "//Included with SUPERINSTRUCTION2(name, a, b) and SUPERINSTRUCTION3(name, a, b, c) defined\n";
+	output << "//Comments hold the profiled executions and the dispatches saved on top of the superinstructions above\n";
+	for(const auto &entry : ranked)
+	{
+		output << "SUPERINSTRUCTION" << entry.parts.size() << '(' << GetKey(entry.parts);
+		for(const auto &part : entry.parts) output << ", " << part;
+		output << ") //" << entry.count << ' ' << entry.saved << '\n';
+	}
+	std::cout << "[SUPERGEN] " << ranked.size() << " superinstructions written to " << outname << std::endl;
+	return 0;
+}